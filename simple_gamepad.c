@@ -37,19 +37,69 @@
    ======================================================================== */
 
 #include <util/delay.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include "simple_gamepad_defs.h"
 #include "simple_gamepad_usb.h"
+#include "simple_gamepad_phase.h"
+#include "simple_gamepad_feature.h"
+#include "simple_gamepad_link.h"
+#include "simple_gamepad_keyboard.h"
 
 
-#define CPU_PRESCALE(n) (CLKPR = 0x80, CLKPR = (n))
-
 // Number of 1 ms sleeps until state is automatically transmitted when there has been no change
 #define NOCHANGE_TX_COUNT   33  // Approx 30 per second
 
+// The same, counted in host polls when sampling just before each poll
+#define NOCHANGE_TX_POLLS   ((NOCHANGE_TX_COUNT + POLL_INTERVAL_MS - 1) / POLL_INTERVAL_MS)
+
+
+#if USE_IDLE_SLEEP && !USE_POLL_PHASE_TRACKING
+// Sleep until the next USB start-of-frame (1 ms) or until an input edge.
+// Returns 1 if a new frame has started, 0 if woken early by an input.
+static uint8_t
+idle_wait(void)
+{
+    uint8_t frame = UDFNUML;
+
+    // interrupts are disabled while testing the wake conditions, and the
+    // instruction after sei always executes, so a wakeup arriving between
+    // the test and the sleep is never lost
+    cli();
+    while (UDFNUML == frame && !g_inputEdge)
+    {
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+        cli();
+    }
+    g_inputEdge = 0;
+    sei();
+    return (UDFNUML != frame);
+}
+#endif
+
+#if USE_IDLE_SLEEP && IDLE_CLOCK_PRESCALE && !USE_POLL_PHASE_TRACKING
+static void
+set_clock_prescale(uint8_t n)
+{
+    uint8_t intr_state = SREG;
+    cli();
+    CPU_PRESCALE(n);
+    SREG = intr_state;
+}
+#endif
+
 
 int main(void)
 {
     uint8_t noChangeCounter = 0;
+    uint8_t changed, pending;
+#if USE_IDLE_SLEEP && IDLE_CLOCK_PRESCALE
+    uint16_t idleCounter = 0;
+#endif
 
     // set for 16 MHz clock
     CPU_PRESCALE(0);
@@ -60,6 +110,22 @@ int main(void)
     // configure Teensy inputs for buttons - this also configures LED pin for output
     simple_gamepad_configure();
 
+#if USE_LINK_SECONDARY
+    // a secondary board is not on USB: it only answers the primary
+    // board's polls, each with a new sample
+    for (;;)
+    {
+        simple_gamepad_link_wait_poll();
+        simple_gampad_read_buttons();
+        simple_gamepad_link_reply();
+    }
+#endif
+
+#if USE_POLL_PHASE_TRACKING
+    // start the clock used to follow the host's polls
+    poll_phase_init();
+#endif
+
     // Initialize the USB, and then wait for the host to set configuration.
     // If the Teensy is powered without a PC connected to the USB port,
     // this will wait forever.
@@ -70,33 +136,105 @@ int main(void)
     // and do whatever it does to actually be ready for input
     _delay_ms(1000);
 
-    // Initialize and transmit initial state
+#if USE_IDLE_SLEEP
+    set_sleep_mode(SLEEP_MODE_IDLE);
+#endif
+
+    // Initialize and transmit initial state. A report the endpoint has no
+    // room for stays pending, and is sent again until it has
     simple_gampad_read_buttons();
-    usb_simple_gamepad_send();
+    pending = usb_simple_gamepad_send() > 0;
 
+#if USE_POLL_PHASE_TRACKING
+    for (;;)
+    {
+#if USE_FEATURE_REPORT
+        // Carry out any configuration request from the host
+        if (g_featurePending)
+            simple_gamepad_feature_task();
+#endif
+
+        // Sample and load the report just before the host's next poll,
+        // sending only if the state changed or every so often otherwise
+        poll_phase_wait();
+        changed = simple_gampad_read_buttons();
+#if USE_KEYBOARD
+        usb_simple_gamepad_send_keyboard();
+#endif
+        if (changed || pending || PROBE_PENDING() || ++noChangeCounter >= NOCHANGE_TX_POLLS)
+        {
+            pending = usb_simple_gamepad_send() > 0;
+            noChangeCounter = 0;
+        }
+#if USE_SPLIT_REPORTS
+        usb_simple_gamepad_send_analog();
+#endif
+    }
+#else
     for (;;)
     {
-        if (simple_gampad_read_buttons())
+#if USE_FEATURE_REPORT
+        // Carry out any configuration request from the host
+        if (g_featurePending)
+            simple_gamepad_feature_task();
+#endif
+
+        changed = simple_gampad_read_buttons();
+#if USE_KEYBOARD
+        // the keyboard report goes first, on its own endpoint, so it is
+        // never held up waiting for room for the state report
+        usb_simple_gamepad_send_keyboard();
+#endif
+        if (changed || PROBE_PENDING())
         {
+#if USE_IDLE_SLEEP && IDLE_CLOCK_PRESCALE
+            // back to full speed before sending, in case the change came
+            // from an input that cannot interrupt
+            if (idleCounter >= IDLE_SLOWDOWN_MS)
+                set_clock_prescale(0);
+            idleCounter = 0;
+#endif
             // Send if state changed or if the host requested descriptors
-            // The time this send takes will work as simple debounce
-            usb_simple_gamepad_send();
+            pending = usb_simple_gamepad_send() > 0;
             noChangeCounter = 0;
         }
         else
         {
+#if USE_IDLE_SLEEP
+            // Sleep until the next frame or input edge otherwise
+            if (!idle_wait())
+            {
+    #if IDLE_CLOCK_PRESCALE
+                // the edge interrupt has already restored full speed
+                idleCounter = 0;
+    #endif
+                continue;
+            }
+
+    #if IDLE_CLOCK_PRESCALE
+            // Slow the clock down once nothing has changed for a while
+            if (idleCounter < IDLE_SLOWDOWN_MS && ++idleCounter == IDLE_SLOWDOWN_MS)
+                set_clock_prescale(IDLE_CLOCK_PRESCALE);
+    #endif
+#else
             // Brief sleep otherwise
             _delay_ms(1);
+#endif
 
-            // Continue to transmit state every so often when there's no change
-            if (++noChangeCounter >= NOCHANGE_TX_COUNT)
+            // Send again a report still pending, once the host has had a
+            // frame to collect one, and continue to transmit state every
+            // so often when there's no change
+            if (pending || ++noChangeCounter >= NOCHANGE_TX_COUNT)
             {
-                usb_simple_gamepad_send();
+                pending = usb_simple_gamepad_send() > 0;
                 noChangeCounter = 0;
             }
         }
+
+#if USE_SPLIT_REPORTS
+        // the analog report keeps its own pace, after the state report
+        usb_simple_gamepad_send_analog();
+#endif
     }
+#endif
 }
-
-
-
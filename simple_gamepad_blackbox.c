@@ -0,0 +1,144 @@
+/* Teensy Simple Gamepad
+ * A Gamepad device with one 2-axis D-pad and 1 or more buttons
+ * Copyright (C) 2013 Robert Byam, robertbyam.com
+ *
+ * Derived from keyboard and serial examples for Teensy USB Development Board
+ * http://www.pjrc.com/teensy/usb_keyboard.html
+ * http://www.pjrc.com/teensy/usb_serial.html
+ * Copyright (c) 2008 PJRC.COM, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* ===========================================================================
+   This software implements a generic gamepad with one 2-axis (four direction)
+   D-Pad and 1 or more button.  The intended usage is that all of these files
+   remain constant, and only the file simple_gamepad_config.h is modified to
+   specify the configurable parameters for the gamepad
+
+   simple_gamepad_blackbox.c
+   This file implements the black-box recorder. Everything runs from the
+   main loop, as the samples and the sends do, so the ring needs no
+   protection from the interrupts.
+   ======================================================================== */
+
+#include "simple_gamepad_blackbox.h"
+#include <avr/io.h>
+
+#if USE_BLACKBOX
+
+uint8_t g_blackbox[BLACKBOX_SIZE];
+uint8_t g_blackboxHead;
+uint8_t g_blackboxPorts[BLACKBOX_PORT_COUNT];
+uint8_t g_blackboxFrozen;
+
+#define BLACKBOX_NEXT(index)    ((uint8_t)((index) & (BLACKBOX_SIZE - 1)))
+
+
+/* this function ends the segment being written, unless it has only just
+   started, so the next entry starts a new one */
+static void
+blackbox_end_segment(void)
+{
+    uint8_t used = g_blackboxHead % BLACKBOX_SEGMENT;
+
+    if (used)
+    {
+        g_blackbox[g_blackboxHead] = BLACKBOX_PAD;
+        g_blackboxHead = BLACKBOX_NEXT(g_blackboxHead - used + BLACKBOX_SEGMENT);
+    }
+}
+
+
+/* this function makes room for an entry of len bytes after its header and
+   frame, starting a new segment when it does not fit in this one, and
+   writes the header and frame. Returns where the rest goes */
+static uint8_t
+blackbox_entry(uint8_t header, uint8_t len)
+{
+    uint8_t i, head;
+
+    if (g_blackboxHead % BLACKBOX_SEGMENT + 2 + len > BLACKBOX_SEGMENT)
+        blackbox_end_segment();
+    head = g_blackboxHead;
+    if (head % BLACKBOX_SEGMENT == 0)
+    {
+        // a segment starts with the ports as they were before
+        g_blackbox[head++] = BLACKBOX_KEY;
+        g_blackbox[head++] = UDFNUML;
+        for (i = 0; i < BLACKBOX_PORT_COUNT; i++)
+        {
+            g_blackbox[head++] = g_blackboxPorts[i];
+        }
+    }
+    g_blackbox[head++] = header;
+    g_blackbox[head++] = UDFNUML;
+    g_blackboxHead = BLACKBOX_NEXT(head + len);
+    return head;
+}
+
+
+/* this function records the ports whose bits are set in mask, from ports */
+void
+simple_gamepad_blackbox_ports(uint8_t mask, const uint8_t *ports)
+{
+    uint8_t i, n = 0, head;
+
+    if (!g_blackboxFrozen)
+    {
+        for (i = 0; i < BLACKBOX_PORT_COUNT; i++)
+        {
+            if (mask & (1 << i))
+                n++;
+        }
+        head = blackbox_entry(BLACKBOX_PORTS | mask, n);
+        for (i = 0; i < BLACKBOX_PORT_COUNT; i++)
+        {
+            if (mask & (1 << i))
+                g_blackbox[head++] = ports[i];
+        }
+    }
+    // kept while frozen too, for the key entry of the next segment
+    for (i = 0; i < BLACKBOX_PORT_COUNT; i++)
+    {
+        g_blackboxPorts[i] = ports[i];
+    }
+}
+
+
+/* this function records a failed send */
+void
+simple_gamepad_blackbox_send(uint8_t outcome)
+{
+    if (!g_blackboxFrozen)
+        blackbox_entry(BLACKBOX_SEND | outcome, 0);
+}
+
+
+/* this function stops recording, or resumes it in a new segment, as the
+   changes made while frozen are missing from this one */
+void
+simple_gamepad_blackbox_freeze(uint8_t frozen)
+{
+    if (g_blackboxFrozen && !frozen)
+        blackbox_end_segment();
+    g_blackboxFrozen = frozen;
+}
+
+#endif
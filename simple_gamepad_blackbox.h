@@ -0,0 +1,115 @@
+/* Teensy Simple Gamepad
+ * A Gamepad device with one 2-axis D-pad and 1 or more buttons
+ * Copyright (C) 2013 Robert Byam, robertbyam.com
+ *
+ * Derived from keyboard and serial examples for Teensy USB Development Board
+ * http://www.pjrc.com/teensy/usb_keyboard.html
+ * http://www.pjrc.com/teensy/usb_serial.html
+ * Copyright (c) 2008 PJRC.COM, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* ===========================================================================
+   This software implements a generic gamepad with one 2-axis (four direction)
+   D-Pad and 1 or more button.  The intended usage is that all of these files
+   remain constant, and only the file simple_gamepad_config.h is modified to
+   specify the configurable parameters for the gamepad
+
+   simple_gamepad_blackbox.h
+   This file declares the black-box recorder, which keeps the recent changes
+   of the input pins and the failed sends in a ring in RAM, for the host to
+   download and replay (see USE_BLACKBOX).
+   ======================================================================== */
+
+#ifndef SIMPLE_GAMEPAD_BLACKBOX_H
+#define SIMPLE_GAMEPAD_BLACKBOX_H
+
+#include "simple_gamepad_defs.h"
+
+#if USE_BLACKBOX
+
+/* the ports sampled by READ_ALL_INPUTS, in its order: B, C, D on the
+   Teensy 1.0, B to F on the Teensy 2.0 and A to F on the Teensy++ */
+#if defined(__AVR_ATmega32U4__)
+#define BLACKBOX_PORT_COUNT 5
+#elif defined(__AVR_AT90USB162__)
+#define BLACKBOX_PORT_COUNT 3
+#else
+#define BLACKBOX_PORT_COUNT 6
+#endif
+
+/* The ring is made of BLACKBOX_SEGMENTS segments, each starting with a key
+   entry, so the host can decode every segment but the one being written
+   over without knowing what came before it. Each entry is a header byte, the
+   low byte of the USB frame number it was taken in, then:
+     BLACKBOX_PORTS | mask    the new value of each port whose bit is set
+                              in the mask, in port order
+     BLACKBOX_SEND | outcome  nothing, a send that failed
+     BLACKBOX_KEY             the value of every port
+   An entry that does not fit in the rest of a segment starts the next one,
+   and a BLACKBOX_PAD byte ends the segment. Only the samples in which a pin
+   changed are kept; the ones between them read the same pins */
+#define BLACKBOX_SEGMENTS   4
+#define BLACKBOX_SEGMENT    (BLACKBOX_SIZE / BLACKBOX_SEGMENTS)
+
+#define BLACKBOX_PAD        0x00
+#define BLACKBOX_PORTS      0x00
+#define BLACKBOX_SEND       0x40
+#define BLACKBOX_KEY        0x80
+#define BLACKBOX_KIND_MASK  0xC0
+
+// send outcomes
+#define BLACKBOX_OFFLINE    0x01    // the USB was not configured
+#define BLACKBOX_TIMEOUT    0x02    // the host did not poll within 50 ms
+
+extern uint8_t g_blackbox[BLACKBOX_SIZE];
+/* the next byte of the ring to write */
+extern uint8_t g_blackboxHead;
+/* the ports as last recorded */
+extern uint8_t g_blackboxPorts[BLACKBOX_PORT_COUNT];
+/* set while the host downloads the ring */
+extern uint8_t g_blackboxFrozen;
+
+/* this function records the ports whose bits are set in mask, from ports */
+void simple_gamepad_blackbox_ports(uint8_t mask, const uint8_t *ports);
+/* this function records a failed send */
+void simple_gamepad_blackbox_send(uint8_t outcome);
+/* this function stops recording, or resumes it in a new segment */
+void simple_gamepad_blackbox_freeze(uint8_t frozen);
+
+/* this function records the ports read by a sample, if any changed. This
+   is all the recorder costs when nothing changes: a compare per port */
+static inline void
+simple_gamepad_blackbox_sample(const uint8_t *ports)
+{
+    uint8_t i, mask = 0;
+
+    for (i = 0; i < BLACKBOX_PORT_COUNT; i++)
+    {
+        if (ports[i] != g_blackboxPorts[i])
+            mask |= 1 << i;
+    }
+    if (mask)
+        simple_gamepad_blackbox_ports(mask, ports);
+}
+
+#endif
+
+#endif /* SIMPLE_GAMEPAD_BLACKBOX_H */
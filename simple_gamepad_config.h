@@ -80,6 +80,30 @@
         are available for other custom configuration/usage.
 
         Port D6, with the LED, is not used and will be configured as an output.
+
+    On the Teensy++ 2.0 (and 1.0), built with MCU = at90usb1286 (at90usb646),
+    up to 41 buttons are read from the pins. The D-pad uses the same pins as
+    above, and the buttons take whole ports in order:
+
+        UP, DOWN, LEFT, RIGHT:  Port B0, B1, B2, B3
+
+        BTN1-4:     Port B4-B7
+        BTN5-12:    Port A0-A7
+        BTN13-20:   Port C0-C7
+        BTN21-26:   Port D0-D5
+        BTN27:      Port D7
+        BTN28-35:   Port F0-F7
+        BTN36-37:   Port E0-E1
+        BTN38-41:   Port E4-E7
+
+    On the Teensy 1.0, built with MCU = at90usb162, up to 16 buttons are read
+    from the pins, with the D-pad again on B0-B3:
+
+        BTN1-4:     Port B4-B7
+        BTN5-10:    Port D0-D5
+        BTN11:      Port D7
+        BTN12:      Port C2
+        BTN13-16:   Port C4-C7
 */
 
 
@@ -111,15 +135,309 @@
 /* this sets the serial number string reported by the device */
 #define STR_SERIAL_NUMBER   L"00001"
 
-/* this setting determines the number of buttons defined and presented to the OS
-   The minimum is 1. The maximum is 20. */
+/* when set to 1, a product ID, product name and serial number written into
+   the EEPROM replace the ones above, each one only if present. This lets a
+   single build be used for many gamepads that each have their own serial
+   number: tools/eep_identity.py writes EEPROM images for a range of serial
+   numbers. Note that the Teensy bootloader only programs the flash, so the
+   EEPROM image must be written with an ISP programmer */
+#define USE_EEPROM_IDENTITY 0
+
+/* These settings are the control table of the gamepad: which controls it
+   presents to the OS, and how many of each. The HID report descriptor, the
+   report layout and its size are all generated from them when compiling,
+   so the report never holds more than the controls declared here. The
+   controls appear in the report in the order listed.
+
+   DPAD_MODE selects how the D-pad is reported:
+     DPAD_AXES   as an X and a Y axis, one byte each
+     DPAD_HAT    as a hat switch packed with the button bits, in half a
+                 byte. 20 buttons then fit a 3 byte report instead of 5
+   BUTTON_COUNT is the number of buttons, 1 to 128. Only the first 20 (41 on
+   the Teensy++, 16 on the Teensy 1.0) are read from the pins listed above;
+   any others are reported released unless another input source sets them.
+   AXIS_COUNT is the number of extra 8-bit absolute axes, 0 to 5, reported
+   as Z, Rx, Ry, Rz and Slider.
+   ENCODER_COUNT is the number of 8-bit relative controls, 0 to 2, reported
+   as Dial and Wheel. */
+#define DPAD_MODE       DPAD_AXES
 #define BUTTON_COUNT    8
+#define AXIS_COUNT      0
+#define ENCODER_COUNT   0
 
 /* enables the internal pull-up resitors on all inputs when defined. Connecting
    the pin to ground activates the button. If this is 0, then extenal pull-up
    resistors must be used */
 #define USE_INTERNAL_PULL_UPS   1
 
+/* the number of MCP23017 I2C port expanders, 0 to 8, for buttons on a remote
+   panel. Each one adds 16 buttons, on its pins GPA0-GPA7 then GPB0-GPB7,
+   which connect to ground when pressed (the expander's own pull-ups are
+   used). They follow the pin buttons in the report, so BUTTON_COUNT must
+   leave room for them: 36 for one expander on the Teensy 2.0. The expanders
+   are set to I2C addresses 0x20 and up in order (pins A2-A0), share the bus
+   on D0 (SCL) and D1 (SDA), which need 4.7k pull-up resistors, and have
+   their INTA outputs wired together to E6. Those three pins are then not
+   read as buttons. The expanders are only read when they signal a change,
+   by interrupts, so the main loop never waits for the bus. Not available on
+   the Teensy 1.0, which has no I2C */
+#define EXPANDER_COUNT          0
+
+/* Other input sources, each read along with the pins at every sample. Their
+   buttons follow the pin buttons (and the expander buttons) in the report,
+   in the order below, and BUTTON_COUNT must leave room for them; the pin
+   buttons get what is left. The pins a source uses are not read as pin
+   buttons. A pin is given as its port letter and bit, like F, 4 for F4, and
+   no two sources may share one.
+
+   A key matrix, with a diode per key: MATRIX_ROWS rows on consecutive bits
+   of one port from MATRIX_ROW_PINS, driven low in turn, and MATRIX_COLS
+   columns on consecutive bits of one port from MATRIX_COL_PINS, read with
+   pull-ups. Adds MATRIX_ROWS * MATRIX_COLS buttons, row by row. Each row
+   is given 1 us to settle, a busy wait of the input read. 0 rows for
+   none. */
+#define MATRIX_ROWS             0
+#define MATRIX_ROW_PINS         F, 4
+#define MATRIX_COLS             0
+#define MATRIX_COL_PINS         B, 4
+
+/* A chain of 74HC165 parallel-in shift registers, 8 buttons each, wired to
+   ground when pressed (with pull-ups on the register inputs). LOAD goes to
+   every /PL, CLOCK to every CP and DATA to Q7 of the last one. 0 for none */
+#define SHIFT_BUTTON_COUNT      0
+#define SHIFT_LOAD_PIN          F, 4
+#define SHIFT_CLOCK_PIN         F, 5
+#define SHIFT_DATA_PIN          F, 6
+
+/* A console controller on its own connector:
+     CONSOLE_NONE    no controller
+     CONSOLE_NES     8 buttons: A, B, Select, Start, Up, Down, Left, Right
+     CONSOLE_SNES    12 buttons: B, Y, Select, Start, Up, Down, Left,
+                     Right, A, X, L, R
+   LATCH, CLOCK and DATA are the pad's signals of the same names; the pad is
+   powered from the Teensy's 5V. The pad is clocked at the consoles' own
+   pace by busy waits of the input read, which then takes 114 us longer
+   with an NES pad and 162 us longer with an SNES pad, at every sample:
+   raise WCET_READ_BUDGET in the Makefile by as much (1824 and 2592 cycles
+   at 16 MHz), and POLL_GUARD_US with USE_POLL_PHASE_TRACKING */
+#define CONSOLE_PAD             CONSOLE_NONE
+#define CONSOLE_LATCH_PIN       F, 0
+#define CONSOLE_CLOCK_PIN       F, 1
+#define CONSOLE_DATA_PIN        F, 7
+
+/* Potentiometers or Hall sensors for the first ADC_AXES of the AXIS_COUNT
+   axes, on the analog inputs listed in ADC_AXIS_CHANNELS (n for ADCn, pin
+   Fn; 0, 1 and 4-7 on the Teensy 2.0). An axis only changes when its input
+   moves by more than ADC_AXIS_DEADBAND (out of 255), so noise does not
+   send reports. Not available on the Teensy 1.0. 0 for none */
+#define ADC_AXES                0
+#define ADC_AXIS_CHANNELS       7, 6
+#define ADC_AXIS_DEADBAND       1
+
+/* Hall-effect switches with rapid trigger, for HALL_BUTTON_COUNT buttons (0
+   to 8) on the analog inputs listed in HALL_CHANNELS (n for ADCn, pin Fn,
+   none of them an axis channel). The ADC then converts every analog input
+   in turn without a pause, about every 30 us, and each switch is decided
+   on at each of its samples, by its travel from the rest level read at
+   power-up (so no switch may be held then), out of 255:
+     HALL_ACTUATION      the travel a press must reach from rest
+     HALL_PRESS_DELTA    a released switch is pressed once it has moved this
+                         far down from the highest point it came back to
+     HALL_RELEASE_DELTA  a pressed switch is released once it has come this
+                         far back up from the lowest point it reached
+     HALL_RELEASE_FLOOR  a switch closer to rest than this is released
+   so a switch is pressed and released as soon as its travel turns around,
+   anywhere along it. A decision wakes the main loop at once when idle
+   sleep is used. A press made and released between two samples of the
+   gamepad is still reported, for one report. Not available on the Teensy
+   1.0. 0 for none */
+#define HALL_BUTTON_COUNT       0
+#define HALL_CHANNELS           0, 1, 4, 5
+#define HALL_ACTUATION          64
+#define HALL_PRESS_DELTA        12
+#define HALL_RELEASE_DELTA      12
+#define HALL_RELEASE_FLOOR      16
+
+/* Quadrature rotary encoders for the first ENCODER_INPUTS of the
+   ENCODER_COUNT relative controls, each on two pins of one port given as
+   the port letter and the bits of its A and B outputs. Each step turned is
+   one count. The pins are sampled every 1 ms, which follows up to about
+   250 detents a second on common encoders. 0 for none */
+#define ENCODER_INPUTS          0
+#define ENCODER1_PINS           D, 2, 3
+#define ENCODER2_PINS           D, 4, 5
+
+/* Several boards as one gamepad, linked by their UARTs. LINK_MODE is:
+     LINK_NONE       a board on its own
+     LINK_PRIMARY    the board on USB, which adds the first
+                     LINK_BUTTON_COUNT buttons of each of LINK_SECONDARIES
+                     secondary boards (1 to 8) to its own, after those of
+                     the other sources
+     LINK_SECONDARY  a board with no USB, powered by the primary, whose
+                     buttons are sent to the primary as secondary
+                     LINK_ADDRESS (0 to LINK_SECONDARIES - 1)
+   The primary's TX (D3) goes to the RX (D2) of every secondary, and the TX
+   of every secondary to the primary's RX. At each sample the primary polls
+   all of them at once, and each secondary samples its buttons and answers
+   in its own time slot, its TX only driven during its slot, so the
+   answers reach the report at the next sample. All the boards must have
+   the same LINK_SECONDARIES, LINK_BUTTON_COUNT (1 to 128) and LINK_BAUD;
+   250000, 500000 and 1000000 are exact at 16 MHz. The secondaries' slots
+   must fit in 1 ms, which 4 secondaries of 24 buttons do at 500000. The
+   primary times the UART and Timer3 from the CPU clock, so with idle sleep
+   it needs IDLE_CLOCK_PRESCALE set to 0. Not available on the Teensy 1.0,
+   which has no Timer3 */
+#define LINK_MODE               LINK_NONE
+#define LINK_SECONDARIES        1
+#define LINK_ADDRESS            0
+#define LINK_BUTTON_COUNT       16
+#define LINK_BAUD               500000
+
+/* when set to 1, the processor sleeps (idle mode) between samples instead of
+   busy-waiting. It wakes on the USB start-of-frame interrupt every 1 ms, and
+   immediately on an edge of any input that has a pin-change or external
+   interrupt (B0-B7, D0-D3 and E6). Inputs without an interrupt are sampled
+   on the next start-of-frame, exactly as often as without sleeping */
+#define USE_IDLE_SLEEP          1
+
+/* when idle sleep is used, the CPU clock is divided by 2^IDLE_CLOCK_PRESCALE
+   once no input has changed for IDLE_SLOWDOWN_MS milliseconds. Full speed is
+   restored on the first input edge or state change, before the report is
+   sent. USB keeps its own PLL clock so it is not affected. 0 disables, and
+   leaves the idle sleep alone. Neither the current saved nor the latency
+   added (the sample of an input without an interrupt runs slowed down) has
+   been measured, in either state. LINK_PRIMARY and USE_POLL_PHASE_TRACKING
+   time from the CPU clock and need 0 */
+#define IDLE_CLOCK_PRESCALE     0
+#define IDLE_SLOWDOWN_MS        250
+
+/* selects how the D-pad resolves simultaneous opposite directions (SOCD),
+   such as UP and DOWN held together:
+     SOCD_PRIORITY   UP beats DOWN and LEFT beats RIGHT
+     SOCD_NEUTRAL    opposite directions cancel out to center
+     SOCD_LAST_WIN   the direction pressed most recently wins
+     SOCD_FIRST_WIN  the direction held the longest wins
+   When both are pressed within the same sample, the UP or LEFT press is
+   treated as the most recent one */
+#define SOCD_MODE               SOCD_PRIORITY
+
+/* the interval, in milliseconds (USB frames), at which the host is asked to
+   poll the gamepad for a new report. 1 gives the lowest latency, 10 is the
+   traditional value */
+#define POLL_INTERVAL_MS        10
+
+/* when set to 1, the gamepad learns when the host polls it (the phase of
+   the poll within POLL_INTERVAL_MS) and reads the inputs and loads the report
+   POLL_GUARD_US microseconds before each expected poll, instead of as soon as
+   something changes. The report is then only as old as the guard time when
+   the host collects it, rather than half a poll interval on average. Only
+   useful when POLL_INTERVAL_MS is more than 1. This uses Timer1 as its clock,
+   so IDLE_CLOCK_PRESCALE must be 0. tools/gamepad_phase.py reads the learned
+   poll time and the sample ages through the feature report */
+#define USE_POLL_PHASE_TRACKING 0
+#define POLL_GUARD_US           250
+
+/* when set to 1, a report still waiting in the endpoint for the host to
+   collect it is thrown away and replaced whenever a newer one is sent, so
+   the host always receives the latest state. A report holding a press (or
+   encoder steps) the newer one no longer has is kept, so a button pressed
+   and released within one poll still reaches the host. Otherwise, up to
+   two reports queue up and a burst of changes can reach the host one poll
+   late ('make replay-check' shows both) */
+#define USE_FRESH_REPORTS       0
+
+/* when set to 1, the axes and encoders are sent in an analog report of
+   their own, on a second interface whose endpoint is polled every
+   ANALOG_INTERVAL_MS, so the report of the D-pad and buttons stays as
+   small and as fast as without them. Each report is only sent when its own
+   controls change: the state report as soon as a button does, and resent
+   every so often when idle as usual; the analog report at most once every
+   ANALOG_INTERVAL_MS, and never while nothing changes. The host sees the
+   analog controls as a second device. Needs AXIS_COUNT or ENCODER_COUNT,
+   and POLL_INTERVAL_MS 1 for a 1 ms button report */
+#define USE_SPLIT_REPORTS       0
+#define ANALOG_INTERVAL_MS      8
+
+/* turbo (autofire) buttons. Each set bit enables turbo on that button, bit 0
+   being BTN1: 0x0005 would enable turbo on BTN1 and BTN3. A held turbo
+   button is reported pressed for TURBO_RATE_POLLS host polls, then released
+   for TURBO_RATE_POLLS polls, and so on. The rate is counted in host polls so
+   that every press and every release is seen by the host: 1 gives the
+   fastest rate, 1000 / (2 * POLL_INTERVAL_MS) presses per second. The mask
+   is 32 bits, so only BTN1 to BTN32 can have turbo */
+#define TURBO_BUTTONS           0x0000
+#define TURBO_RATE_POLLS        2
+
+/* macros play a timed sequence of button presses when their trigger button
+   is pressed. Each macro is MACRO_ENTRY(trigger button, { steps }), and
+   each step is { buttons to press (same bits as TURBO_BUTTONS), duration in
+   host polls }. A macro ends at its last step or at the first step with a
+   0 duration. The trigger button only starts its macro and is never
+   reported itself; it must be one of BTN1 to BTN<BUTTON_COUNT>, which is
+   checked when compiling. Like TURBO_BUTTONS, the steps can only press BTN1
+   to BTN32. The entries follow one another with no comma in between. Set
+   MACRO_COUNT to the number of entries in MACRO_TABLE, 0 for none. This
+   example presses BTN1+BTN2, then nothing, then BTN3 when BTN8
+   is pressed:
+
+   #define MACRO_COUNT 1
+   #define MACRO_TABLE \
+       MACRO_ENTRY(8, { { 0x0003, 2 }, { 0x0000, 1 }, { 0x0004, 2 } })
+   */
+#define MACRO_COUNT             0
+#define MACRO_MAX_STEPS         8
+#define MACRO_TABLE
+
+/* when set to 1, the buttons can be remapped from the host without
+   reflashing: each button of the report can take its input from any of the
+   button pins above, be inverted (pressed when the pin is high, for
+   normally closed switches) or be disabled. The mapping is sent in a
+   feature report (see tools/gamepad_remap.py), kept in EEPROM and loaded
+   when the gamepad starts. Reading the buttons takes the same time with or
+   without a remapping. Storing a new mapping pauses the reports for up to
+   about 75 ms while the EEPROM is written */
+#define USE_BUTTON_REMAP        0
+
+/* when set to 1, the RAM left for the stack is filled with a known pattern
+   at reset, and the deepest the stack has reached since is measured from
+   how much of it has been overwritten. The result is read through the
+   feature report (see tools/gamepad_stack.py), to check the stack usage
+   reported by 'make footprint' and 'make benchmark' on a running gamepad */
+#define USE_STACK_MONITOR       0
+
+/* when set to 1, the gamepad answers a loopback probe, to tell the USB and
+   host latency from its own: each output report the host writes holds a
+   token, and the next input report, sent at once, carries the token back
+   with the Timer3 time and USB frame number it arrived at, and those of
+   the report being loaded (see tools/gamepad_probe.py). The input report
+   grows by 7 bytes. Not available on the Teensy 1.0, which has no Timer3 */
+#define USE_LOOPBACK_PROBE      0
+
+/* when set to 1, a black-box recorder keeps the recent history of the
+   gamepad in BLACKBOX_SIZE bytes of RAM (64, 128 or 256): every change of
+   the input pins, as sampled, and every send that failed, each with the
+   USB frame it happened in. Samples in which nothing changed cost a compare
+   per port and are not kept, so 256 bytes hold a few hundred changes. The
+   host downloads it through the feature report and replays it through
+   the gamepad's own code, built for the host, to reproduce the reports
+   (see tools/gamepad_blackbox.py) */
+#define USE_BLACKBOX            0
+#define BLACKBOX_SIZE           256
+
+/* when set to 1, the gamepad is also a keyboard, a second interface of its
+   own with a 1 ms endpoint, for emulators that only take keys. Each D-pad
+   direction and button presses a key, given in KEYBOARD_KEYMAP as HID
+   keyboard usages: up, down, left, right, then BTN1 to BTN<BUTTON_COUNT>.
+   0 is no key, 0x04 to 0x77 the keys and 0xE0 to 0xE7 the modifiers. The
+   report is a bitmap of every key, so any number can be held at once. It
+   is made from the same sample as the gamepad report, after SOCD,
+   remapping, turbo and macros, and loaded as soon as its own endpoint has
+   room, whether or not the gamepad's has. This example is the MAME player
+   1 default: the arrows, LCtrl, LAlt, Space, LShift, Z, X, 5, 1 */
+#define USE_KEYBOARD            0
+#define KEYBOARD_KEYMAP \
+    0x52, 0x51, 0x50, 0x4F, \
+    0xE0, 0xE2, 0x2C, 0xE1, 0x1D, 0x1B, 0x22, 0x1E
 
 
 #endif /* SIMPLE_GAMEPAD_DEF_H */
@@ -43,30 +43,110 @@
 
 #include "simple_gamepad_defs.h"
 #include "simple_gamepad_usb.h"
+#include "simple_gamepad_turbo.h"
+#include "simple_gamepad_phase.h"
+#include "simple_gamepad_blackbox.h"
+#include "simple_gamepad_keyboard.h"
 #include <string.h>
 #include <avr/io.h>
 #include <avr/pgmspace.h>
 #include <avr/interrupt.h>
-
+#include <avr/eeprom.h>
 
 
 const uint8_t GAMEPAD_HID_REPORT_DESC_SIZE = sizeof(gamepad_hid_report_desc);
 /* define the global gamepad state object instance */
 gamepad_state g_gamepadState;
 
+#if USE_IDLE_SLEEP
+volatile uint8_t g_inputEdge;
+#endif
+
+#if USE_LOOPBACK_PROBE
+volatile uint8_t g_probePending;
+#endif
+
+// whether a state report is waiting for room, and the USB frame (low byte)
+// it started waiting in
+static uint8_t sendPending;
+static uint8_t sendFrame;
+
+#if USE_SPLIT_REPORTS
+analog_state g_analogState;
+// the first analog report goes with the first state report
+uint8_t g_analogPending = 1;
+// the USB frame (low byte) the last analog report was loaded in
+static uint8_t analogFrame;
+#endif
+
+#if USE_FRESH_REPORTS
+/* the presses of a state report: its buttons bytes, the hat taken out, then
+   a byte of the D-pad directions and of the encoder steps it carries */
+#define PRESS_SIZE      (BUTTON_ARRAY_SIZE + 1)
+#define PRESS_UP        0x01
+#define PRESS_DOWN      0x02
+#define PRESS_LEFT      0x04
+#define PRESS_RIGHT     0x08
+#define PRESS_STEPS     0x10
+
+/* the presses of the last two state reports loaded, the newest first */
+static uint8_t loadedPresses[2 * PRESS_SIZE];
+#if USE_SPLIT_REPORTS
+/* whether the last two analog reports loaded carry encoder steps */
+static uint8_t loadedSteps[2];
+#endif
+
+#if DPAD_MODE == DPAD_HAT
+/* the directions of each hat value, up then clockwise, and centered */
+static const uint8_t PROGMEM hat_presses[HAT_CENTER + 1] =
+{
+    PRESS_UP, PRESS_UP | PRESS_RIGHT, PRESS_RIGHT, PRESS_DOWN | PRESS_RIGHT,
+    PRESS_DOWN, PRESS_DOWN | PRESS_LEFT, PRESS_LEFT, PRESS_UP | PRESS_LEFT, 0
+};
+#endif
+#endif
+
 
 /* These macros and definintions implement the button to port mappings */
 
-#if BUTTON_COUNT == 0 || BUTTON_COUNT >= 21
-#error BUTTON_COUNT must be 1 to 20
+#if POLL_INTERVAL_MS < 1 || POLL_INTERVAL_MS > 255
+#error POLL_INTERVAL_MS must be 1 to 255
+#endif
+
+#if TURBO_BUTTONS != 0 && (TURBO_RATE_POLLS < 1 || TURBO_RATE_POLLS > 255)
+#error TURBO_RATE_POLLS must be 1 to 255
 #endif
 
+#if defined(__AVR_ATmega32U4__)
 // Port array index definitions
 #define INDEX_B     0
 #define INDEX_C     1
 #define INDEX_D     2
 #define INDEX_E     3
 #define INDEX_F     4
+#define PORT_COUNT  5
+#elif defined(__AVR_AT90USB162__)
+#define INDEX_B     0
+#define INDEX_C     1
+#define INDEX_D     2
+#define PORT_COUNT  3
+#else
+#define INDEX_A     0
+#define INDEX_B     1
+#define INDEX_C     2
+#define INDEX_D     3
+#define INDEX_E     4
+#define INDEX_F     5
+#define PORT_COUNT  6
+#endif
+
+/* the input sources other than the pins, which use the port numbers above */
+#include "simple_gamepad_sources.h"
+
+#if USE_BLACKBOX
+/* the recorder keeps the ports as READ_ALL_INPUTS reads them */
+typedef char blackbox_port_count_check[PORT_COUNT == BLACKBOX_PORT_COUNT ? 1 : -1];
+#endif
 
 // Button Mappings
 #define BUTTON_UP_INDEX     INDEX_B
@@ -77,6 +157,14 @@ gamepad_state g_gamepadState;
 #define BUTTON_LEFT_SHIFT   2 // B2
 #define BUTTON_RIGHT_INDEX  INDEX_B
 #define BUTTON_RIGHT_SHIFT  3 // B3
+
+// ease of use macros for passing shift/index to functions
+#define BUTTON_UP       BUTTON_UP_INDEX, BUTTON_UP_SHIFT
+#define BUTTON_DOWN     BUTTON_DOWN_INDEX, BUTTON_DOWN_SHIFT
+#define BUTTON_LEFT     BUTTON_LEFT_INDEX, BUTTON_LEFT_SHIFT
+#define BUTTON_RIGHT    BUTTON_RIGHT_INDEX, BUTTON_RIGHT_SHIFT
+
+#if defined(__AVR_ATmega32U4__)
 #define BUTTON_1_INDEX      INDEX_B    // 1 Button, only port B is needed
 #define BUTTON_1_SHIFT      7 // B7
 #define BUTTON_2_INDEX      INDEX_D    // 2+ buttons, port D is required
@@ -118,13 +206,7 @@ gamepad_state g_gamepadState;
 #define BUTTON_20_INDEX     INDEX_E    // 20 buttons, port E is required
 #define BUTTON_20_SHIFT     6 // E6
 
-// ease of use macros for passing shift/index to functions
-#define BUTTON_UP       BUTTON_UP_INDEX, BUTTON_UP_SHIFT
-#define BUTTON_DOWN     BUTTON_DOWN_INDEX, BUTTON_DOWN_SHIFT
-#define BUTTON_LEFT     BUTTON_LEFT_INDEX, BUTTON_LEFT_SHIFT
-#define BUTTON_RIGHT    BUTTON_RIGHT_INDEX, BUTTON_RIGHT_SHIFT
-
-static const uint8_t BUTTON_BTN[20][2] =
+static const uint8_t PROGMEM BUTTON_BTN[PIN_BUTTON_COUNT][2] =
 {
     { BUTTON_1_INDEX, BUTTON_1_SHIFT },
     { BUTTON_2_INDEX, BUTTON_2_SHIFT },
@@ -147,10 +229,216 @@ static const uint8_t BUTTON_BTN[20][2] =
     { BUTTON_19_INDEX, BUTTON_19_SHIFT },
     { BUTTON_20_INDEX, BUTTON_20_SHIFT }
 };
+#elif defined(__AVR_AT90USB162__)
+/* Teensy 1.0: the buttons take the ports in bit order, as on the Teensy++.
+   C0, C1 and C3 are not available as pins */
+static const uint8_t PROGMEM BUTTON_BTN[PIN_BUTTON_COUNT][2] =
+{
+    { INDEX_B, 4 }, { INDEX_B, 5 }, { INDEX_B, 6 }, { INDEX_B, 7 },     // 1-4
+    { INDEX_D, 0 }, { INDEX_D, 1 }, { INDEX_D, 2 }, { INDEX_D, 3 },     // 5-8
+    { INDEX_D, 4 }, { INDEX_D, 5 }, { INDEX_D, 7 },                     // 9-11
+    { INDEX_C, 2 }, { INDEX_C, 4 }, { INDEX_C, 5 }, { INDEX_C, 6 },     // 12-15
+    { INDEX_C, 7 }                                                      // 16
+};
+#else
+/* Teensy++: the buttons take whole ports in bit order, so that each port is
+   read as a single run of buttons (see button_run) */
+static const uint8_t PROGMEM BUTTON_BTN[PIN_BUTTON_COUNT][2] =
+{
+    { INDEX_B, 4 }, { INDEX_B, 5 }, { INDEX_B, 6 }, { INDEX_B, 7 },     // 1-4
+    { INDEX_A, 0 }, { INDEX_A, 1 }, { INDEX_A, 2 }, { INDEX_A, 3 },     // 5-8
+    { INDEX_A, 4 }, { INDEX_A, 5 }, { INDEX_A, 6 }, { INDEX_A, 7 },     // 9-12
+    { INDEX_C, 0 }, { INDEX_C, 1 }, { INDEX_C, 2 }, { INDEX_C, 3 },     // 13-16
+    { INDEX_C, 4 }, { INDEX_C, 5 }, { INDEX_C, 6 }, { INDEX_C, 7 },     // 17-20
+    { INDEX_D, 0 }, { INDEX_D, 1 }, { INDEX_D, 2 }, { INDEX_D, 3 },     // 21-24
+    { INDEX_D, 4 }, { INDEX_D, 5 }, { INDEX_D, 7 },                     // 25-27
+    { INDEX_F, 0 }, { INDEX_F, 1 }, { INDEX_F, 2 }, { INDEX_F, 3 },     // 28-31
+    { INDEX_F, 4 }, { INDEX_F, 5 }, { INDEX_F, 6 }, { INDEX_F, 7 },     // 32-35
+    { INDEX_E, 0 }, { INDEX_E, 1 }, { INDEX_E, 4 }, { INDEX_E, 5 },     // 36-39
+    { INDEX_E, 6 }, { INDEX_E, 7 }                                      // 40-41
+};
+#endif
+
+/* The pin buttons are read a port at a time. Buttons that take bits of the
+   same port to report bits the same distance away form a run, which is read
+   with one mask and one shift however many buttons it holds, so the time
+   taken grows with the number of ports in use rather than with the number
+   of buttons. The runs are built when the gamepad starts, or when it is
+   remapped, from BUTTON_BTN and the remap bytes: a button is pressed when
+   its bit of (port ^ flip) is set, and disabled buttons are left out.
+
+   The shift is done by multiplying by factor, 1 << (distance % 8), into the
+   report bytes byte - 1 and byte (counted from the first buttons byte).
+
+   The cost depends on the map: the BUTTON_BTN order gives one or two runs
+   a port, but a remapping can give every button a distance of its own.
+   It is bounded by one run per pin button, DIRECT_BUTTON_COUNT runs, which
+   is what 'make wcet' and 'make benchmark' count (WCET_READ_LOOPS). */
+typedef struct
+{
+    uint8_t index;
+    uint8_t flip;
+    uint8_t mask;
+    uint8_t byte;
+    uint8_t factor;
+} button_run;
+
+static button_run button_runs[DIRECT_BUTTON_COUNT];
+static uint8_t button_run_count;
+
+/* this function builds the runs from the remap byte of each pin button,
+   or the pin number when remapping is not used */
+static void
+button_runs_build(const uint8_t *map)
+{
+    uint8_t i, j, pin, index, shift, distance;
+    button_run *run;
+
+    button_run_count = 0;
+    for (i = 0; i < DIRECT_BUTTON_COUNT; i++)
+    {
+#if USE_BUTTON_REMAP
+        if (map[i] & REMAP_DISABLE)
+            continue;
+        pin = map[i] & REMAP_PIN_MASK;
+#else
+        pin = map[i];
+#endif
+        index = pgm_read_byte(&BUTTON_BTN[pin][0]);
+        shift = pgm_read_byte(&BUTTON_BTN[pin][1]);
+        // a pin taken by an input source is not read as a button
+        if (sources_pin_reserved(index, shift))
+            continue;
+        // from the port bit to the report bit, plus 8 to stay positive
+        distance = i + BUTTON_BIT_OFFSET + 8 - shift;
+
+        // join the run of the same port and distance, or start one
+        run = button_runs;
+        for (j = 0; j < button_run_count; j++, run++)
+        {
+            if (run->index == index && run->byte == distance / 8 &&
+                run->factor == (1 << (distance % 8)))
+                break;
+        }
+        if (j == button_run_count)
+        {
+            run->index = index;
+            run->flip = 0;
+            run->mask = 0;
+            run->byte = distance / 8;
+            run->factor = 1 << (distance % 8);
+            button_run_count++;
+        }
+        run->mask |= 1 << shift;
+#if USE_BUTTON_REMAP
+        if (map[i] & REMAP_INVERT)
+            continue;
+#endif
+        // pull-up resistors make buttons active LOW
+        run->flip |= 1 << shift;
+    }
+}
+
+
+#if USE_BUTTON_REMAP
+#define REMAP_MAGIC     0xA5
+
+/* the remapping as stored in EEPROM at EEPROM_REMAP_ADDR */
+typedef struct
+{
+    uint8_t magic;
+    uint8_t count;
+    uint8_t map[DIRECT_BUTTON_COUNT];
+    uint8_t check;
+} remap_record;
+
+#define REMAP_RECORD    ((remap_record *)EEPROM_REMAP_ADDR)
+
+static uint8_t
+remap_check(const uint8_t *map)
+{
+    uint8_t i, sum = DIRECT_BUTTON_COUNT;
+
+    for (i = 0; i < DIRECT_BUTTON_COUNT; i++)
+        sum += map[i];
+    return ~sum;
+}
+
+static uint8_t
+remap_valid(const uint8_t *map)
+{
+    uint8_t i;
+
+    for (i = 0; i < DIRECT_BUTTON_COUNT; i++)
+    {
+        // only pins configured as button inputs can be read
+        if ((map[i] & ~(REMAP_PIN_MASK | REMAP_INVERT | REMAP_DISABLE)) ||
+            (map[i] & REMAP_PIN_MASK) >= DIRECT_BUTTON_COUNT)
+            return 0;
+    }
+    return 1;
+}
+
+
+/* this function fills map with the remap byte of each pin button, from
+   EEPROM or the default one button per pin, and returns their number */
+uint8_t
+simple_gamepad_remap_read(uint8_t *map)
+{
+    uint8_t i;
+
+    if (eeprom_read_byte(&REMAP_RECORD->magic) == REMAP_MAGIC &&
+        eeprom_read_byte(&REMAP_RECORD->count) == DIRECT_BUTTON_COUNT)
+    {
+        eeprom_read_block(map, REMAP_RECORD->map, DIRECT_BUTTON_COUNT);
+        if (eeprom_read_byte(&REMAP_RECORD->check) == remap_check(map) &&
+            remap_valid(map))
+            return DIRECT_BUTTON_COUNT;
+    }
+
+    // nothing valid stored, each button reads its own pin
+    for (i = 0; i < DIRECT_BUTTON_COUNT; i++)
+        map[i] = i;
+    return DIRECT_BUTTON_COUNT;
+}
+
+
+/* this function checks, applies and stores the remap bytes of all the pin
+   buttons. Returns 0 if they are not valid for this gamepad */
+uint8_t
+simple_gamepad_remap_write(const uint8_t *map)
+{
+    if (!remap_valid(map))
+        return 0;
+
+    button_runs_build(map);
+
+    // only the bytes that changed are written, and the check byte makes a
+    // record left half written by a power loss read as not valid
+    eeprom_update_byte(&REMAP_RECORD->magic, REMAP_MAGIC);
+    eeprom_update_byte(&REMAP_RECORD->count, DIRECT_BUTTON_COUNT);
+    eeprom_update_block(map, REMAP_RECORD->map, DIRECT_BUTTON_COUNT);
+    eeprom_update_byte(&REMAP_RECORD->check, remap_check(map));
+    return 1;
+}
+
+
+/* this function erases the stored remapping and restores the default */
+void
+simple_gamepad_remap_reset(void)
+{
+    uint8_t map[DIRECT_BUTTON_COUNT];
+
+    eeprom_update_byte(&REMAP_RECORD->magic, 0xFF);
+    simple_gamepad_remap_read(map);
+    button_runs_build(map);
+}
+#endif
+
 
 /* this function checks the inputs read via READ_ALL_INPUTS */
 static inline uint8_t
-INPUT_ACTIVE(uint8_t portArray[5], uint8_t index, uint8_t shift)
+INPUT_ACTIVE(uint8_t portArray[PORT_COUNT], uint8_t index, uint8_t shift)
 {
     // pull-up resistors make buttons active LOW
     return ((portArray[index] & (1 << shift)) == 0 ? 1 : 0);
@@ -158,7 +446,7 @@ INPUT_ACTIVE(uint8_t portArray[5], uint8_t index, uint8_t shift)
 
 
 static inline void
-SET_AS_INPUT(uint8_t portArray[5], uint8_t index, uint8_t shift)
+SET_AS_INPUT(uint8_t portArray[PORT_COUNT], uint8_t index, uint8_t shift)
 {
     // clear the bit to make it an input
     portArray[index] &= ~(1 << shift);
@@ -166,120 +454,446 @@ SET_AS_INPUT(uint8_t portArray[5], uint8_t index, uint8_t shift)
 
 
 static inline void
-READ_ALL_INPUTS(uint8_t portArray[5])
+READ_ALL_INPUTS(uint8_t portArray[PORT_COUNT])
 {
-    portArray[INDEX_B] = PINB;
-#if BUTTON_COUNT >= 2 // 2-5 buttons, ports B and D needed
-    portArray[INDEX_D] = PIND;
+    // all the ports are read, as a remapped button may use any of them
+#ifdef INDEX_A
+    portArray[INDEX_A] = PINA;
 #endif
-#if BUTTON_COUNT >= 6 // 6-11 buttons, ports B, D, and C needed
+    portArray[INDEX_B] = PINB;
     portArray[INDEX_C] = PINC;
-#endif
-#if BUTTON_COUNT >= 12 // 12-19 buttons, ports B, D, C, and F needed
-    portArray[INDEX_F] = PINF;
-#endif
-#if BUTTON_COUNT >= 20 // all ports needed
+    portArray[INDEX_D] = PIND;
+#ifdef INDEX_E
     portArray[INDEX_E] = PINE;
+    portArray[INDEX_F] = PINF;
 #endif
 }
 
 
+/* These macros build the D-pad SOCD resolution tables at compile time. Each
+   axis keeps a state of 3 bits: which direction was pressed most recently
+   (bit 4) and both directions as seen at the previous sample (bits 3-2). OR
+   the new sample (bit 1 UP/LEFT, bit 0 DOWN/RIGHT) into it to index the
+   table, which gives the next state in bits 4-2 and the resolved direction
+   in bits 1-0: 0 center, 1 UP/LEFT, 2 DOWN/RIGHT. One table lookup per axis
+   resolves every mode in constant time, with no branches on the inputs. */
+#define SOCD_RAW(i)     ((i) & 3)
+#define SOCD_PREV(i)    (((i) >> 2) & 3)
+#define SOCD_NEW(i)     (SOCD_RAW(i) & ~SOCD_PREV(i))
+// 1 if DOWN/RIGHT was pressed most recently, a same-sample press counts UP/LEFT last
+#define SOCD_LAST(i)    (SOCD_NEW(i) == 1 ? 1 : (SOCD_NEW(i) >= 2 ? 0 : (((i) >> 4) & 1)))
+
+#if SOCD_MODE == SOCD_PRIORITY
+#define SOCD_BOTH(i)    1
+#elif SOCD_MODE == SOCD_NEUTRAL
+#define SOCD_BOTH(i)    0
+#elif SOCD_MODE == SOCD_LAST_WIN
+#define SOCD_BOTH(i)    (SOCD_LAST(i) ? 2 : 1)
+#elif SOCD_MODE == SOCD_FIRST_WIN
+#define SOCD_BOTH(i)    (SOCD_LAST(i) ? 1 : 2)
+#else
+#error SOCD_MODE must be SOCD_PRIORITY, SOCD_NEUTRAL, SOCD_LAST_WIN or SOCD_FIRST_WIN
+#endif
+
+#define SOCD_RESULT(i)  (SOCD_RAW(i) == 0 ? 0 : (SOCD_RAW(i) == 2 ? 1 : \
+                        (SOCD_RAW(i) == 1 ? 2 : SOCD_BOTH(i))))
+#define SOCD_ENTRY(i)   ((SOCD_LAST(i) << 4) | (SOCD_RAW(i) << 2) | SOCD_RESULT(i))
+#define SOCD_ENTRY4(i)  SOCD_ENTRY(i), SOCD_ENTRY(i + 1), SOCD_ENTRY(i + 2), SOCD_ENTRY(i + 3)
+
+#define SOCD_STATE_MASK 0x1C
+#define SOCD_DIR_MASK   0x03
+
+static const uint8_t PROGMEM socd_table[32] =
+{
+    SOCD_ENTRY4(0),  SOCD_ENTRY4(4),  SOCD_ENTRY4(8),  SOCD_ENTRY4(12),
+    SOCD_ENTRY4(16), SOCD_ENTRY4(20), SOCD_ENTRY4(24), SOCD_ENTRY4(28)
+};
+
+#if DPAD_MODE == DPAD_AXES
+/* axis value for each resolved direction, UP and LEFT share one value */
+static const uint8_t socd_axis_value[3] = { AXIS_CENTER, Y_AXIS_UP, Y_AXIS_DOWN };
+#else
+/* hat value for each pair of resolved directions, indexed by (y << 2) | x */
+static const uint8_t socd_hat_value[12] =
+{
+    HAT_CENTER, 6, 2, 0,    // center: none, left, right
+    0,          7, 1, 0,    // up: up, up-left, up-right
+    4,          5, 3        // down: down, down-left, down-right
+};
+#endif
+
+/* SOCD state of each axis, see socd_table */
+static uint8_t socdStateY;
+static uint8_t socdStateX;
+
+
 /* this function reads the gamepad state from the hardware */
 uint8_t
 simple_gampad_read_buttons(void)
 {
-    uint8_t inPorts[5];
+    uint8_t inPorts[PORT_COUNT];
     uint8_t i;
-    uint8_t btnArrayIndex;
-    uint8_t btnArrayShift;
-    gamepad_state prevState;
-
-    // save previous state
-    prevState = g_gamepadState;
+    uint8_t socd;
+    // the buttons array, with a spare byte before for the runs and two
+    // after for the runs and the sources
+    uint8_t buttons[BUTTON_ARRAY_SIZE + 3];
+    const button_run *run;
+    uint16_t bits;
+#if DPAD_MODE == DPAD_HAT
+    uint8_t socdY, hat;
+#else
+    uint8_t axis;
+#endif
+    // the bits that differ from the previous state, which is updated in
+    // place rather than kept in a copy
+    uint8_t changed = 0;
 
     // read all values from hardware into local array
     READ_ALL_INPUTS(inPorts);
+#if USE_BLACKBOX
+    simple_gamepad_blackbox_sample(inPorts);
+#endif
 
     // set y axis
-    if (INPUT_ACTIVE(inPorts, BUTTON_UP))
-        g_gamepadState.y_axis = Y_AXIS_UP;
-    else if (INPUT_ACTIVE(inPorts, BUTTON_DOWN))
-        g_gamepadState.y_axis = Y_AXIS_DOWN;
-    else
-        g_gamepadState.y_axis = AXIS_CENTER;
+    socd = pgm_read_byte(&socd_table[socdStateY |
+                (INPUT_ACTIVE(inPorts, BUTTON_UP) << 1) |
+                INPUT_ACTIVE(inPorts, BUTTON_DOWN)]);
+    socdStateY = socd & SOCD_STATE_MASK;
+#if DPAD_MODE == DPAD_AXES
+    axis = socd_axis_value[socd & SOCD_DIR_MASK];
+    changed |= g_gamepadState.y_axis ^ axis;
+    g_gamepadState.y_axis = axis;
+#else
+    socdY = socd & SOCD_DIR_MASK;
+#endif
 
     // set x axis
-    if (INPUT_ACTIVE(inPorts, BUTTON_LEFT))
-        g_gamepadState.x_axis = X_AXIS_LEFT;
-    else if (INPUT_ACTIVE(inPorts, BUTTON_RIGHT))
-        g_gamepadState.x_axis = X_AXIS_RIGHT;
-    else
-        g_gamepadState.x_axis = AXIS_CENTER;
+    socd = pgm_read_byte(&socd_table[socdStateX |
+                (INPUT_ACTIVE(inPorts, BUTTON_LEFT) << 1) |
+                INPUT_ACTIVE(inPorts, BUTTON_RIGHT)]);
+    socdStateX = socd & SOCD_STATE_MASK;
+#if DPAD_MODE == DPAD_AXES
+    axis = socd_axis_value[socd & SOCD_DIR_MASK];
+    changed |= g_gamepadState.x_axis ^ axis;
+    g_gamepadState.x_axis = axis;
+#else
+    hat = socd_hat_value[(socdY << 2) | (socd & SOCD_DIR_MASK)];
+#endif
 
     // clear old button settings
+    for (i = 0; i < sizeof(buttons); i++)
+    {
+        buttons[i] = 0;
+    }
+#if DPAD_MODE == DPAD_HAT
+    buttons[1] = hat;
+#endif
+
+    // set all the buttons - one bit for each button, a port run at a time
+    run = button_runs;
+    for (i = button_run_count; i; i--, run++)
+    {
+        bits = (uint8_t)((inPorts[run->index] ^ run->flip) & run->mask) * run->factor;
+        buttons[run->byte] |= bits;
+        buttons[run->byte + 1] |= bits >> 8;
+    }
+
+    // the buttons and controls of the other input sources
+#if USE_SPLIT_REPORTS
+    // the axes and encoders have their own report, and their own changes
+    g_analogPending |= sources_scan(inPorts, &buttons[1]);
+#else
+    changed |= sources_scan(inPorts, &buttons[1]);
+#endif
+
+#if USE_TURBO_ENGINE
+    // turbo and macros transform the sampled buttons before they are reported
+    simple_gamepad_turbo_apply(&buttons[1]);
+#endif
+
     for (i = 0; i < BUTTON_ARRAY_SIZE; i++)
     {
-        g_gamepadState.buttons[i] = 0;
+        changed |= g_gamepadState.buttons[i] ^ buttons[i + 1];
+        g_gamepadState.buttons[i] = buttons[i + 1];
     }
 
-    // set all the buttons - one bit for each button
+#if USE_KEYBOARD
+    // the keyboard report is made from this same sample, only when it
+    // changed the state
+    if (changed)
+        simple_gamepad_keyboard_update(&g_gamepadState);
+#endif
+
+    return (changed ? 1 : 0);
+}
+
+
+#if USE_LOOPBACK_PROBE
+/* this function takes the token of an output report from the endpoint 0
+   FIFO, in the USB interrupt, stamps it, and has the main loop send a
+   report at once to carry it back */
+void
+simple_gamepad_probe_receive(void)
+{
+    uint16_t now;
+    uint8_t frame;
+
+#if USE_IDLE_SLEEP && IDLE_CLOCK_PRESCALE
+    // Timer3 runs from the CPU clock, so the full speed is restored before
+    // the stamp, for it to count at the same rate as the send stamp
+    CPU_PRESCALE(0);
+#endif
+    now = TCNT3;
+    frame = UDFNUML;
 
-    for (i = 0; i < BUTTON_COUNT; i++)
+    g_gamepadState.probe_token = UEBCLX ? UEDATX : 0;
+    g_gamepadState.probe_rx_frame = frame;
+    g_gamepadState.probe_rx_time[0] = now;
+    g_gamepadState.probe_rx_time[1] = now >> 8;
+    g_probePending = 1;
+#if USE_IDLE_SLEEP
+    g_inputEdge = 1;
+#endif
+}
+#endif
+
+
+#if USE_FRESH_REPORTS
+/* this function kills the banks of the selected endpoint that the host has
+   not collected yet, the newest first, with interrupts disabled, so that
+   it reads the next report at its next poll instead of a stale one. A bank
+   holding a press that next no longer has is kept, and the one before it,
+   or the host would never see that press: a button pressed and released
+   within one poll still reaches it, one poll late. loaded holds the
+   presses of the last two reports loaded, the newest first, and next those
+   of the next one, size bytes each. A kill takes a few cycles, unless the
+   host is collecting a bank at the time; it is waited for KILLBK_SPINS
+   checks at most, then left to finish on its own, returning 0: the
+   endpoint must not be written until KILLBK clears */
+uint8_t
+usb_fresh_banks(uint8_t *loaded, const uint8_t *next, uint8_t size)
+{
+    uint8_t i, busy, dropped;
+
+    if (UEINTX & (1<<KILLBK))
+        return 0;
+    busy = UESTA0X & ((1<<NBUSYBK1)|(1<<NBUSYBK0));
+    while (busy)
     {
-        btnArrayIndex = i / 8;
-        btnArrayShift = i % 8;
-        g_gamepadState.buttons[btnArrayIndex] |=
-                INPUT_ACTIVE(inPorts, BUTTON_BTN[i][0], BUTTON_BTN[i][1]) << btnArrayShift;
+        dropped = 0;
+        for (i = 0; i < size; i++)
+        {
+            dropped |= loaded[i] & ~next[i];
+        }
+        if (dropped)
+            break;
+        // writing ones leaves the UEINTX flags alone and sets KILLBK,
+        // which kills the last bank written. Once set, the kill happens,
+        // so the bank before it is the newest from now on
+        UEINTX = 0xFF;
+        memcpy(loaded, loaded + size, size);
+        busy--;
+        for (i = 0; UEINTX & (1<<KILLBK); i++)
+        {
+            if (i == KILLBK_SPINS)
+                return 0;
+        }
     }
+    return 1;
+}
+
 
-    return (memcmp(&g_gamepadState, &prevState, sizeof(prevState)) == 0 ? 0 : 1);
+/* this function records the presses of the report just loaded */
+void
+usb_fresh_loaded(uint8_t *loaded, const uint8_t *next, uint8_t size)
+{
+    memcpy(loaded + size, loaded, size);
+    memcpy(loaded, next, size);
 }
 
 
-/* this function transmits the state report */
+/* this function takes the presses of a state report */
+static void
+report_presses(const gamepad_state *state, uint8_t *presses)
+{
+    uint8_t i;
+
+    for (i = 0; i < BUTTON_ARRAY_SIZE; i++)
+    {
+        presses[i] = state->buttons[i];
+    }
+#if DPAD_MODE == DPAD_AXES
+    presses[BUTTON_ARRAY_SIZE] =
+        (state->y_axis == Y_AXIS_UP ? PRESS_UP : 0) |
+        (state->y_axis == Y_AXIS_DOWN ? PRESS_DOWN : 0) |
+        (state->x_axis == X_AXIS_LEFT ? PRESS_LEFT : 0) |
+        (state->x_axis == X_AXIS_RIGHT ? PRESS_RIGHT : 0);
+#else
+    i = presses[0] & 0x0F;
+    presses[0] &= 0xF0;
+    presses[BUTTON_ARRAY_SIZE] = pgm_read_byte(&hat_presses[i < HAT_CENTER ? i : HAT_CENTER]);
+#endif
+}
+#endif
+
+
+/* this function leaves the state report pending, restoring the interrupts,
+   and gives it up once it has been for SEND_TIMEOUT_FRAMES, as when the
+   host stops polling */
+static int8_t
+send_pending(uint8_t intr_state)
+{
+    uint8_t frame = UDFNUML;
+
+    SREG = intr_state;
+    if (!sendPending)
+    {
+        sendPending = 1;
+        sendFrame = frame;
+    }
+    else if ((uint8_t)(frame - sendFrame) >= SEND_TIMEOUT_FRAMES)
+    {
+        sendPending = 0;
+#if USE_BLACKBOX
+        simple_gamepad_blackbox_send(BLACKBOX_TIMEOUT);
+#endif
+        return -1;
+    }
+    return 1;
+}
+
+
+/* this function transmits the state report. It never waits for the host:
+   when the endpoint has no room, it returns 1 and the report is pending,
+   for the main loop to send again (with the state by then) at its next
+   pass. It returns 0 once the report is loaded, and -1 when the USB is
+   offline or the report was pending too long */
 int8_t
 usb_simple_gamepad_send(void)
 {
-    uint8_t intr_state, timeout, i;
+    uint8_t intr_state;
+#if USE_LOOPBACK_PROBE
+    uint16_t now;
+#endif
+#if USE_FRESH_REPORTS
+    uint8_t presses[PRESS_SIZE];
+#if ENCODER_COUNT > 0 && !USE_SPLIT_REPORTS
+    uint8_t i;
+#endif
+#endif
 
     if (!usb_configuration)
+    {
+        sendPending = 0;
+#if USE_BLACKBOX
+        simple_gamepad_blackbox_send(BLACKBOX_OFFLINE);
+#endif
         return -1;
+    }
 
     intr_state = SREG;
     cli();
     UENUM = GAMEPAD_ENDPOINT;
-    timeout = UDFNUML + 50;
-    for (;;)
+
+#if USE_FRESH_REPORTS
+    // make room first, so this report is not left waiting behind stale ones
+    report_presses(&g_gamepadState, presses);
+    if (!usb_fresh_banks(loadedPresses, presses, PRESS_SIZE))
+        return send_pending(intr_state);
+#endif
+    // are we ready to transmit?
+    if (!(UEINTX & (1<<RWAL)))
+        return send_pending(intr_state);
+    sendPending = 0;
+
+#if USE_LOOPBACK_PROBE
+    // the probe token goes back with the time the report is loaded at
+    now = TCNT3;
+    g_gamepadState.probe_load_frame = UDFNUML;
+    g_gamepadState.probe_load_time[0] = now;
+    g_gamepadState.probe_load_time[1] = now >> 8;
+    g_probePending = 0;
+#endif
+
+    // transmit the report
+    gamepad_report_write(&g_gamepadState);
+
+    UEINTX = 0x3A;
+#if USE_FRESH_REPORTS
+    usb_fresh_loaded(loadedPresses, presses, PRESS_SIZE);
+#if ENCODER_COUNT > 0 && !USE_SPLIT_REPORTS
+    // steps are relative, so a report carrying some is never replaced
+    for (i = 0; i < ENCODER_COUNT; i++)
     {
-        // are we ready to transmit?
-        if (UEINTX & (1<<RWAL))
-            break;
-        SREG = intr_state;
-        // has the USB gone offline?
-        if (!usb_configuration)
-            return -1;
-        // have we waited too long?
-        if (UDFNUML == timeout)
-            return -1;
-        // get ready to try checking again
-        intr_state = SREG;
-        cli();
-        UENUM = GAMEPAD_ENDPOINT;
+        if (g_gamepadState.encoders[i])
+            loadedPresses[PRESS_SIZE - 1] |= PRESS_STEPS;
     }
+#endif
+#endif
+#if USE_POLL_PHASE_TRACKING
+    poll_phase_report_loaded();
+#endif
+    sources_loaded();
+    SREG = intr_state;
+    return 0;
+}
 
-    // transmit axis
-    UEDATX = (uint8_t)g_gamepadState.x_axis;
-    UEDATX = (uint8_t)g_gamepadState.y_axis;
-    // transmit each button
-    for (i = 0; i < BUTTON_ARRAY_SIZE; i++)
+
+#if USE_SPLIT_REPORTS
+/* this function transmits the analog report, when its controls changed and
+   ANALOG_INTERVAL_MS frames have passed since the last one. It is called at
+   every pass of the main loop and never waits: a report the endpoint has
+   no room for stays pending for the next pass, and the state report is
+   never held up by it */
+void
+usb_simple_gamepad_send_analog(void)
+{
+    uint8_t intr_state;
+#if USE_FRESH_REPORTS
+    uint8_t i, steps = 0;
+#endif
+
+    if (!usb_configuration || (uint8_t)(UDFNUML - analogFrame) < ANALOG_INTERVAL_MS)
+        return;
+    if (!g_analogPending)
     {
-        UEDATX = g_gamepadState.buttons[i];
+        // keep the last report old enough that a change goes at once,
+        // rather than the frame count wrapping around to look recent
+        analogFrame = UDFNUML - ANALOG_INTERVAL_MS;
+        return;
     }
 
-    UEINTX = 0x3A;
+    intr_state = SREG;
+    cli();
+    UENUM = ANALOG_ENDPOINT;
+#if USE_FRESH_REPORTS
+    // the axes are absolute, but a report carrying encoder steps is kept
+    if (!usb_fresh_banks(loadedSteps, &steps, 1))
+    {
+        SREG = intr_state;
+        return;
+    }
+#if ENCODER_COUNT > 0
+    for (i = 0; i < ENCODER_COUNT; i++)
+    {
+        steps |= g_analogState.encoders[i];
+    }
+#endif
+#endif
+    if (UEINTX & (1<<RWAL))
+    {
+        analog_report_write(&g_analogState);
+        UEINTX = 0x3A;
+#if USE_FRESH_REPORTS
+        usb_fresh_loaded(loadedSteps, &steps, 1);
+#endif
+        sources_analog_loaded();
+        g_analogPending = 0;
+        analogFrame = UDFNUML;
+    }
     SREG = intr_state;
-    return 0;
 }
+#endif
 
 
 /* this function configures the hardware for the desired usage */
@@ -288,7 +902,12 @@ simple_gamepad_configure(void)
 {
     uint8_t i;
     // default all to outputs
-    uint8_t ddrValues[5] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    uint8_t ddrValues[PORT_COUNT];
+    uint8_t map[DIRECT_BUTTON_COUNT];
+    // the pins of the input sources
+    uint8_t reserved[PORT_COUNT];
+
+    memset(ddrValues, 0xFF, sizeof(ddrValues));
 
     // d-pad buttons
     SET_AS_INPUT(ddrValues, BUTTON_UP);
@@ -297,37 +916,151 @@ simple_gamepad_configure(void)
     SET_AS_INPUT(ddrValues, BUTTON_RIGHT);
 
     // set each button
-    for (i = 0; i < BUTTON_COUNT; i++)
+    for (i = 0; i < DIRECT_BUTTON_COUNT; i++)
     {
-        SET_AS_INPUT(ddrValues, BUTTON_BTN[i][0], BUTTON_BTN[i][1]);
+        SET_AS_INPUT(ddrValues, pgm_read_byte(&BUTTON_BTN[i][0]),
+                     pgm_read_byte(&BUTTON_BTN[i][1]));
+    }
+
+    // build the button runs, from the remapping stored in EEPROM
+#if USE_BUTTON_REMAP
+    simple_gamepad_remap_read(map);
+#else
+    for (i = 0; i < DIRECT_BUTTON_COUNT; i++)
+    {
+        map[i] = i;
+    }
+#endif
+    button_runs_build(map);
+
+    // the pins of the input sources are left as inputs until the sources
+    // set them up, so none is driven against what it is wired to
+    for (i = 0; i < PORT_COUNT * 8; i++)
+    {
+        if (i % 8 == 0)
+            reserved[i / 8] = 0;
+        if (sources_pin_reserved(i / 8, i % 8))
+            reserved[i / 8] |= 1 << (i % 8);
+    }
+    for (i = 0; i < PORT_COUNT; i++)
+    {
+        ddrValues[i] &= ~reserved[i];
     }
 
     // write to the DDR registers
+#ifdef INDEX_A
+    DDRA = ddrValues[INDEX_A];
+#endif
     DDRB = ddrValues[INDEX_B];
     DDRC = ddrValues[INDEX_C];
     DDRD = ddrValues[INDEX_D];
+#ifdef INDEX_E
     DDRE = ddrValues[INDEX_E];
     DDRF = ddrValues[INDEX_F];
+#endif
 
 #ifdef USE_INTERNAL_PULL_UPS
     // if using internal pull-up resistors, write a 1 to each input
     // and a 0 to all outputs to set them low
+#ifdef INDEX_A
+    PORTA = ~ddrValues[INDEX_A];
+#endif
     PORTB = ~ddrValues[INDEX_B];
     PORTC = ~ddrValues[INDEX_C];
     PORTD = ~ddrValues[INDEX_D];
+#ifdef INDEX_E
     PORTE = ~ddrValues[INDEX_E];
     PORTF = ~ddrValues[INDEX_F];
+#endif
 #else
     // set all ports to no internal pull-up and outputs to low
+#ifdef INDEX_A
+    PORTA = 0;
+#endif
     PORTB = 0;
     PORTC = 0;
     PORTD = 0;
+#ifdef INDEX_E
     PORTE = 0;
     PORTF = 0;
 #endif
+#endif
+
+    // and they do not wake the idle sleep, a source being read on the
+    // start-of-frame like the inputs without an interrupt
+    for (i = 0; i < PORT_COUNT; i++)
+    {
+        ddrValues[i] |= reserved[i];
+    }
+
+#if USE_IDLE_SLEEP
+    // wake from idle sleep on any edge of the inputs that can interrupt:
+    // all of port B through pin change interrupt 0, D0-D3 through INT0-3
+    // and E6 (E4-E7 on the Teensy++) through INT6 (INT4-7), each set to
+    // trigger on any logical change. On the Teensy 1.0 every input can:
+    // C7, D4 and D7 through INT4, INT5 and INT7, and C2, C4-C6 and D5
+    // through pin change interrupt 1
+    PCMSK0 = ~ddrValues[INDEX_B];
+    PCIFR = (1 << PCIF0);
+    PCICR = (1 << PCIE0);
+    EICRA = (1 << ISC30) | (1 << ISC20) | (1 << ISC10) | (1 << ISC00);
+    EIFR = 0xFF;
+#if defined(__AVR_ATmega32U4__)
+    EICRB = (1 << ISC60);
+    EIMSK = (~ddrValues[INDEX_D] & 0x0F) | (~ddrValues[INDEX_E] & (1 << 6));
+#elif defined(__AVR_AT90USB162__)
+#define WAKE_BIT(index, shift, bit) ((((uint8_t)~ddrValues[index] >> (shift)) & 1) << (bit))
+    EICRB = (1 << ISC70) | (1 << ISC50) | (1 << ISC40);
+    EIMSK = (~ddrValues[INDEX_D] & 0x0F) | WAKE_BIT(INDEX_C, 7, 4) |
+            WAKE_BIT(INDEX_D, 4, 5) | WAKE_BIT(INDEX_D, 7, 7);
+    PCMSK1 = WAKE_BIT(INDEX_C, 6, 0) | WAKE_BIT(INDEX_C, 5, 1) |
+             WAKE_BIT(INDEX_C, 4, 2) | WAKE_BIT(INDEX_C, 2, 3) |
+             WAKE_BIT(INDEX_D, 5, 4);
+    PCIFR = (1 << PCIF1) | (1 << PCIF0);
+    PCICR = (1 << PCIE1) | (1 << PCIE0);
+#else
+    EICRB = (1 << ISC70) | (1 << ISC60) | (1 << ISC50) | (1 << ISC40);
+    EIMSK = (~ddrValues[INDEX_D] & 0x0F) | (~ddrValues[INDEX_E] & 0xF0);
+#endif
+#endif
+
+    // the input sources set up their own pins, and their interrupts
+    sources_init();
+
+#if USE_LOOPBACK_PROBE
+    // the probe times are taken from Timer3, free running
+    TCCR3A = 0;
+    TCCR3B = (1<<CS31) | (1<<CS30);         // F_CPU / 64
+#endif
 }
 
 
+#if USE_IDLE_SLEEP
+/* any input edge wakes the main loop and restores the full clock speed, so
+   the sample and report that follow are not slowed by the idle prescaler */
+ISR(PCINT0_vect)
+{
+    CPU_PRESCALE(0);
+    g_inputEdge = 1;
+}
+ISR(INT0_vect, ISR_ALIASOF(PCINT0_vect));
+ISR(INT1_vect, ISR_ALIASOF(PCINT0_vect));
+ISR(INT2_vect, ISR_ALIASOF(PCINT0_vect));
+ISR(INT3_vect, ISR_ALIASOF(PCINT0_vect));
+#if !USE_EXPANDERS
+ISR(INT6_vect, ISR_ALIASOF(PCINT0_vect));
+#endif
+#if !defined(__AVR_ATmega32U4__)
+ISR(INT4_vect, ISR_ALIASOF(PCINT0_vect));
+ISR(INT5_vect, ISR_ALIASOF(PCINT0_vect));
+ISR(INT7_vect, ISR_ALIASOF(PCINT0_vect));
+#endif
+#if defined(__AVR_AT90USB162__)
+ISR(PCINT1_vect, ISR_ALIASOF(PCINT0_vect));
+#endif
+#endif
+
+
 
 
 
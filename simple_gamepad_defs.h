@@ -53,26 +53,355 @@
 void simple_gamepad_configure(void);
 /* this function reads the gamepad state from the hardware */
 uint8_t simple_gampad_read_buttons(void);
-/* this function transmits the state report */
+/* this function transmits the state report: 0 loaded, 1 pending for want
+   of room, to be sent again, -1 offline or given up on */
 int8_t usb_simple_gamepad_send(void);
+#if USE_SPLIT_REPORTS
+/* this function transmits the analog report, if it is due */
+void usb_simple_gamepad_send_analog(void);
+#endif
+
+/* the USB frames a state report stays pending at most for room */
+#define SEND_TIMEOUT_FRAMES 50
+
+#if USE_FRESH_REPORTS
+/* the checks a bank kill is waited for, a few microseconds */
+#define KILLBK_SPINS 8
+
+/* these functions replace the reports of the selected endpoint the host has
+   not collected with the next one, keeping any that holds a press the next
+   one no longer has (see simple_gamepad_defs.c). loaded holds the presses
+   of the last two reports loaded, size bytes each, the newest first */
+uint8_t usb_fresh_banks(uint8_t *loaded, const uint8_t *next, uint8_t size);
+void usb_fresh_loaded(uint8_t *loaded, const uint8_t *next, uint8_t size);
+#endif
+
+
+/* sets the system clock to F_CPU / 2^n. The two writes must happen within
+   four cycles of each other, so interrupts must be off unless called from
+   an interrupt handler */
+#define CPU_PRESCALE(n) (CLKPR = 0x80, CLKPR = (n))
+
+/* the turbo and macro engine is only built when something uses it */
+#define USE_TURBO_ENGINE (TURBO_BUTTONS != 0 || MACRO_COUNT > 0)
+
+/* turbo and macro step masks are 32 bits, BTN1 to BTN32 */
+#if TURBO_BUTTONS > 0xFFFFFFFF || (BUTTON_COUNT < 32 && (TURBO_BUTTONS >> BUTTON_COUNT) != 0)
+#error TURBO_BUTTONS can only set the bits of BTN1 to BTN32, up to BUTTON_COUNT
+#endif
+
+/* the feature report, a configuration channel to and from the host, is only
+   built when something uses it */
+#define USE_FEATURE_REPORT \
+    (USE_BUTTON_REMAP || USE_STACK_MONITOR || USE_EXPANDERS || LINK_MODE == LINK_PRIMARY || \
+     HALL_BUTTON_COUNT > 0 || USE_BLACKBOX || USE_POLL_PHASE_TRACKING)
+
+/* the feature report size in bytes, one control transfer packet */
+#define FEATURE_REPORT_SIZE 32
+
+/* fixed EEPROM addresses of the stored settings, so host tools can prepare
+   EEPROM images */
+#define EEPROM_IDENTITY_ADDR    0x000
+#define EEPROM_REMAP_ADDR       0x100
+
+#if USE_BUTTON_REMAP
+/* Each pin button of the report is described by one remap byte: the button
+   pin it reads (0 for BTN1's pin, as listed in simple_gamepad_config.h),
+   plus REMAP_INVERT to be pressed when the pin is high, or REMAP_DISABLE to
+   never be pressed */
+#define REMAP_PIN_MASK  0x3F
+#define REMAP_INVERT    0x40
+#define REMAP_DISABLE   0x80
+
+/* this function fills map with the remap byte of each pin button, from
+   EEPROM or the default one button per pin, and returns their number */
+uint8_t simple_gamepad_remap_read(uint8_t *map);
+/* this function checks, applies and stores the remap bytes of all the pin
+   buttons. Returns 0 if they are not valid for this gamepad */
+uint8_t simple_gamepad_remap_write(const uint8_t *map);
+/* this function erases the stored remapping and restores the default */
+void simple_gamepad_remap_reset(void);
+#endif
+
+#if USE_IDLE_SLEEP
+/* set by the input pin interrupts when any input changes, cleared by the
+   main loop once it has sampled the inputs */
+extern volatile uint8_t g_inputEdge;
+#endif
+
+#if USE_BLACKBOX && BLACKBOX_SIZE != 64 && BLACKBOX_SIZE != 128 && BLACKBOX_SIZE != 256
+#error BLACKBOX_SIZE must be 64, 128 or 256
+#endif
+
+#if USE_LOOPBACK_PROBE && defined(__AVR_AT90USB162__)
+#error USE_LOOPBACK_PROBE must be 0 on the Teensy 1.0, which has no Timer3
+#endif
+#if USE_LOOPBACK_PROBE
+/* the bytes of the probe in the input report */
+#define PROBE_REPORT_SIZE   7
+/* set by the USB interrupt when a probe token arrives, cleared once a
+   report carrying it back has been loaded */
+extern volatile uint8_t g_probePending;
+#define PROBE_PENDING()     (g_probePending)
+/* this function takes the token of an output report from the endpoint 0
+   FIFO, in the USB interrupt */
+void simple_gamepad_probe_receive(void);
+#else
+#define PROBE_REPORT_SIZE   0
+#define PROBE_PENDING()     0
+#endif
+
+
+// these select how the D-pad is reported, see DPAD_MODE
+#define DPAD_AXES       0
+#define DPAD_HAT        1
+
+/* In hat mode the 4-bit hat shares the first byte of the button bits, so a
+   D-pad costs half a byte instead of two. BUTTON_BIT_OFFSET is where BTN1
+   sits in the buttons array. */
+#if DPAD_MODE == DPAD_AXES
+#define DPAD_REPORT_SIZE    2
+#define BUTTON_BIT_OFFSET   0
+#elif DPAD_MODE == DPAD_HAT
+#define DPAD_REPORT_SIZE    0
+#define BUTTON_BIT_OFFSET   4
+#else
+#error DPAD_MODE must be DPAD_AXES or DPAD_HAT
+#endif
+
+#if BUTTON_COUNT < 1 || BUTTON_COUNT > 128
+#error BUTTON_COUNT must be 1 to 128
+#endif
+#if AXIS_COUNT < 0 || AXIS_COUNT > 5
+#error AXIS_COUNT must be 0 to 5
+#endif
+#if ENCODER_COUNT < 0 || ENCODER_COUNT > 2
+#error ENCODER_COUNT must be 0 to 2
+#endif
+#if USE_SPLIT_REPORTS && AXIS_COUNT == 0 && ENCODER_COUNT == 0
+#error USE_SPLIT_REPORTS needs AXIS_COUNT or ENCODER_COUNT, there is nothing to split
+#endif
+#if USE_SPLIT_REPORTS && (ANALOG_INTERVAL_MS < 1 || ANALOG_INTERVAL_MS > 255)
+#error ANALOG_INTERVAL_MS must be 1 to 255
+#endif
+
+/* the number of buttons that can be read from pins on each board */
+#if defined(__AVR_ATmega32U4__)
+#define PIN_BUTTON_COUNT    20  // Teensy 2.0
+#elif defined(__AVR_AT90USB1286__) || defined(__AVR_AT90USB646__)
+#define PIN_BUTTON_COUNT    41  // Teensy++ 2.0 and 1.0
+#elif defined(__AVR_AT90USB162__)
+#define PIN_BUTTON_COUNT    16  // Teensy 1.0
+#else
+#error MCU must be atmega32u4 (Teensy 2.0), at90usb1286 (Teensy++ 2.0), at90usb646 (Teensy++ 1.0) or at90usb162 (Teensy 1.0)
+#endif
+
+/* The input sources other than the pins, see simple_gamepad_sources.h.
+   Their buttons follow the pin buttons in the report, in this order */
+
+// this selects the console controller, see CONSOLE_PAD
+#define CONSOLE_NONE    0
+#define CONSOLE_NES     1
+#define CONSOLE_SNES    2
+
+// this selects the role of the board, see LINK_MODE
+#define LINK_NONE       0
+#define LINK_PRIMARY    1
+#define LINK_SECONDARY  2
+
+/* buttons read from MCP23017 port expanders */
+#define USE_EXPANDERS (EXPANDER_COUNT > 0)
+#if EXPANDER_COUNT < 0 || EXPANDER_COUNT > 8
+#error EXPANDER_COUNT must be 0 to 8
+#endif
+#if USE_EXPANDERS && defined(__AVR_AT90USB162__)
+#error EXPANDER_COUNT must be 0 on the Teensy 1.0, which has no I2C hardware
+#endif
+#define EXPANDER_BUTTON_COUNT   (16 * EXPANDER_COUNT)
+
+#if MATRIX_ROWS < 0 || MATRIX_ROWS > 8 || MATRIX_COLS < 0 || MATRIX_COLS > 8
+#error MATRIX_ROWS and MATRIX_COLS must be 0 to 8
+#endif
+#define MATRIX_BUTTON_COUNT     (MATRIX_ROWS * MATRIX_COLS)
+
+#if SHIFT_BUTTON_COUNT < 0 || SHIFT_BUTTON_COUNT > 64
+#error SHIFT_BUTTON_COUNT must be 0 to 64
+#endif
+
+#if CONSOLE_PAD == CONSOLE_NONE
+#define CONSOLE_BUTTON_COUNT    0
+#elif CONSOLE_PAD == CONSOLE_NES
+#define CONSOLE_BUTTON_COUNT    8
+#elif CONSOLE_PAD == CONSOLE_SNES
+#define CONSOLE_BUTTON_COUNT    12
+#else
+#error CONSOLE_PAD must be CONSOLE_NONE, CONSOLE_NES or CONSOLE_SNES
+#endif
+
+#if ADC_AXES < 0 || ADC_AXES > AXIS_COUNT
+#error ADC_AXES must be 0 to AXIS_COUNT
+#endif
+#if ADC_AXES > 0 && defined(__AVR_AT90USB162__)
+#error ADC_AXES must be 0 on the Teensy 1.0, which has no ADC
+#endif
+#if HALL_BUTTON_COUNT < 0 || HALL_BUTTON_COUNT > 8
+#error HALL_BUTTON_COUNT must be 0 to 8
+#endif
+#if HALL_BUTTON_COUNT > 0 && defined(__AVR_AT90USB162__)
+#error HALL_BUTTON_COUNT must be 0 on the Teensy 1.0, which has no ADC
+#endif
+#if HALL_BUTTON_COUNT > 0 && (HALL_RELEASE_FLOOR < 1 || HALL_ACTUATION < HALL_RELEASE_FLOOR || \
+    HALL_ACTUATION > 255 || HALL_PRESS_DELTA < 1 || HALL_RELEASE_DELTA < 1)
+#error HALL_ACTUATION must be HALL_RELEASE_FLOOR to 255, and the deltas and floor at least 1
+#endif
+#if ENCODER_INPUTS < 0 || ENCODER_INPUTS > ENCODER_COUNT
+#error ENCODER_INPUTS must be 0 to ENCODER_COUNT
+#endif
+
+/* boards linked by their UARTs, see LINK_MODE */
+#define USE_LINK_PRIMARY    (LINK_MODE == LINK_PRIMARY)
+#define USE_LINK_SECONDARY  (LINK_MODE == LINK_SECONDARY)
+#if LINK_MODE != LINK_NONE && !USE_LINK_PRIMARY && !USE_LINK_SECONDARY
+#error LINK_MODE must be LINK_NONE, LINK_PRIMARY or LINK_SECONDARY
+#endif
+#if LINK_MODE != LINK_NONE && defined(__AVR_AT90USB162__)
+#error LINK_MODE must be LINK_NONE on the Teensy 1.0, which has no Timer3
+#endif
+#if LINK_SECONDARIES < 1 || LINK_SECONDARIES > 8
+#error LINK_SECONDARIES must be 1 to 8
+#endif
+#if LINK_ADDRESS < 0 || LINK_ADDRESS >= LINK_SECONDARIES
+#error LINK_ADDRESS must be 0 to LINK_SECONDARIES - 1
+#endif
+#if LINK_BUTTON_COUNT < 1 || LINK_BUTTON_COUNT > 128
+#error LINK_BUTTON_COUNT must be 1 to 128
+#endif
+#if USE_LINK_PRIMARY
+#define LINK_TOTAL_BUTTON_COUNT (LINK_SECONDARIES * LINK_BUTTON_COUNT)
+#else
+#define LINK_TOTAL_BUTTON_COUNT 0
+#endif
+
+#define SOURCE_BUTTON_COUNT \
+    (EXPANDER_BUTTON_COUNT + MATRIX_BUTTON_COUNT + SHIFT_BUTTON_COUNT + CONSOLE_BUTTON_COUNT + \
+     HALL_BUTTON_COUNT + LINK_TOTAL_BUTTON_COUNT)
+
+/* buttons read from the pins, as many as BUTTON_COUNT leaves room for once
+   the other sources have theirs */
+#if BUTTON_COUNT <= SOURCE_BUTTON_COUNT
+#error BUTTON_COUNT must leave room for the buttons of the input sources and at least one pin button
+#elif BUTTON_COUNT - SOURCE_BUTTON_COUNT > PIN_BUTTON_COUNT
+#define DIRECT_BUTTON_COUNT PIN_BUTTON_COUNT
+#else
+#define DIRECT_BUTTON_COUNT (BUTTON_COUNT - SOURCE_BUTTON_COUNT)
+#endif
+
+/* where the buttons of each source start, counting the bits of the buttons
+   array */
+#define EXPANDER_FIRST_BIT  (BUTTON_BIT_OFFSET + DIRECT_BUTTON_COUNT)
+#define MATRIX_FIRST_BIT    (EXPANDER_FIRST_BIT + EXPANDER_BUTTON_COUNT)
+#define SHIFT_FIRST_BIT     (MATRIX_FIRST_BIT + MATRIX_BUTTON_COUNT)
+#define CONSOLE_FIRST_BIT   (SHIFT_FIRST_BIT + SHIFT_BUTTON_COUNT)
+#define HALL_FIRST_BIT      (CONSOLE_FIRST_BIT + CONSOLE_BUTTON_COUNT)
+#define LINK_FIRST_BIT      (HALL_FIRST_BIT + HALL_BUTTON_COUNT)
 
+/* button array byte size, 1 bit for each button (and 4 for the hat) */
+#define BUTTON_ARRAY_SIZE ((BUTTON_BIT_OFFSET + BUTTON_COUNT + 7) / 8)
 
-/* button array byte size, 1 bit for each button */
-#define BUTTON_ARRAY_SIZE ((BUTTON_COUNT + 7) / 8)
+/* the report size in bytes, the report is the gamepad_state byte for byte.
+   With USE_SPLIT_REPORTS the axes and encoders are in the analog report,
+   the analog_state byte for byte, instead */
+#if USE_SPLIT_REPORTS
+#define ANALOG_REPORT_SIZE  (AXIS_COUNT + ENCODER_COUNT)
+#define GAMEPAD_REPORT_SIZE \
+    (DPAD_REPORT_SIZE + BUTTON_ARRAY_SIZE + PROBE_REPORT_SIZE)
+#else
+#define GAMEPAD_REPORT_SIZE \
+    (DPAD_REPORT_SIZE + BUTTON_ARRAY_SIZE + AXIS_COUNT + ENCODER_COUNT + PROBE_REPORT_SIZE)
+#endif
 
 typedef struct
 {
+#if DPAD_MODE == DPAD_AXES
     /* x and y axis */
     uint8_t x_axis;
     uint8_t y_axis;
+#endif
 
-    /* the buttons - one bit for each */
+    /* the buttons - one bit for each, starting at BUTTON_BIT_OFFSET. In hat
+       mode the low 4 bits of buttons[0] are the hat switch: 0 = up, then
+       clockwise to 7, or HAT_CENTER */
     uint8_t buttons[BUTTON_ARRAY_SIZE];
 
+#if AXIS_COUNT > 0 && !USE_SPLIT_REPORTS
+    /* extra axes, -127 to 127 */
+    uint8_t axes[AXIS_COUNT];
+#endif
+#if ENCODER_COUNT > 0 && !USE_SPLIT_REPORTS
+    /* relative controls, movement since the previous report */
+    int8_t encoders[ENCODER_COUNT];
+#endif
+#if USE_LOOPBACK_PROBE
+    /* the last probe token, the USB frame number (low byte) and Timer3
+       time it arrived at, and those of this report being loaded. The times
+       are low byte first, in ticks of 64 / F_CPU */
+    uint8_t probe_token;
+    uint8_t probe_rx_frame;
+    uint8_t probe_rx_time[2];
+    uint8_t probe_load_frame;
+    uint8_t probe_load_time[2];
+#endif
+
 } gamepad_state;
 
 extern gamepad_state g_gamepadState;
 
+#if USE_SPLIT_REPORTS
+typedef struct
+{
+#if AXIS_COUNT > 0
+    /* extra axes, -127 to 127 */
+    uint8_t axes[AXIS_COUNT];
+#endif
+#if ENCODER_COUNT > 0
+    /* relative controls, movement since the previous analog report */
+    int8_t encoders[ENCODER_COUNT];
+#endif
+} analog_state;
+
+extern analog_state g_analogState;
+/* set when the analog controls changed since the last analog report */
+extern uint8_t g_analogPending;
+/* the state the axes and encoders are read into */
+#define ANALOG_STATE        g_analogState
+#else
+#define ANALOG_STATE        g_gamepadState
+#endif
+
+#if HALL_BUTTON_COUNT > 0
+/* the measures of the rapid trigger switches (see HALL_BUTTON_COUNT): the
+   rounds of the ADC, each sampling every analog input once, and the time
+   from a switch being decided on to the report carrying it being loaded,
+   in rounds. 16 bits each, wrapping */
+typedef struct
+{
+    uint16_t rounds;
+    uint16_t last_latency;
+    uint16_t max_latency;
+} hall_info;
+
+extern volatile hall_info g_hallInfo;
+/* the pressed switches, a bit each, and the last travel of each */
+extern volatile uint8_t g_hallState;
+extern volatile uint8_t g_hallTravel[HALL_BUTTON_COUNT];
+#endif
+
+// these select how opposite D-pad directions are resolved, see SOCD_MODE
+#define SOCD_PRIORITY   0
+#define SOCD_NEUTRAL    1
+#define SOCD_LAST_WIN   2
+#define SOCD_FIRST_WIN  3
+
 // these are used to set the axis values
 #define AXIS_CENTER     ((uint8_t)0x00)
 #define X_AXIS_LEFT     ((uint8_t)0x81) // -127
@@ -80,11 +409,14 @@ extern gamepad_state g_gamepadState;
 #define Y_AXIS_UP       ((uint8_t)0x81) // -127
 #define Y_AXIS_DOWN     ((uint8_t)0x7F) // 127
 
+// hat switch value when no direction is pressed (outside the logical range)
+#define HAT_CENTER      ((uint8_t)0x08)
 
-#if (BUTTON_COUNT % 8) == 0
+
+#if ((BUTTON_BIT_OFFSET + BUTTON_COUNT) % 8) == 0
 #define PADDING_BITS 0
 #else
-#define PADDING_BITS (8 - (BUTTON_COUNT % 8))
+#define PADDING_BITS (8 - ((BUTTON_BIT_OFFSET + BUTTON_COUNT) % 8))
 #endif
 
 /* define the HID report */
@@ -93,6 +425,7 @@ static const uint8_t PROGMEM gamepad_hid_report_desc[] = {
     0x09, 0x05,         // USAGE (Game Pad)
     0xa1, 0x01,         // COLLECTION (Application)
     0xa1, 0x00,         //   COLLECTION (Physical)
+#if DPAD_MODE == DPAD_AXES
     0x09, 0x30,         //     USAGE (X)
     0x09, 0x31,         //     USAGE (Y)
     0x15, 0x81,         //     LOGICAL_MINIMUM (-127)
@@ -100,6 +433,19 @@ static const uint8_t PROGMEM gamepad_hid_report_desc[] = {
     0x75, 0x08,         //     REPORT_SIZE (8)
     0x95, 0x02,         //     REPORT_COUNT (2)
     0x81, 0x02,         //     INPUT (Data,Var,Abs)
+#else
+    0x09, 0x39,         //     USAGE (Hat switch)
+    0x15, 0x00,         //     LOGICAL_MINIMUM (0)
+    0x25, 0x07,         //     LOGICAL_MAXIMUM (7)
+    0x35, 0x00,         //     PHYSICAL_MINIMUM (0)
+    0x46, 0x3b, 0x01,   //     PHYSICAL_MAXIMUM (315)
+    0x65, 0x14,         //     UNIT (Eng Rot:Angular Pos)
+    0x75, 0x04,         //     REPORT_SIZE (4)
+    0x95, 0x01,         //     REPORT_COUNT (1)
+    0x81, 0x42,         //     INPUT (Data,Var,Abs,Null)
+    0x65, 0x00,         //     UNIT (None)
+    0x45, 0x00,         //     PHYSICAL_MAXIMUM (0)
+#endif
     0x05, 0x09,         //     USAGE_PAGE (Button)
     0x19, 0x01,         //     USAGE_MINIMUM (Button 1)
     0x29, BUTTON_COUNT, //     USAGE_MAXIMUM (Button N)
@@ -112,11 +458,122 @@ static const uint8_t PROGMEM gamepad_hid_report_desc[] = {
     0x95, PADDING_BITS, //     REPORT_COUNT (Padding bits to fit to uint8_t)
     0x75, 0x01,         //     REPORT_SIZE (1)
     0x81, 0x03,         //     INPUT (Cnst,Var,Abs)
+#endif
+#if AXIS_COUNT > 0 && !USE_SPLIT_REPORTS
+    0x05, 0x01,         //     USAGE_PAGE (Generic Desktop)
+    0x19, 0x32,         //     USAGE_MINIMUM (Z)
+    0x29, 0x32 + AXIS_COUNT - 1, // USAGE_MAXIMUM (Z + AXIS_COUNT - 1)
+    0x15, 0x81,         //     LOGICAL_MINIMUM (-127)
+    0x25, 0x7f,         //     LOGICAL_MAXIMUM (127)
+    0x75, 0x08,         //     REPORT_SIZE (8)
+    0x95, AXIS_COUNT,   //     REPORT_COUNT (Number of Axes)
+    0x81, 0x02,         //     INPUT (Data,Var,Abs)
+#endif
+#if ENCODER_COUNT > 0 && !USE_SPLIT_REPORTS
+    0x05, 0x01,         //     USAGE_PAGE (Generic Desktop)
+    0x19, 0x37,         //     USAGE_MINIMUM (Dial)
+    0x29, 0x37 + ENCODER_COUNT - 1, // USAGE_MAXIMUM (Dial or Wheel)
+    0x15, 0x81,         //     LOGICAL_MINIMUM (-127)
+    0x25, 0x7f,         //     LOGICAL_MAXIMUM (127)
+    0x75, 0x08,         //     REPORT_SIZE (8)
+    0x95, ENCODER_COUNT, //    REPORT_COUNT (Number of Encoders)
+    0x81, 0x06,         //     INPUT (Data,Var,Rel)
+#endif
+    0xc0,               //   END_COLLECTION
+#if USE_LOOPBACK_PROBE
+    0x06, 0x00, 0xff,   //   USAGE_PAGE (Vendor Defined Page 1)
+    0x09, 0x02,         //   USAGE (Vendor Usage 2)
+    0x15, 0x00,         //   LOGICAL_MINIMUM (0)
+    0x26, 0xff, 0x00,   //   LOGICAL_MAXIMUM (255)
+    0x75, 0x08,         //   REPORT_SIZE (8)
+    0x95, PROBE_REPORT_SIZE, // REPORT_COUNT (Probe Size)
+    0x81, 0x02,         //   INPUT (Data,Var,Abs)
+    0x09, 0x03,         //   USAGE (Vendor Usage 3)
+    0x95, 0x01,         //   REPORT_COUNT (1)
+    0x91, 0x02,         //   OUTPUT (Data,Var,Abs)
+#endif
+#if USE_FEATURE_REPORT
+    0x06, 0x00, 0xff,   //   USAGE_PAGE (Vendor Defined Page 1)
+    0x09, 0x01,         //   USAGE (Vendor Usage 1)
+    0x15, 0x00,         //   LOGICAL_MINIMUM (0)
+    0x26, 0xff, 0x00,   //   LOGICAL_MAXIMUM (255)
+    0x75, 0x08,         //   REPORT_SIZE (8)
+    0x95, FEATURE_REPORT_SIZE, // REPORT_COUNT (Feature Report Size)
+    0xb1, 0x02,         //   FEATURE (Data,Var,Abs)
+#endif
+    0xc0                // END_COLLECTION
+};
+
+
+/* Writes the report into the selected endpoint FIFO. The report is the
+   gamepad_state byte for byte, so packing it is a straight copy of a size
+   known at compile time: every line below is either one FIFO write or is
+   removed by the compiler, and no loop runs. */
+#define REPORT_BYTE(n)  if ((n) < GAMEPAD_REPORT_SIZE) UEDATX = report[(n)]
+#define REPORT_BYTES8(n) \
+    REPORT_BYTE(n); REPORT_BYTE(n + 1); REPORT_BYTE(n + 2); REPORT_BYTE(n + 3); \
+    REPORT_BYTE(n + 4); REPORT_BYTE(n + 5); REPORT_BYTE(n + 6); REPORT_BYTE(n + 7)
+
+static inline void
+gamepad_report_write(const gamepad_state *state)
+{
+    const uint8_t *report = (const uint8_t *)state;
+
+    REPORT_BYTES8(0);
+    REPORT_BYTES8(8);
+    REPORT_BYTES8(16);
+    REPORT_BYTES8(24);
+}
+
+typedef char gamepad_report_size_check[
+        (sizeof(gamepad_state) == GAMEPAD_REPORT_SIZE && GAMEPAD_REPORT_SIZE <= 32) ? 1 : -1];
+
+#if USE_SPLIT_REPORTS
+/* define the analog report, on an interface of its own */
+static const uint8_t PROGMEM analog_hid_report_desc[] = {
+    0x05, 0x01,         // USAGE_PAGE (Generic Desktop)
+    0x09, 0x05,         // USAGE (Game Pad)
+    0xa1, 0x01,         // COLLECTION (Application)
+    0xa1, 0x00,         //   COLLECTION (Physical)
+#if AXIS_COUNT > 0
+    0x19, 0x32,         //     USAGE_MINIMUM (Z)
+    0x29, 0x32 + AXIS_COUNT - 1, // USAGE_MAXIMUM (Z + AXIS_COUNT - 1)
+    0x15, 0x81,         //     LOGICAL_MINIMUM (-127)
+    0x25, 0x7f,         //     LOGICAL_MAXIMUM (127)
+    0x75, 0x08,         //     REPORT_SIZE (8)
+    0x95, AXIS_COUNT,   //     REPORT_COUNT (Number of Axes)
+    0x81, 0x02,         //     INPUT (Data,Var,Abs)
+#endif
+#if ENCODER_COUNT > 0
+    0x19, 0x37,         //     USAGE_MINIMUM (Dial)
+    0x29, 0x37 + ENCODER_COUNT - 1, // USAGE_MAXIMUM (Dial or Wheel)
+    0x15, 0x81,         //     LOGICAL_MINIMUM (-127)
+    0x25, 0x7f,         //     LOGICAL_MAXIMUM (127)
+    0x75, 0x08,         //     REPORT_SIZE (8)
+    0x95, ENCODER_COUNT, //    REPORT_COUNT (Number of Encoders)
+    0x81, 0x06,         //     INPUT (Data,Var,Rel)
 #endif
     0xc0,               //   END_COLLECTION
     0xc0                // END_COLLECTION
 };
 
+/* Writes the analog report into the selected endpoint FIFO, as
+   gamepad_report_write does the state report */
+#define ANALOG_BYTE(n)  if ((n) < ANALOG_REPORT_SIZE) UEDATX = report[(n)]
+
+static inline void
+analog_report_write(const analog_state *state)
+{
+    const uint8_t *report = (const uint8_t *)state;
+
+    ANALOG_BYTE(0); ANALOG_BYTE(1); ANALOG_BYTE(2); ANALOG_BYTE(3);
+    ANALOG_BYTE(4); ANALOG_BYTE(5); ANALOG_BYTE(6);
+}
+
+typedef char analog_report_size_check[
+        (sizeof(analog_state) == ANALOG_REPORT_SIZE && ANALOG_REPORT_SIZE <= 7) ? 1 : -1];
+#endif
+
 
 
 #endif /* SIMPLE_GAMEPAD_DEF_INTERNAL_H */
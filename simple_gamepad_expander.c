@@ -0,0 +1,383 @@
+/* Teensy Simple Gamepad
+ * A Gamepad device with one 2-axis D-pad and 1 or more buttons
+ * Copyright (C) 2013 Robert Byam, robertbyam.com
+ *
+ * Derived from keyboard and serial examples for Teensy USB Development Board
+ * http://www.pjrc.com/teensy/usb_keyboard.html
+ * http://www.pjrc.com/teensy/usb_serial.html
+ * Copyright (c) 2008 PJRC.COM, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* ===========================================================================
+   This software implements a generic gamepad with one 2-axis (four direction)
+   D-Pad and 1 or more button.  The intended usage is that all of these files
+   remain constant, and only the file simple_gamepad_config.h is modified to
+   specify the configurable parameters for the gamepad
+
+   simple_gamepad_expander.c
+   This file implements the MCP23017 port expander inputs. All the I2C
+   transfers are carried out a step at a time by the TWI interrupt, from a
+   queue of pending jobs, so the main loop never waits on the bus: it only
+   merges the last values read into the report.
+   ======================================================================== */
+
+#include "simple_gamepad_expander.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/twi.h>
+
+#if USE_EXPANDERS
+
+/* I2C bus clock */
+#define TWI_FREQ            400000UL
+
+/* expander addresses, 0x20 plus the number set on pins A2-A0 */
+#define EXPANDER_ADDR       0x20
+
+/* MCP23017 registers, in the default IOCON.BANK = 0 layout */
+#define MCP_GPINTENA        0x04
+#define MCP_INTFA           0x0E
+
+/* Setup, written from GPINTENA on in one sequential transfer: interrupt on
+   change of every pin, compared with its previous value, INTA and INTB
+   mirrored and open-drain so all the expanders share one line, and every
+   pin an input with its pull-up */
+#define MCP_IOCON_SETUP     0x44    // MIRROR | ODR
+static const uint8_t PROGMEM expander_setup[] =
+{
+    MCP_GPINTENA,
+    0xFF, 0xFF,                     // GPINTENA, GPINTENB
+    0x00, 0x00,                     // DEFVALA, DEFVALB
+    0x00, 0x00,                     // INTCONA, INTCONB
+    MCP_IOCON_SETUP, MCP_IOCON_SETUP,   // IOCON, twice
+    0xFF, 0xFF                      // GPPUA, GPPUB
+};
+
+/* a read takes INTFA, INTFB, INTCAPA, INTCAPB, GPIOA and GPIOB in one
+   sequential transfer, which also clears the expander's interrupt */
+#define EXPANDER_READ_SIZE  6
+
+/* the TWI control values: continue, continue and acknowledge the next byte
+   read, send a start, send a stop then a start, and send a stop */
+#define TWI_NEXT            ((1<<TWINT) | (1<<TWEN) | (1<<TWIE))
+#define TWI_NEXT_ACK        (TWI_NEXT | (1<<TWEA))
+#define TWI_START           (TWI_NEXT | (1<<TWSTA))
+#define TWI_STOP_START      (TWI_NEXT | (1<<TWSTO) | (1<<TWSTA))
+#define TWI_STOP            ((1<<TWINT) | (1<<TWEN) | (1<<TWSTO))
+
+/* the interrupt line is low while any expander has a change to be read */
+#define EXPANDER_INT_ACTIVE()   ((PINE & (1<<6)) == 0)
+
+#define ALL_EXPANDERS       ((uint8_t)((1 << EXPANDER_COUNT) - 1))
+
+volatile expander_info g_expanderInfo[EXPANDER_COUNT];
+
+/* the pressed buttons of each expander, written by the TWI interrupt */
+static volatile uint16_t expanderButtons[EXPANDER_COUNT];
+
+/* the job queue, one bit per expander for each kind of job */
+static volatile uint8_t setupPending;
+static volatile uint8_t readPending;
+static volatile uint8_t twiBusy;
+
+/* the job being carried out */
+static uint8_t job;
+static uint8_t jobIsSetup;
+static uint8_t jobReading;          // past the repeated start of a read
+static uint8_t jobCount;            // bytes moved so far
+static uint8_t jobData[EXPANDER_READ_SIZE];
+
+/* edge timing: the time of the first edge not yet read, and for each
+   expander whose change it was, the time of its edge. Its latency is
+   taken when a report holding the change (merged) is loaded */
+static volatile uint8_t edgeArmed;
+static volatile uint16_t edgeStamp;
+static volatile uint8_t latencyPending;
+static uint8_t latencyMerged;
+static volatile uint16_t latencyStamp[EXPANDER_COUNT];
+
+/* the expanders that reported a press already released when read, which
+   are read again once a report holding the press has been loaded, as
+   nothing else would signal the release */
+static volatile uint8_t tapPending;
+static uint8_t tapMerged;
+
+
+/* this function takes the next job from the queue and starts it, or
+   returns 0 if there is none. Setups go first, so an expander is never
+   read before it is set up */
+static uint8_t
+twi_next_job(void)
+{
+    uint8_t pending;
+
+    if (!setupPending && !readPending && EXPANDER_INT_ACTIVE())
+    {
+        // a change came in while the last ones were being read
+        readPending = ALL_EXPANDERS;
+    }
+    jobIsSetup = (setupPending != 0);
+    pending = jobIsSetup ? setupPending : readPending;
+    if (!pending)
+        return 0;
+
+    for (job = 0; !(pending & (1 << job)); job++)
+        ;
+    if (jobIsSetup)
+        setupPending &= ~(1 << job);
+    else
+        readPending &= ~(1 << job);
+    jobReading = 0;
+    jobCount = 0;
+    return 1;
+}
+
+
+/* this function ends the current transfer and starts the next job, or
+   leaves the bus idle */
+static void
+twi_finish(void)
+{
+    if (twi_next_job())
+    {
+        TWCR = TWI_STOP_START;
+    }
+    else
+    {
+        TWCR = TWI_STOP;
+        twiBusy = 0;
+        edgeArmed = 0;
+    }
+}
+
+
+/* this function stores the values read from the current expander */
+static void
+expander_read_done(void)
+{
+    uint16_t flags = jobData[0] | (jobData[1] << 8);
+    uint16_t captured = jobData[2] | (jobData[3] << 8);
+    uint16_t pins = jobData[4] | (jobData[5] << 8);
+    // pull-ups make buttons active LOW. A press already released by the
+    // time of the read still shows in the value captured at its edge, so
+    // it is reported at least once
+    uint16_t pressed = ~pins | (flags & ~captured);
+
+    if (flags & ~captured & pins)
+        tapPending |= 1 << job;
+    if (pressed != expanderButtons[job])
+    {
+        expanderButtons[job] = pressed;
+        if (edgeArmed && !(latencyPending & (1 << job)))
+        {
+            latencyStamp[job] = edgeStamp;
+            latencyPending |= 1 << job;
+        }
+#if USE_IDLE_SLEEP
+        g_inputEdge = 1;
+#endif
+    }
+}
+
+
+/* the TWI interrupt moves each transfer on by one step */
+ISR(TWI_vect)
+{
+    switch (TW_STATUS)
+    {
+    case TW_START:
+    case TW_REP_START:
+        TWDR = ((EXPANDER_ADDR + job) << 1) | (jobReading ? TW_READ : TW_WRITE);
+        TWCR = TWI_NEXT;
+        break;
+
+    case TW_MT_SLA_ACK:
+    case TW_MT_DATA_ACK:
+        if (jobIsSetup)
+        {
+            if (jobCount < sizeof(expander_setup))
+            {
+                TWDR = pgm_read_byte(&expander_setup[jobCount++]);
+                TWCR = TWI_NEXT;
+            }
+            else
+            {
+                twi_finish();
+            }
+        }
+        else if (jobCount == 0)
+        {
+            // the first register to read, then a repeated start to read
+            TWDR = MCP_INTFA;
+            TWCR = TWI_NEXT;
+            jobCount = 1;
+        }
+        else
+        {
+            jobReading = 1;
+            jobCount = 0;
+            TWCR = TWI_START;
+        }
+        break;
+
+    case TW_MR_SLA_ACK:
+        TWCR = TWI_NEXT_ACK;
+        break;
+
+    case TW_MR_DATA_ACK:
+        jobData[jobCount++] = TWDR;
+        // the last byte is not acknowledged, to end the read
+        TWCR = (jobCount < EXPANDER_READ_SIZE - 1) ? TWI_NEXT_ACK : TWI_NEXT;
+        break;
+
+    case TW_MR_DATA_NACK:
+        jobData[jobCount] = TWDR;
+        expander_read_done();
+        twi_finish();
+        break;
+
+    default:
+        // not acknowledged, arbitration lost or a bus error: the job is
+        // dropped, and a missing expander does not hold up the others
+        g_expanderInfo[job].errors++;
+        twi_finish();
+        break;
+    }
+}
+
+
+/* the interrupt line falls when an expander sees a change */
+ISR(INT6_vect)
+{
+#if USE_IDLE_SLEEP
+    // full speed at once, for the transfers and the report that follow
+    CPU_PRESCALE(0);
+#endif
+    if (!edgeArmed)
+    {
+        edgeStamp = TCNT3;
+        edgeArmed = 1;
+    }
+    readPending = ALL_EXPANDERS;
+    if (!twiBusy && twi_next_job())
+    {
+        twiBusy = 1;
+        TWCR = TWI_START;
+    }
+}
+
+
+/* this function starts the I2C bus, Timer3 and the interrupt line */
+void
+simple_gamepad_expander_init(void)
+{
+    // the bus and the interrupt line are inputs with pull-ups; the TWI
+    // drives SCL and SDA itself once enabled
+    DDRD &= ~((1<<1) | (1<<0));
+    PORTD |= (1<<1) | (1<<0);
+    DDRE &= ~(1<<6);
+    PORTE |= (1<<6);
+
+    TWSR = 0;                               // prescaler 1
+    TWBR = (F_CPU / TWI_FREQ - 16) / 2;
+
+    TCCR3A = 0;
+    TCCR3B = (1<<CS31) | (1<<CS30);         // free running, F_CPU / 64
+
+    // INT6 on the falling edge. INT0 and INT1 would see every bus clock
+    EIMSK &= ~((1<<INT1) | (1<<INT0));
+    EICRB = (EICRB & ~((1<<ISC61) | (1<<ISC60))) | (1<<ISC61);
+    EIFR = (1<<INTF6);
+    EIMSK |= (1<<INT6);
+
+    // set up and read every expander once interrupts are enabled
+    setupPending = ALL_EXPANDERS;
+    readPending = ALL_EXPANDERS;
+    twi_next_job();
+    twiBusy = 1;
+    TWCR = TWI_START;
+}
+
+
+/* this function ORs the pressed expander buttons into the buttons array */
+void
+simple_gamepad_expander_merge(uint8_t *buttons)
+{
+    uint8_t n, i, byte, intr_state;
+    uint16_t pressed;
+    uint32_t bits;
+
+    for (n = 0; n < EXPANDER_COUNT; n++)
+    {
+        intr_state = SREG;
+        cli();
+        pressed = expanderButtons[n];
+        latencyMerged |= latencyPending & (1 << n);
+        tapMerged |= tapPending & (1 << n);
+        tapPending &= ~(1 << n);
+        SREG = intr_state;
+
+        bits = (uint32_t)pressed << ((EXPANDER_FIRST_BIT + 16 * n) % 8);
+        byte = (EXPANDER_FIRST_BIT + 16 * n) / 8;
+        for (i = 0; i < 3 && byte + i < BUTTON_ARRAY_SIZE; i++)
+        {
+            buttons[byte + i] |= bits;
+            bits >>= 8;
+        }
+    }
+}
+
+
+/* this function takes the latency of the changes that have made it into
+   the report just loaded */
+void
+simple_gamepad_expander_report_loaded(void)
+{
+    uint8_t n;
+    uint16_t now = TCNT3, latency;
+
+    for (n = 0; n < EXPANDER_COUNT; n++)
+    {
+        if (!(latencyMerged & (1 << n)))
+            continue;
+        latency = now - latencyStamp[n];
+        g_expanderInfo[n].last_latency = latency;
+        if (latency > g_expanderInfo[n].max_latency)
+            g_expanderInfo[n].max_latency = latency;
+        g_expanderInfo[n].changes++;
+    }
+    latencyPending &= ~latencyMerged;
+    latencyMerged = 0;
+
+    // read the tapped expanders again, for their release
+    if (tapMerged)
+    {
+        readPending |= tapMerged;
+        tapMerged = 0;
+        if (!twiBusy && twi_next_job())
+        {
+            twiBusy = 1;
+            TWCR = TWI_START;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,81 @@
+/* Teensy Simple Gamepad
+ * A Gamepad device with one 2-axis D-pad and 1 or more buttons
+ * Copyright (C) 2013 Robert Byam, robertbyam.com
+ *
+ * Derived from keyboard and serial examples for Teensy USB Development Board
+ * http://www.pjrc.com/teensy/usb_keyboard.html
+ * http://www.pjrc.com/teensy/usb_serial.html
+ * Copyright (c) 2008 PJRC.COM, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* ===========================================================================
+   This software implements a generic gamepad with one 2-axis (four direction)
+   D-Pad and 1 or more button.  The intended usage is that all of these files
+   remain constant, and only the file simple_gamepad_config.h is modified to
+   specify the configurable parameters for the gamepad
+
+   simple_gamepad_expander.h
+   This file declares the MCP23017 port expander inputs, read over I2C by the
+   TWI interrupt whenever the expanders signal a change.
+   ======================================================================== */
+
+#ifndef SIMPLE_GAMEPAD_EXPANDER_H
+#define SIMPLE_GAMEPAD_EXPANDER_H
+
+#include "simple_gamepad_defs.h"
+
+#if USE_EXPANDERS
+
+/* the pins taken by the I2C bus (D0 SCL, D1 SDA) and by the expanders'
+   interrupt line (E6, INT6), which are not read as buttons */
+#define EXPANDER_PIN_RESERVED(index, shift) \
+    (((index) == INDEX_D && (shift) <= 1) || ((index) == INDEX_E && (shift) == 6))
+
+/* Timer3 runs freely at F_CPU / 64 to time the expanders, 4 us per tick at
+   16 MHz */
+#define EXPANDER_TICKS_PER_MS   (F_CPU / 64 / 1000)
+
+/* instrumentation for each expander, times in Timer3 ticks from the edge of
+   the interrupt line to the report holding the change being loaded */
+typedef struct
+{
+    uint16_t last_latency;  // of the last change
+    uint16_t max_latency;   // largest seen
+    uint16_t changes;       // number of changes reported
+    uint16_t errors;        // transfers not acknowledged or lost
+} expander_info;
+
+extern volatile expander_info g_expanderInfo[EXPANDER_COUNT];
+
+/* this function starts the I2C bus, Timer3 and the interrupt line, after
+   the pins have been configured. The expanders are set up and read once by
+   the TWI interrupt as soon as interrupts are enabled */
+void simple_gamepad_expander_init(void);
+/* this function ORs the pressed expander buttons into the buttons array,
+   the first byte being the first byte of the report buttons */
+void simple_gamepad_expander_merge(uint8_t *buttons);
+/* called by usb_simple_gamepad_send, with interrupts disabled, once a
+   report has been loaded */
+void simple_gamepad_expander_report_loaded(void);
+
+#endif
+
+#endif /* SIMPLE_GAMEPAD_EXPANDER_H */
@@ -0,0 +1,350 @@
+/* Teensy Simple Gamepad
+ * A Gamepad device with one 2-axis D-pad and 1 or more buttons
+ * Copyright (C) 2013 Robert Byam, robertbyam.com
+ *
+ * Derived from keyboard and serial examples for Teensy USB Development Board
+ * http://www.pjrc.com/teensy/usb_keyboard.html
+ * http://www.pjrc.com/teensy/usb_serial.html
+ * Copyright (c) 2008 PJRC.COM, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* ===========================================================================
+   This software implements a generic gamepad with one 2-axis (four direction)
+   D-Pad and 1 or more button.  The intended usage is that all of these files
+   remain constant, and only the file simple_gamepad_config.h is modified to
+   specify the configurable parameters for the gamepad
+
+   simple_gamepad_feature.c
+   This file implements the feature report configuration channel. Requests
+   are received by the USB interrupt and carried out by the main loop, as
+   some of them write to EEPROM and take too long for an interrupt
+   ======================================================================== */
+
+#include "simple_gamepad_feature.h"
+#include "simple_gamepad_expander.h"
+#include "simple_gamepad_link.h"
+#include "simple_gamepad_blackbox.h"
+#include "simple_gamepad_phase.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <string.h>
+
+#if USE_FEATURE_REPORT
+
+volatile uint8_t g_featurePending;
+
+/* the request, which its result then replaces */
+static uint8_t featureReport[FEATURE_REPORT_SIZE];
+
+
+#if USE_STACK_MONITOR
+
+#define STACK_PAINT     0xC5
+
+/* the first byte after the static data, and the top of the stack */
+extern uint8_t _end;
+extern uint8_t __stack;
+
+/* this function fills the stack area with the paint, before anything is
+   on it. It runs in .init1, before the C runtime is set up, so it cannot
+   rely on anything the compiler expects (like r1 being zero) and must be
+   written in assembly */
+static void stack_paint(void) __attribute__((naked, used, section(".init1")));
+
+static void
+stack_paint(void)
+{
+    __asm__ volatile (
+        "    ldi r30, lo8(_end)\n"
+        "    ldi r31, hi8(_end)\n"
+        "    ldi r24, 0xC5\n"                 // STACK_PAINT
+        "    ldi r25, hi8(__stack)\n"
+        "    rjmp 2f\n"
+        "1:  st Z+, r24\n"
+        "2:  cpi r30, lo8(__stack)\n"
+        "    cpc r31, r25\n"
+        "    brlo 1b\n"
+        "    breq 1b\n");
+}
+
+
+/* this function returns the number of stack bytes ever used, counting the
+   paint still left from the bottom up */
+static uint16_t
+stack_used(void)
+{
+    const uint8_t *p = &_end;
+
+    while (p <= &__stack && *p == STACK_PAINT)
+        p++;
+    return (uint16_t)(&__stack - p + 1);
+}
+
+#endif
+
+
+/* this function reads a request from the FIFO, in the USB interrupt */
+void
+simple_gamepad_feature_receive(void)
+{
+    uint8_t i, n;
+
+    n = UEBCLX;
+    for (i = 0; i < FEATURE_REPORT_SIZE; i++)
+    {
+        featureReport[i] = (i < n) ? UEDATX : 0;
+    }
+    g_featurePending = 1;
+}
+
+
+/* this function writes the result to the FIFO, in the USB interrupt */
+void
+simple_gamepad_feature_send(uint8_t len)
+{
+    uint8_t i;
+
+    if (len > FEATURE_REPORT_SIZE)
+        len = FEATURE_REPORT_SIZE;
+    for (i = 0; i < len; i++)
+    {
+        // until carried out, the buffer still holds the request
+        if (i == 1 && g_featurePending)
+            UEDATX = FEATURE_BUSY;
+        else
+            UEDATX = featureReport[i];
+    }
+}
+
+
+/* this function clears the result, once the request has been read */
+static void
+feature_result_clear(void)
+{
+    uint8_t i;
+
+    for (i = 1; i < FEATURE_REPORT_SIZE; i++)
+    {
+        featureReport[i] = 0;
+    }
+}
+
+
+/* this function carries out the pending request, from the main loop */
+void
+simple_gamepad_feature_task(void)
+{
+    uint8_t status = FEATURE_UNKNOWN;
+#if USE_BUTTON_REMAP || HALL_BUTTON_COUNT > 0 || USE_BLACKBOX
+    uint8_t i;
+#endif
+#if USE_BUTTON_REMAP
+    uint8_t map[DIRECT_BUTTON_COUNT];
+    uint8_t first = featureReport[1];
+    uint8_t n = featureReport[2];
+#endif
+#if USE_STACK_MONITOR
+    uint16_t used, size;
+#endif
+#if USE_EXPANDERS
+    uint8_t expander = featureReport[1];
+    expander_info info;
+#endif
+#if USE_LINK_PRIMARY
+    uint8_t secondary = featureReport[1];
+    link_errors errors;
+#endif
+#if HALL_BUTTON_COUNT > 0
+    hall_info hall;
+    uint8_t travel[HALL_BUTTON_COUNT];
+    uint8_t pressed;
+#endif
+#if USE_BLACKBOX
+    uint8_t page = featureReport[1];
+    uint8_t freeze = featureReport[2];
+    uint16_t offset;
+#endif
+#if USE_POLL_PHASE_TRACKING
+    poll_phase_info phase;
+#endif
+
+    // each command takes everything it needs from the request before
+    // clearing it to write the result in its place
+    switch (featureReport[0])
+    {
+#if USE_BUTTON_REMAP
+    case FEATURE_REMAP_READ:
+        n = simple_gamepad_remap_read(map);
+        feature_result_clear();
+        featureReport[2] = n;
+        featureReport[3] = first;
+        for (i = 0; i < FEATURE_REMAP_PAGE && first + i < DIRECT_BUTTON_COUNT; i++)
+        {
+            featureReport[4 + i] = map[first + i];
+        }
+        status = FEATURE_OK;
+        break;
+    case FEATURE_REMAP_WRITE:
+        // the page replaces part of the current mapping, and the whole of
+        // it is then checked and stored
+        status = FEATURE_INVALID;
+        if (first > DIRECT_BUTTON_COUNT || n > DIRECT_BUTTON_COUNT - first ||
+            n > FEATURE_REPORT_SIZE - 3)
+        {
+            feature_result_clear();
+            break;
+        }
+        simple_gamepad_remap_read(map);
+        for (i = 0; i < n; i++)
+        {
+            map[first + i] = featureReport[3 + i];
+        }
+        feature_result_clear();
+        if (simple_gamepad_remap_write(map))
+            status = FEATURE_OK;
+        break;
+    case FEATURE_REMAP_RESET:
+        feature_result_clear();
+        simple_gamepad_remap_reset();
+        status = FEATURE_OK;
+        break;
+#endif
+#if USE_STACK_MONITOR
+    case FEATURE_STACK_READ:
+        used = stack_used();
+        size = (uint16_t)(&__stack - &_end + 1);
+        feature_result_clear();
+        featureReport[2] = used;
+        featureReport[3] = used >> 8;
+        featureReport[4] = size;
+        featureReport[5] = size >> 8;
+        status = FEATURE_OK;
+        break;
+#endif
+#if USE_EXPANDERS
+    case FEATURE_EXPANDER_READ:
+        feature_result_clear();
+        if (expander >= EXPANDER_COUNT)
+        {
+            status = FEATURE_INVALID;
+            break;
+        }
+        // the error count is updated by the TWI interrupt
+        cli();
+        info = g_expanderInfo[expander];
+        sei();
+        featureReport[2] = EXPANDER_COUNT;
+        featureReport[3] = expander;
+        memcpy(&featureReport[4], &info, sizeof(info));
+        status = FEATURE_OK;
+        break;
+#endif
+#if USE_LINK_PRIMARY
+    case FEATURE_LINK_READ:
+        feature_result_clear();
+        if (secondary >= LINK_SECONDARIES)
+        {
+            status = FEATURE_INVALID;
+            break;
+        }
+        // the UART error counts are updated by its interrupt
+        cli();
+        errors = g_linkErrors;
+        sei();
+        featureReport[2] = LINK_SECONDARIES;
+        featureReport[3] = secondary;
+        memcpy(&featureReport[4], &g_linkInfo[secondary], sizeof(link_info));
+        memcpy(&featureReport[4 + sizeof(link_info)], &errors, sizeof(errors));
+        status = FEATURE_OK;
+        break;
+#endif
+#if HALL_BUTTON_COUNT > 0
+    case FEATURE_HALL_READ:
+        feature_result_clear();
+        // all of it is updated by the ADC interrupt, at every sample
+        cli();
+        hall.rounds = g_hallInfo.rounds;
+        hall.last_latency = g_hallInfo.last_latency;
+        hall.max_latency = g_hallInfo.max_latency;
+        pressed = g_hallState;
+        for (i = 0; i < HALL_BUTTON_COUNT; i++)
+        {
+            travel[i] = g_hallTravel[i];
+        }
+        sei();
+        featureReport[2] = HALL_BUTTON_COUNT;
+        featureReport[3] = pressed;
+        memcpy(&featureReport[4], &hall, sizeof(hall));
+        memcpy(&featureReport[4 + sizeof(hall)], travel, sizeof(travel));
+        status = FEATURE_OK;
+        break;
+#endif
+#if USE_BLACKBOX
+    case FEATURE_BLACKBOX_READ:
+        feature_result_clear();
+        offset = (uint16_t)page * FEATURE_BLACKBOX_PAGE;
+        if (offset >= BLACKBOX_SIZE)
+        {
+            status = FEATURE_INVALID;
+            break;
+        }
+        // the ring is written by the main loop only, like this, so
+        // freezing it here leaves no entry half written
+        simple_gamepad_blackbox_freeze(freeze);
+        featureReport[2] = (uint8_t)BLACKBOX_SIZE;
+        featureReport[3] = BLACKBOX_SIZE >> 8;
+        featureReport[4] = g_blackboxHead;
+        featureReport[5] = BLACKBOX_PORT_COUNT;
+        featureReport[6] = BLACKBOX_SEGMENTS;
+        featureReport[7] = page;
+        for (i = 0; i < FEATURE_BLACKBOX_PAGE && offset + i < BLACKBOX_SIZE; i++)
+        {
+            featureReport[8 + i] = g_blackbox[offset + i];
+        }
+        status = FEATURE_OK;
+        break;
+#endif
+#if USE_POLL_PHASE_TRACKING
+    case FEATURE_PHASE_READ:
+        feature_result_clear();
+        // updated by the USB interrupts, at every frame and poll
+        cli();
+        memcpy(&phase, (const void *)&g_pollPhase, sizeof(phase));
+        sei();
+        featureReport[2] = POLL_INTERVAL_MS;
+        featureReport[3] = (uint8_t)PHASE_TICKS_PER_MS;
+        featureReport[4] = PHASE_TICKS_PER_MS >> 8;
+        featureReport[5] = (uint8_t)POLL_GUARD_US;
+        featureReport[6] = POLL_GUARD_US >> 8;
+        memcpy(&featureReport[7], &phase, sizeof(phase));
+        status = FEATURE_OK;
+        break;
+#endif
+    default:
+        feature_result_clear();
+        break;
+    }
+
+    featureReport[1] = status;
+    g_featurePending = 0;
+}
+
+#endif
@@ -0,0 +1,111 @@
+/* Teensy Simple Gamepad
+ * A Gamepad device with one 2-axis D-pad and 1 or more buttons
+ * Copyright (C) 2013 Robert Byam, robertbyam.com
+ *
+ * Derived from keyboard and serial examples for Teensy USB Development Board
+ * http://www.pjrc.com/teensy/usb_keyboard.html
+ * http://www.pjrc.com/teensy/usb_serial.html
+ * Copyright (c) 2008 PJRC.COM, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* ===========================================================================
+   This software implements a generic gamepad with one 2-axis (four direction)
+   D-Pad and 1 or more button.  The intended usage is that all of these files
+   remain constant, and only the file simple_gamepad_config.h is modified to
+   specify the configurable parameters for the gamepad
+
+   simple_gamepad_feature.h
+   This file declares the feature report configuration channel, through which
+   the host reads and changes the gamepad settings at run time
+   ======================================================================== */
+
+#ifndef SIMPLE_GAMEPAD_FEATURE_H
+#define SIMPLE_GAMEPAD_FEATURE_H
+
+#include "simple_gamepad_defs.h"
+
+#if USE_FEATURE_REPORT
+
+/* The host sends a request by setting the feature report, and reads the
+   result back by getting it. A request is { command, arguments... }, and
+   the result is { command, status, data... }. The status stays
+   FEATURE_BUSY until the main loop has carried out the request, and new
+   requests are refused (stalled) until then. */
+
+// commands. The remap bytes of the pin buttons are read and written a
+// page at a time, from the first one given, as they may not all fit
+#define FEATURE_REMAP_READ      0x01    // arguments: first
+                                        // data: count, first, remap bytes
+#define FEATURE_REMAP_WRITE     0x02    // arguments: first, n, remap bytes
+#define FEATURE_REMAP_RESET     0x03
+#define FEATURE_STACK_READ      0x04    // data: used, size (16 bits each,
+                                        // low byte first)
+#define FEATURE_EXPANDER_READ   0x05    // arguments: expander
+                                        // data: count, expander, then the
+                                        // expander_info fields (16 bits
+                                        // each, low byte first)
+#define FEATURE_LINK_READ       0x06    // arguments: secondary
+                                        // data: count, secondary, then the
+                                        // link_info and link_errors fields
+                                        // (16 bits each, low byte first)
+#define FEATURE_HALL_READ       0x07    // data: count, pressed bits, the
+                                        // hall_info fields (16 bits each,
+                                        // low byte first), then the travel
+                                        // of each switch
+#define FEATURE_BLACKBOX_READ   0x08    // arguments: page, freeze
+                                        // data: size (16 bits, low byte
+                                        // first), head, port count,
+                                        // segments, page, then the page of
+                                        // the ring. Recording stops while
+                                        // freeze is set, and resumes when
+                                        // it is not
+#define FEATURE_PHASE_READ      0x09    // data: poll interval (ms), Timer1
+                                        // ticks per ms, guard time (us),
+                                        // then the poll_phase_info fields
+                                        // (16 bits each but locked, low
+                                        // byte first)
+
+// remap bytes in one page
+#define FEATURE_REMAP_PAGE      (FEATURE_REPORT_SIZE - 4)
+// black-box ring bytes in one page
+#define FEATURE_BLACKBOX_PAGE   (FEATURE_REPORT_SIZE - 8)
+
+// status
+#define FEATURE_OK              0x00
+#define FEATURE_BUSY            0x01
+#define FEATURE_UNKNOWN         0x02    // command not supported
+#define FEATURE_INVALID         0x03    // arguments not valid
+
+/* set when a request has been received, cleared once carried out */
+extern volatile uint8_t g_featurePending;
+
+/* these functions are called by the USB interrupt, with endpoint 0
+   selected, to read a request from the FIFO and to write up to len bytes of
+   the result to it */
+void simple_gamepad_feature_receive(void);
+void simple_gamepad_feature_send(uint8_t len);
+
+/* this function carries out the pending request, from the main loop */
+void simple_gamepad_feature_task(void);
+
+#endif
+
+#endif /* SIMPLE_GAMEPAD_FEATURE_H */
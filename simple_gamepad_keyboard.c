@@ -0,0 +1,185 @@
+/* Teensy Simple Gamepad
+ * A Gamepad device with one 2-axis D-pad and 1 or more buttons
+ * Copyright (C) 2013 Robert Byam, robertbyam.com
+ *
+ * Derived from keyboard and serial examples for Teensy USB Development Board
+ * http://www.pjrc.com/teensy/usb_keyboard.html
+ * http://www.pjrc.com/teensy/usb_serial.html
+ * Copyright (c) 2008 PJRC.COM, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* ===========================================================================
+   This software implements a generic gamepad with one 2-axis (four direction)
+   D-Pad and 1 or more button.  The intended usage is that all of these files
+   remain constant, and only the file simple_gamepad_config.h is modified to
+   specify the configurable parameters for the gamepad
+
+   simple_gamepad_keyboard.c
+   This file implements the keyboard. Its report is made from the gamepad
+   state rather than from the pins, so it costs no read of its own and
+   both interfaces always agree: it is only remade when a sample changed
+   the gamepad state.
+   ======================================================================== */
+
+#include "simple_gamepad_keyboard.h"
+#include "simple_gamepad_usb.h"
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#if USE_KEYBOARD
+
+keyboard_state g_keyboardState;
+uint8_t g_keyboardPending;
+
+#if USE_FRESH_REPORTS
+/* the last two reports loaded, the newest first. A keyboard report is all
+   presses, so they are their own presses for usb_fresh_banks */
+static uint8_t loadedReports[2 * KEYBOARD_REPORT_SIZE];
+#endif
+
+/* the key of each D-pad direction, then of each button */
+static const uint8_t PROGMEM keyboard_keymap[4 + BUTTON_COUNT] =
+{
+    KEYBOARD_KEYMAP
+};
+
+// the D-pad directions, in keymap order
+#define DIR_UP      0x01
+#define DIR_DOWN    0x02
+#define DIR_LEFT    0x04
+#define DIR_RIGHT   0x08
+
+#if DPAD_MODE == DPAD_HAT
+/* the directions of each hat value, up then clockwise, and centered */
+static const uint8_t PROGMEM hat_directions[HAT_CENTER + 1] =
+{
+    DIR_UP, DIR_UP | DIR_RIGHT, DIR_RIGHT, DIR_DOWN | DIR_RIGHT,
+    DIR_DOWN, DIR_DOWN | DIR_LEFT, DIR_LEFT, DIR_UP | DIR_LEFT, 0
+};
+#endif
+
+
+/* this function adds a key to a report, usage 0 and keys out of the
+   report's range are left out */
+static inline void
+keyboard_key(keyboard_state *report, uint8_t key)
+{
+    if (key >= KEYBOARD_FIRST_MODIFIER && key <= KEYBOARD_LAST_MODIFIER)
+        report->modifiers |= 1 << (key - KEYBOARD_FIRST_MODIFIER);
+    else if (key && key <= KEYBOARD_LAST_KEY)
+        report->keys[key / 8] |= 1 << (key % 8);
+}
+
+
+/* this function makes the keyboard report from the gamepad state, after a
+   sample changed it, and marks it pending if it changed too */
+void
+simple_gamepad_keyboard_update(const gamepad_state *state)
+{
+    keyboard_state report;
+    uint8_t i, bit, directions;
+
+    memset(&report, 0, sizeof(report));
+
+    // the D-pad, as reported after SOCD
+#if DPAD_MODE == DPAD_AXES
+    directions = 0;
+    if (state->y_axis == Y_AXIS_UP)
+        directions |= DIR_UP;
+    else if (state->y_axis == Y_AXIS_DOWN)
+        directions |= DIR_DOWN;
+    if (state->x_axis == X_AXIS_LEFT)
+        directions |= DIR_LEFT;
+    else if (state->x_axis == X_AXIS_RIGHT)
+        directions |= DIR_RIGHT;
+#else
+    i = state->buttons[0] & 0x0F;
+    directions = pgm_read_byte(&hat_directions[i < HAT_CENTER ? i : HAT_CENTER]);
+#endif
+    for (i = 0; i < 4; i++)
+    {
+        if (directions & (1 << i))
+            keyboard_key(&report, pgm_read_byte(&keyboard_keymap[i]));
+    }
+
+    // the buttons, as reported after remapping, turbo and macros
+    for (i = 0; i < BUTTON_COUNT; i++)
+    {
+        bit = BUTTON_BIT_OFFSET + i;
+        if (state->buttons[bit / 8] & (1 << (bit % 8)))
+            keyboard_key(&report, pgm_read_byte(&keyboard_keymap[4 + i]));
+    }
+
+    if (memcmp(&report, &g_keyboardState, sizeof(report)))
+    {
+        g_keyboardState = report;
+        g_keyboardPending = 1;
+    }
+}
+
+
+/* this function loads the pending report into the keyboard endpoint, if it
+   has room. Otherwise it stays pending, for the next pass of the main loop.
+   It never waits for the host, so neither endpoint holds the other up: with
+   USE_FRESH_REPORTS, a bank kill is checked KILLBK_SPINS times at most, and
+   the report stays pending while it finishes */
+void
+usb_simple_gamepad_send_keyboard(void)
+{
+    const uint8_t *report = (const uint8_t *)&g_keyboardState;
+    uint8_t intr_state, i;
+
+    if (!usb_configuration || !g_keyboardPending)
+        return;
+
+    intr_state = SREG;
+    cli();
+    UENUM = KEYBOARD_ENDPOINT;
+#if USE_FRESH_REPORTS
+    // as for the gamepad, a newer report replaces the ones not collected,
+    // unless they hold a key this one has released
+    if (!usb_fresh_banks(loadedReports, report, KEYBOARD_REPORT_SIZE))
+    {
+        SREG = intr_state;
+        return;
+    }
+#endif
+    if (UEINTX & (1<<RWAL))
+    {
+        for (i = 0; i < KEYBOARD_REPORT_SIZE; i++)
+        {
+            UEDATX = report[i];
+        }
+        UEINTX = 0x3A;
+#if USE_FRESH_REPORTS
+        usb_fresh_loaded(loadedReports, report, KEYBOARD_REPORT_SIZE);
+#endif
+        g_keyboardPending = 0;
+    }
+    SREG = intr_state;
+}
+
+typedef char keyboard_report_size_check[
+        sizeof(keyboard_state) == KEYBOARD_REPORT_SIZE ? 1 : -1];
+
+#endif
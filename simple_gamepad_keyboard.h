@@ -0,0 +1,103 @@
+/* Teensy Simple Gamepad
+ * A Gamepad device with one 2-axis D-pad and 1 or more buttons
+ * Copyright (C) 2013 Robert Byam, robertbyam.com
+ *
+ * Derived from keyboard and serial examples for Teensy USB Development Board
+ * http://www.pjrc.com/teensy/usb_keyboard.html
+ * http://www.pjrc.com/teensy/usb_serial.html
+ * Copyright (c) 2008 PJRC.COM, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* ===========================================================================
+   This software implements a generic gamepad with one 2-axis (four direction)
+   D-Pad and 1 or more button.  The intended usage is that all of these files
+   remain constant, and only the file simple_gamepad_config.h is modified to
+   specify the configurable parameters for the gamepad
+
+   simple_gamepad_keyboard.h
+   This file declares the keyboard, a second HID interface whose report is
+   made from the gamepad state through KEYBOARD_KEYMAP (see USE_KEYBOARD).
+   ======================================================================== */
+
+#ifndef SIMPLE_GAMEPAD_KEYBOARD_H
+#define SIMPLE_GAMEPAD_KEYBOARD_H
+
+#include "simple_gamepad_defs.h"
+
+#if USE_KEYBOARD
+
+#define KEYBOARD_INTERFACE  1
+#define KEYBOARD_ENDPOINT   2
+
+/* the keys of the bitmap, from usage 0 (no key) to KEYBOARD_LAST_KEY, and
+   the modifiers, which have a byte of their own */
+#define KEYBOARD_LAST_KEY       0x77
+#define KEYBOARD_FIRST_MODIFIER 0xE0
+#define KEYBOARD_LAST_MODIFIER  0xE7
+
+/* the report size in bytes, the report is the keyboard_state byte for byte */
+#define KEYBOARD_REPORT_SIZE    (1 + (KEYBOARD_LAST_KEY + 1) / 8)
+
+typedef struct
+{
+    /* left Ctrl, Shift, Alt, GUI, then the same on the right, a bit each */
+    uint8_t modifiers;
+    /* one bit for each key, bit n % 8 of byte n / 8 for usage n */
+    uint8_t keys[(KEYBOARD_LAST_KEY + 1) / 8];
+} keyboard_state;
+
+extern keyboard_state g_keyboardState;
+/* set when the report has changed and is not loaded in the endpoint yet */
+extern uint8_t g_keyboardPending;
+
+/* define the HID report: a bitmap of every key, so any number of keys can
+   be held at once, whatever the host's boot protocol limits */
+static const uint8_t PROGMEM keyboard_hid_report_desc[] = {
+    0x05, 0x01,         // USAGE_PAGE (Generic Desktop)
+    0x09, 0x06,         // USAGE (Keyboard)
+    0xa1, 0x01,         // COLLECTION (Application)
+    0x05, 0x07,         //   USAGE_PAGE (Keyboard)
+    0x19, KEYBOARD_FIRST_MODIFIER, // USAGE_MINIMUM (Left Control)
+    0x29, KEYBOARD_LAST_MODIFIER,  // USAGE_MAXIMUM (Right GUI)
+    0x15, 0x00,         //   LOGICAL_MINIMUM (0)
+    0x25, 0x01,         //   LOGICAL_MAXIMUM (1)
+    0x75, 0x01,         //   REPORT_SIZE (1)
+    0x95, 0x08,         //   REPORT_COUNT (8)
+    0x81, 0x02,         //   INPUT (Data,Var,Abs)
+    0x19, 0x00,         //   USAGE_MINIMUM (No Event)
+    0x29, KEYBOARD_LAST_KEY, //   USAGE_MAXIMUM (Last Key)
+    0x95, KEYBOARD_LAST_KEY + 1, // REPORT_COUNT (Number of Keys)
+    0x81, 0x02,         //   INPUT (Data,Var,Abs)
+    0xc0                // END_COLLECTION
+};
+
+/* this function makes the keyboard report from the gamepad state, after a
+   sample changed it, and marks it pending if it changed too */
+void simple_gamepad_keyboard_update(const gamepad_state *state);
+
+/* this function loads the pending report into the keyboard endpoint, if it
+   has room. It is called at every pass of the main loop, whatever the
+   gamepad endpoint's state, and never waits */
+void usb_simple_gamepad_send_keyboard(void);
+
+#endif
+
+#endif /* SIMPLE_GAMEPAD_KEYBOARD_H */
@@ -0,0 +1,386 @@
+/* Teensy Simple Gamepad
+ * A Gamepad device with one 2-axis D-pad and 1 or more buttons
+ * Copyright (C) 2013 Robert Byam, robertbyam.com
+ *
+ * Derived from keyboard and serial examples for Teensy USB Development Board
+ * http://www.pjrc.com/teensy/usb_keyboard.html
+ * http://www.pjrc.com/teensy/usb_serial.html
+ * Copyright (c) 2008 PJRC.COM, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* ===========================================================================
+   This software implements a generic gamepad with one 2-axis (four direction)
+   D-Pad and 1 or more button.  The intended usage is that all of these files
+   remain constant, and only the file simple_gamepad_config.h is modified to
+   specify the configurable parameters for the gamepad
+
+   simple_gamepad_link.c
+   This file implements the link between boards. On the primary, the UART
+   receive interrupt only stores each byte in a ring buffer, and the main
+   loop takes the frames from it at every sample, before polling again. A
+   secondary does nothing but wait for the poll, sample and answer.
+   ======================================================================== */
+
+#include "simple_gamepad_link.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/crc16.h>
+#include <util/delay.h>
+
+#if LINK_MODE != LINK_NONE
+
+/* the baud rate register, the UART running at double speed (U2X1) */
+#define LINK_UBRR       ((F_CPU / 8 + LINK_BAUD / 2) / LINK_BAUD - 1)
+
+/* 8 data bits, no parity, 1 stop bit */
+#define LINK_UCSRC      ((1<<UCSZ11) | (1<<UCSZ10))
+
+
+#if USE_LINK_PRIMARY
+
+#if USE_IDLE_SLEEP && IDLE_CLOCK_PRESCALE
+#error LINK_PRIMARY needs IDLE_CLOCK_PRESCALE set to 0
+#endif
+
+/* the receive buffer holds more than a whole round of answers, and is only
+   emptied at each sample */
+#define LINK_RING_SIZE  128
+#define LINK_RING_MASK  (LINK_RING_SIZE - 1)
+#if LINK_SECONDARIES * LINK_FRAME_SIZE >= LINK_RING_SIZE
+#error the secondaries frames do not fit the link receive buffer
+#endif
+
+/* Timer3 ticks from a poll to the last answer being in */
+#define LINK_ROUND_TICKS    ((uint16_t)((LINK_ROUND_US * (F_CPU / 64 / 1000) + 999) / 1000))
+
+/* a secondary that has not answered this many polls in a row is taken to
+   be gone, and its buttons released */
+#define LINK_TIMEOUT_POLLS  50
+
+/* the mask of the last button byte of a frame */
+#define LINK_LAST_MASK  ((uint8_t)(0xFF >> (8 * LINK_FRAME_BYTES - LINK_BUTTON_COUNT)))
+
+link_info g_linkInfo[LINK_SECONDARIES];
+volatile link_errors g_linkErrors;
+
+/* the receive buffer, written by the interrupt at head and read by the
+   main loop at tail */
+static uint8_t rxRing[LINK_RING_SIZE];
+static volatile uint8_t rxHead;
+static uint8_t rxTail;
+
+/* the frame being received: the number of bytes of it so far (0 while
+   looking for LINK_SYNC), its address, buttons and CRC */
+static uint8_t frameCount;
+static uint8_t frameAddress;
+static uint8_t frameButtons[LINK_FRAME_BYTES];
+static uint8_t frameCrc;
+
+/* the buttons of each secondary */
+static uint8_t linkButtons[LINK_SECONDARIES][LINK_FRAME_BYTES];
+
+/* the last poll: whether one was sent, when, which secondaries have
+   answered it, and for how many polls in a row each has not */
+static uint8_t polled;
+static uint16_t pollStamp;
+static uint8_t answered;
+static uint8_t silentPolls[LINK_SECONDARIES];
+
+/* the secondaries whose buttons changed, and the poll they were sampled on.
+   Their latency is taken when a report holding the change (merged) is
+   loaded */
+static uint8_t latencyPending;
+static uint8_t latencyMerged;
+static uint16_t latencyStamp[LINK_SECONDARIES];
+
+
+ISR(USART1_RX_vect)
+{
+    uint8_t status = UCSR1A;
+    uint8_t c = UDR1;
+    uint8_t next = (rxHead + 1) & LINK_RING_MASK;
+
+    // a bad byte is still stored, the CRC of its frame then fails
+    if (status & ((1<<FE1) | (1<<DOR1)))
+        g_linkErrors.uart++;
+    if (next == rxTail)
+    {
+        g_linkErrors.overflow++;
+        return;
+    }
+    rxRing[rxHead] = c;
+    rxHead = next;
+}
+
+
+/* this function stores the frame just received */
+static void
+link_frame_done(void)
+{
+    uint8_t i, changed = 0;
+    uint8_t *stored = linkButtons[frameAddress];
+
+    frameButtons[LINK_FRAME_BYTES - 1] &= LINK_LAST_MASK;
+    for (i = 0; i < LINK_FRAME_BYTES; i++)
+    {
+        changed |= stored[i] ^ frameButtons[i];
+        stored[i] = frameButtons[i];
+    }
+    if (changed && !(latencyPending & (1 << frameAddress)))
+    {
+        latencyStamp[frameAddress] = pollStamp;
+        latencyPending |= 1 << frameAddress;
+    }
+    answered |= 1 << frameAddress;
+    g_linkInfo[frameAddress].frames++;
+}
+
+
+/* this function takes the next byte received, a frame at a time */
+static void
+link_receive(uint8_t c)
+{
+    if (frameCount == 0)
+    {
+        // anything but the start of a frame is skipped
+        if (c == LINK_SYNC)
+            frameCount = 1;
+        return;
+    }
+    if (frameCount == 1)
+    {
+        if (c >= LINK_SECONDARIES)
+        {
+            // not a frame after all, unless this starts one
+            frameCount = (c == LINK_SYNC);
+            return;
+        }
+        frameAddress = c;
+        frameCrc = _crc8_ccitt_update(0, c);
+    }
+    else if (frameCount < LINK_FRAME_SIZE - 1)
+    {
+        frameButtons[frameCount - 2] = c;
+        frameCrc = _crc8_ccitt_update(frameCrc, c);
+    }
+    else
+    {
+        if (c == frameCrc)
+            link_frame_done();
+        else
+            g_linkErrors.crc++;
+        frameCount = 0;
+        return;
+    }
+    frameCount++;
+}
+
+
+/* this function counts the secondaries that have not answered the last
+   poll, and releases the buttons of those gone for too long */
+static void
+link_round_done(void)
+{
+    uint8_t n, i;
+
+    for (n = 0; n < LINK_SECONDARIES; n++)
+    {
+        if (answered & (1 << n))
+        {
+            silentPolls[n] = 0;
+            continue;
+        }
+        g_linkInfo[n].missed++;
+        if (silentPolls[n] < LINK_TIMEOUT_POLLS && ++silentPolls[n] == LINK_TIMEOUT_POLLS)
+        {
+            for (i = 0; i < LINK_FRAME_BYTES; i++)
+            {
+                linkButtons[n][i] = 0;
+            }
+        }
+    }
+    answered = 0;
+}
+
+
+/* this function takes the frames received, ORs the buttons of every
+   secondary into the buttons array and polls again once due */
+void
+simple_gamepad_link_merge(uint8_t *buttons)
+{
+    uint8_t n, i, bit;
+    // everything received before now is in the buffer
+    uint16_t now = TCNT3;
+
+    while (rxTail != rxHead)
+    {
+        link_receive(rxRing[rxTail]);
+        rxTail = (rxTail + 1) & LINK_RING_MASK;
+    }
+
+    // every secondary has had its slot, so poll again for a new sample.
+    // Sampling more often than that (after an input edge) only merges the
+    // last answers again
+    if ((uint16_t)(now - pollStamp) >= LINK_ROUND_TICKS || !polled)
+    {
+        if (polled)
+            link_round_done();
+        // a frame cut short by a missing secondary is given up
+        frameCount = 0;
+        UDR1 = LINK_POLL;
+        pollStamp = now;
+        polled = 1;
+    }
+
+    bit = LINK_FIRST_BIT;
+    for (n = 0; n < LINK_SECONDARIES; n++)
+    {
+        latencyMerged |= latencyPending & (1 << n);
+        for (i = 0; i < LINK_FRAME_BYTES; i++)
+        {
+            buttons[bit / 8] |= linkButtons[n][i] << (bit % 8);
+            buttons[bit / 8 + 1] |= linkButtons[n][i] >> (8 - bit % 8);
+            bit += (i < LINK_FRAME_BYTES - 1) ? 8 : LINK_BUTTON_COUNT - 8 * i;
+        }
+    }
+}
+
+
+/* this function takes the latency of the changes that have made it into
+   the report just loaded */
+void
+simple_gamepad_link_report_loaded(void)
+{
+    uint8_t n;
+    uint16_t now = TCNT3, latency;
+
+    for (n = 0; n < LINK_SECONDARIES; n++)
+    {
+        if (!(latencyMerged & (1 << n)))
+            continue;
+        latency = now - latencyStamp[n];
+        g_linkInfo[n].last_latency = latency;
+        if (latency > g_linkInfo[n].max_latency)
+            g_linkInfo[n].max_latency = latency;
+    }
+    latencyPending &= ~latencyMerged;
+    latencyMerged = 0;
+}
+
+#else
+
+/* this function waits for the primary's poll */
+void
+simple_gamepad_link_wait_poll(void)
+{
+    for (;;)
+    {
+        while (!(UCSR1A & (1<<RXC1)))
+            ;
+        if (UDR1 == LINK_POLL)
+            return;
+    }
+}
+
+
+/* this function sends the frame, in the slot of LINK_ADDRESS */
+static void
+link_send(const uint8_t *frame)
+{
+    uint8_t i;
+
+    for (i = 0; i < LINK_ADDRESS; i++)
+    {
+        _delay_us(LINK_SLOT_US);
+    }
+
+    // drive TX only for the frame, writing TXC1 clears it
+    UCSR1A = (1<<TXC1) | (1<<U2X1);
+    UCSR1B = (1<<RXEN1) | (1<<TXEN1);
+    for (i = 0; i < LINK_FRAME_SIZE; i++)
+    {
+        while (!(UCSR1A & (1<<UDRE1)))
+            ;
+        UDR1 = frame[i];
+    }
+    while (!(UCSR1A & (1<<TXC1)))
+        ;
+    UCSR1B = (1<<RXEN1);
+}
+
+
+/* this function answers the poll with the buttons just read */
+void
+simple_gamepad_link_reply(void)
+{
+    uint8_t frame[LINK_FRAME_SIZE];
+    uint8_t i, byte, crc;
+    uint16_t bits;
+
+    frame[0] = LINK_SYNC;
+    frame[1] = LINK_ADDRESS;
+    crc = _crc8_ccitt_update(0, LINK_ADDRESS);
+    for (i = 0; i < LINK_FRAME_BYTES; i++)
+    {
+        // the report buttons start after the hat, when there is one
+        byte = (BUTTON_BIT_OFFSET + 8 * i) / 8;
+        bits = 0;
+        if (byte < BUTTON_ARRAY_SIZE)
+            bits = g_gamepadState.buttons[byte];
+        if (byte + 1 < BUTTON_ARRAY_SIZE)
+            bits |= g_gamepadState.buttons[byte + 1] << 8;
+        bits >>= BUTTON_BIT_OFFSET % 8;
+        if (8 * i + 8 > LINK_BUTTON_COUNT)
+            bits &= 0xFF >> (8 * i + 8 - LINK_BUTTON_COUNT);
+        frame[2 + i] = bits;
+        crc = _crc8_ccitt_update(crc, bits);
+    }
+    frame[LINK_FRAME_SIZE - 1] = crc;
+    link_send(frame);
+}
+
+#endif
+
+
+/* this function sets up the UART, and on the primary Timer3 */
+void
+simple_gamepad_link_init(void)
+{
+    UBRR1 = LINK_UBRR;
+    UCSR1A = (1<<U2X1);
+    UCSR1C = LINK_UCSRC;
+#if USE_LINK_PRIMARY
+    // RX has a pull-up, as the secondaries only drive it in their slots
+    DDRD &= ~(1<<2);
+    PORTD |= (1<<2);
+    TCCR3A = 0;
+    TCCR3B = (1<<CS31) | (1<<CS30);         // free running, F_CPU / 64
+    UCSR1B = (1<<RXCIE1) | (1<<RXEN1) | (1<<TXEN1);
+#else
+    // TX is left floating when not sending, so the other secondaries can
+    // drive the line the TXs share
+    DDRD &= ~((1<<3) | (1<<2));
+    PORTD = (PORTD & ~(1<<3)) | (1<<2);
+    UCSR1B = (1<<RXEN1);
+#endif
+}
+
+#endif
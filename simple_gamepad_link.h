@@ -0,0 +1,126 @@
+/* Teensy Simple Gamepad
+ * A Gamepad device with one 2-axis D-pad and 1 or more buttons
+ * Copyright (C) 2013 Robert Byam, robertbyam.com
+ *
+ * Derived from keyboard and serial examples for Teensy USB Development Board
+ * http://www.pjrc.com/teensy/usb_keyboard.html
+ * http://www.pjrc.com/teensy/usb_serial.html
+ * Copyright (c) 2008 PJRC.COM, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* ===========================================================================
+   This software implements a generic gamepad with one 2-axis (four direction)
+   D-Pad and 1 or more button.  The intended usage is that all of these files
+   remain constant, and only the file simple_gamepad_config.h is modified to
+   specify the configurable parameters for the gamepad
+
+   simple_gamepad_link.h
+   This file declares the link between a primary board, on USB, and the
+   secondary boards whose buttons it adds to its own, over their UARTs.
+   ======================================================================== */
+
+#ifndef SIMPLE_GAMEPAD_LINK_H
+#define SIMPLE_GAMEPAD_LINK_H
+
+#include "simple_gamepad_defs.h"
+
+#if LINK_MODE != LINK_NONE
+
+/* The primary sends LINK_POLL to every secondary at once. Each answers with
+   a frame, in its own slot after the poll:
+
+     LINK_SYNC, address, LINK_FRAME_BYTES of buttons, CRC
+
+   the buttons being the secondary's first LINK_BUTTON_COUNT, button 1 in
+   bit 0 of the first byte, and the CRC the CRC-8 (polynomial 0x07) of the
+   address and the buttons. 8 data bits, no parity, 1 stop bit */
+#define LINK_POLL           0x5A
+#define LINK_SYNC           0xA5
+#define LINK_FRAME_BYTES    ((LINK_BUTTON_COUNT + 7) / 8)
+#define LINK_FRAME_SIZE     (LINK_FRAME_BYTES + 3)
+
+/* a secondary's slot is its frame plus a guard time for its TX to be
+   released before the next one drives the line, in us */
+#define LINK_GUARD_US       20
+#define LINK_BYTE_US(n)     (((n) * 10000000UL + LINK_BAUD - 1) / LINK_BAUD)
+#define LINK_SLOT_US        (LINK_BYTE_US(LINK_FRAME_SIZE) + LINK_GUARD_US)
+#define LINK_ROUND_US       (LINK_BYTE_US(1) + LINK_SECONDARIES * LINK_SLOT_US)
+#if LINK_ROUND_US > 900
+#error the secondaries slots must fit in 1 ms: fewer LINK_SECONDARIES or LINK_BUTTON_COUNT, or a higher LINK_BAUD
+#endif
+
+/* the pins of the UART, RX on D2 and TX on D3, which are not read as
+   buttons */
+#define LINK_PIN_RESERVED(index, shift) \
+    ((index) == INDEX_D && ((shift) == 2 || (shift) == 3))
+
+/* Timer3 runs freely at F_CPU / 64, as for the expanders, to time the
+   link: 4 us per tick at 16 MHz */
+#define LINK_TICKS_PER_MS   (F_CPU / 64 / 1000)
+
+/* this function sets up the UART, and on the primary Timer3, after the
+   pins have been configured */
+void simple_gamepad_link_init(void);
+
+#if USE_LINK_PRIMARY
+
+/* instrumentation for each secondary, times in Timer3 ticks from the poll
+   its buttons were sampled on to the report holding them being loaded */
+typedef struct
+{
+    uint16_t last_latency;  // of the last frame
+    uint16_t max_latency;   // largest seen
+    uint16_t frames;        // number of frames received
+    uint16_t missed;        // polls not answered with a good frame
+} link_info;
+
+/* errors of the link, which cannot be told apart by secondary */
+typedef struct
+{
+    uint16_t crc;           // frames with a bad CRC
+    uint16_t uart;          // bytes with a framing error or overrun
+    uint16_t overflow;      // bytes lost to a full receive buffer
+} link_errors;
+
+extern link_info g_linkInfo[LINK_SECONDARIES];
+extern volatile link_errors g_linkErrors;
+
+/* this function takes the frames received since the last call, ORs the
+   buttons of every secondary into the buttons array (the first byte being
+   the first byte of the report buttons) and polls the secondaries again
+   once their last answers are due */
+void simple_gamepad_link_merge(uint8_t *buttons);
+/* called by usb_simple_gamepad_send, with interrupts disabled, once a
+   report has been loaded */
+void simple_gamepad_link_report_loaded(void);
+
+#else
+
+/* these functions wait for the primary's poll, and answer it with the
+   buttons just read */
+void simple_gamepad_link_wait_poll(void);
+void simple_gamepad_link_reply(void);
+
+#endif
+
+#endif
+
+#endif /* SIMPLE_GAMEPAD_LINK_H */
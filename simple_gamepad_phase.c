@@ -0,0 +1,227 @@
+/* Teensy Simple Gamepad
+ * A Gamepad device with one 2-axis D-pad and 1 or more buttons
+ * Copyright (C) 2013 Robert Byam, robertbyam.com
+ *
+ * Derived from keyboard and serial examples for Teensy USB Development Board
+ * http://www.pjrc.com/teensy/usb_keyboard.html
+ * http://www.pjrc.com/teensy/usb_serial.html
+ * Copyright (c) 2008 PJRC.COM, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* ===========================================================================
+   This software implements a generic gamepad with one 2-axis (four direction)
+   D-Pad and 1 or more button.  The intended usage is that all of these files
+   remain constant, and only the file simple_gamepad_config.h is modified to
+   specify the configurable parameters for the gamepad
+
+   simple_gamepad_phase.c
+   This file contains the host poll phase tracker. With a poll interval above
+   1 ms the host collects reports only in every Nth frame, always at about
+   the same time within that frame. Every poll that finds no report waiting
+   is answered with a NAK, which raises NAKINI on the endpoint: timing those
+   against the start-of-frame gives both the frame and the time within it,
+   and the main loop then samples the inputs a guard time before the next
+   expected poll.
+   ======================================================================== */
+
+#include "simple_gamepad_phase.h"
+#include "simple_gamepad_usb.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#if USE_POLL_PHASE_TRACKING
+
+#if USE_IDLE_SLEEP && IDLE_CLOCK_PRESCALE
+#error USE_POLL_PHASE_TRACKING needs IDLE_CLOCK_PRESCALE set to 0
+#endif
+
+#if POLL_GUARD_US >= POLL_INTERVAL_MS * 1000L
+#error POLL_GUARD_US must be shorter than the poll interval
+#endif
+
+#define GUARD_TICKS ((uint16_t)((uint32_t)POLL_GUARD_US * PHASE_TICKS_PER_MS / 1000))
+
+volatile poll_phase_info g_pollPhase;
+
+// Timer1 at the latest and the previous start-of-frame
+static volatile uint16_t sofStamp;
+static volatile uint16_t prevSofStamp;
+// frames until the next expected poll, 0 during the poll frame
+static volatile uint8_t framesToPoll;
+// a report has been loaded and not yet seen leaving the endpoint
+static volatile uint8_t reportPending;
+// Timer1 when the pending report was sampled and loaded
+static volatile uint16_t loadStamp;
+// start-of-frames seen (low byte), and their count when the main loop last
+// sampled
+static volatile uint8_t sofCount;
+static uint8_t sampledSof;
+
+
+/* this function starts Timer1, call it before usb_init */
+void
+poll_phase_init(void)
+{
+    TCCR1A = 0;
+    TCCR1B = (1<<CS11) | (1<<CS10);     // free running, F_CPU / 64
+    TIMSK1 = 0;
+    set_sleep_mode(SLEEP_MODE_IDLE);
+}
+
+// the compare match only wakes the main loop out of sleep
+EMPTY_INTERRUPT(TIMER1_COMPA_vect);
+
+
+/* this function sleeps until the next interrupt. It is called with
+   interrupts disabled, and returns with them disabled again */
+static inline void
+phase_sleep(void)
+{
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    sleep_disable();
+    cli();
+}
+
+
+/* this function sleeps until the guard time before the next expected poll */
+void
+poll_phase_wait(void)
+{
+    uint8_t framesBefore = 0;
+    uint16_t offset;
+
+    cli();
+
+    // the inputs are sampled once per poll: once the sampling time has
+    // passed, the next one is looked for from the next frame on
+    while (sofCount == sampledSof)
+    {
+        phase_sleep();
+    }
+
+    // work out the frame, counted back from the poll frame, and the time
+    // within it at which to sample
+    offset = g_pollPhase.poll_offset;
+    while (offset < GUARD_TICKS)
+    {
+        offset += PHASE_TICKS_PER_MS;
+        framesBefore++;
+    }
+    offset -= GUARD_TICKS;
+
+    // sleep through the start-of-frame interrupts up to that frame
+    while (framesToPoll != framesBefore)
+    {
+        phase_sleep();
+    }
+
+    // then let the Timer1 compare match wake us at that time
+    OCR1A = sofStamp + offset;
+    TIFR1 = (1<<OCF1A);
+    TIMSK1 = (1<<OCIE1A);
+    while ((uint16_t)(TCNT1 - sofStamp) < offset && framesToPoll == framesBefore)
+    {
+        phase_sleep();
+    }
+    TIMSK1 = 0;
+    sampledSof = sofCount;
+
+    sei();
+}
+
+
+/* called by usb_simple_gamepad_send, with interrupts disabled, once a report
+   has been loaded. Sampling and loading happen back to back, so this is
+   also the time the inputs were sampled */
+void
+poll_phase_report_loaded(void)
+{
+    loadStamp = TCNT1;
+    reportPending = 1;
+}
+
+
+/* called from the USB general interrupt on each start-of-frame */
+void
+poll_phase_sof(void)
+{
+    uint8_t prevEndpoint;
+    int16_t age;
+
+    prevSofStamp = sofStamp;
+    sofStamp = TCNT1;
+    sofCount++;
+
+    // keep predicting the poll even when it is not seen, as happens when
+    // the host finds a report waiting and there is no NAK
+    if (framesToPoll)
+        framesToPoll--;
+    else
+        framesToPoll = POLL_INTERVAL_MS - 1;
+
+    if (!reportPending)
+        return;
+
+    // once the endpoint banks are empty the host has collected the report,
+    // during the previous frame at about the learned poll time
+    prevEndpoint = UENUM;
+    UENUM = GAMEPAD_ENDPOINT;
+    if (!(UESTA0X & ((1<<NBUSYBK1) | (1<<NBUSYBK0))))
+    {
+        reportPending = 0;
+        age = (int16_t)(prevSofStamp + g_pollPhase.poll_offset - loadStamp);
+        if (age < 0)
+            age = 0;
+        g_pollPhase.last_age = age;
+        if ((uint16_t)age > g_pollPhase.max_age)
+            g_pollPhase.max_age = age;
+        g_pollPhase.collected++;
+    }
+    UENUM = prevEndpoint;
+}
+
+
+/* called from the USB endpoint interrupt each time the host polled the
+   gamepad endpoint and was answered with a NAK */
+void
+poll_phase_in_token(void)
+{
+    uint16_t offset = TCNT1 - sofStamp;
+
+    if (offset >= PHASE_TICKS_PER_MS)
+        offset = PHASE_TICKS_PER_MS - 1;
+
+    // follow an earlier poll at once, and a later one slowly, so a single
+    // late poll does not make the next sample miss an early one
+    if (!g_pollPhase.locked || offset < g_pollPhase.poll_offset)
+        g_pollPhase.poll_offset = offset;
+    else
+        g_pollPhase.poll_offset += (offset - g_pollPhase.poll_offset) / 8;
+    g_pollPhase.locked = 1;
+
+    // this is the poll frame, the next one is a full interval away
+    framesToPoll = POLL_INTERVAL_MS;
+}
+
+#endif /* USE_POLL_PHASE_TRACKING */
@@ -0,0 +1,77 @@
+/* Teensy Simple Gamepad
+ * A Gamepad device with one 2-axis D-pad and 1 or more buttons
+ * Copyright (C) 2013 Robert Byam, robertbyam.com
+ *
+ * Derived from keyboard and serial examples for Teensy USB Development Board
+ * http://www.pjrc.com/teensy/usb_keyboard.html
+ * http://www.pjrc.com/teensy/usb_serial.html
+ * Copyright (c) 2008 PJRC.COM, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* ===========================================================================
+   This software implements a generic gamepad with one 2-axis (four direction)
+   D-Pad and 1 or more button.  The intended usage is that all of these files
+   remain constant, and only the file simple_gamepad_config.h is modified to
+   specify the configurable parameters for the gamepad
+
+   simple_gamepad_phase.h
+   This file declares the host poll phase tracker, which learns when the host
+   polls the gamepad endpoint and schedules sampling just before each poll.
+   ======================================================================== */
+
+#ifndef SIMPLE_GAMEPAD_PHASE_H
+#define SIMPLE_GAMEPAD_PHASE_H
+
+#include "simple_gamepad_defs.h"
+
+#if USE_POLL_PHASE_TRACKING
+
+/* Timer1 runs freely at F_CPU / 64 as the clock for all phase measurements,
+   4 us per tick at 16 MHz */
+#define PHASE_TICKS_PER_MS  (F_CPU / 64 / 1000)
+
+/* instrumentation, all times in Timer1 ticks */
+typedef struct
+{
+    uint8_t locked;         // non-zero once a host poll has been seen
+    uint16_t poll_offset;   // learned time of the host poll after start-of-frame
+    uint16_t last_age;      // sample age when the last report was collected
+    uint16_t max_age;       // largest sample age seen
+    uint16_t collected;     // number of reports collected by the host
+} poll_phase_info;
+
+extern volatile poll_phase_info g_pollPhase;
+
+/* this function starts Timer1, call it before usb_init */
+void poll_phase_init(void);
+/* this function sleeps until the guard time before the next expected poll */
+void poll_phase_wait(void);
+/* called by usb_simple_gamepad_send once a report has been loaded */
+void poll_phase_report_loaded(void);
+
+/* called from the USB interrupts on each start-of-frame, and each time the
+   host polls the gamepad endpoint while it has nothing to send (NAK) */
+void poll_phase_sof(void);
+void poll_phase_in_token(void);
+
+#endif
+
+#endif /* SIMPLE_GAMEPAD_PHASE_H */
@@ -0,0 +1,254 @@
+/* Teensy Simple Gamepad
+ * A Gamepad device with one 2-axis D-pad and 1 or more buttons
+ * Copyright (C) 2013 Robert Byam, robertbyam.com
+ *
+ * Derived from keyboard and serial examples for Teensy USB Development Board
+ * http://www.pjrc.com/teensy/usb_keyboard.html
+ * http://www.pjrc.com/teensy/usb_serial.html
+ * Copyright (c) 2008 PJRC.COM, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* ===========================================================================
+   This software implements a generic gamepad with one 2-axis (four direction)
+   D-Pad and 1 or more button.  The intended usage is that all of these files
+   remain constant, and only the file simple_gamepad_config.h is modified to
+   specify the configurable parameters for the gamepad
+
+   simple_gamepad_sources.c
+   This file holds the state of the input sources that is not only used by
+   their hooks in simple_gamepad_sources.h, and the ADC interrupt. It does
+   not include that file, which needs the port numbers of
+   simple_gamepad_defs.c, so its declarations there must be kept the same.
+   ======================================================================== */
+
+#include "simple_gamepad_defs.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#if ADC_AXES > 0 || HALL_BUTTON_COUNT > 0
+
+/* the analog inputs: the axes, then the Hall-effect switches */
+#define ADC_INPUTS      (ADC_AXES + HALL_BUTTON_COUNT)
+
+#if ADC_AXES > 0
+/* the channels of the axes, in order */
+const uint8_t PROGMEM g_adcChannels[] = { ADC_AXIS_CHANNELS };
+typedef char adc_channels_check[sizeof(g_adcChannels) >= ADC_AXES ? 1 : -1];
+
+/* the last value of each axis, 0 to 255 */
+volatile uint8_t g_adcValues[ADC_AXES];
+#endif
+
+#if HALL_BUTTON_COUNT > 0
+/* the channels of the switches, in order */
+const uint8_t PROGMEM g_hallChannels[] = { HALL_CHANNELS };
+typedef char hall_channels_check[sizeof(g_hallChannels) >= HALL_BUTTON_COUNT ? 1 : -1];
+
+volatile hall_info g_hallInfo;
+volatile uint8_t g_hallState;
+volatile uint8_t g_hallTravel[HALL_BUTTON_COUNT];
+
+/* the switches pressed since the last report was loaded, so a press
+   shorter than a sample of the gamepad is still reported */
+volatile uint8_t g_hallPressed;
+
+/* the round of the first decision not yet read by a sample, and of the
+   first one read by a sample but not yet in a loaded report, when set */
+volatile uint8_t g_hallDecided;
+volatile uint16_t g_hallDecidedRound;
+uint8_t g_hallScanned;
+uint16_t g_hallScannedRound;
+
+/* the reading of each switch at rest, taken in the first round */
+static uint8_t hallRest[HALL_BUTTON_COUNT];
+static uint8_t hallCalibrated;
+
+/* the turning point of each switch: the lowest point it reached while
+   pressed, the highest it came back to while released */
+static uint8_t hallExtreme[HALL_BUTTON_COUNT];
+#endif
+
+/* the input being converted, ADC_INPUTS when the round is done */
+static volatile uint8_t adcInput = ADC_INPUTS;
+
+/* the converter clock must be 50 to 200 kHz for 10 bit results, but 8 bit
+   ones stay good to about 1 MHz. F_CPU / 128 is 125 kHz, a conversion
+   taking 13 of its cycles, 104 us. The switches use F_CPU / 32, 26 us */
+#if HALL_BUTTON_COUNT > 0
+#define ADC_PRESCALE_BITS   ((1<<ADPS2) | (1<<ADPS0))
+#else
+#define ADC_PRESCALE_BITS   ((1<<ADPS2) | (1<<ADPS1) | (1<<ADPS0))
+#endif
+#define ADC_START(channel) \
+    (ADMUX = (1<<REFS0) | (1<<ADLAR) | (channel), \
+     ADCSRA = (1<<ADEN) | (1<<ADSC) | (1<<ADIE) | ADC_PRESCALE_BITS)
+
+
+/* this function returns the channel of analog input n */
+static inline uint8_t
+adc_input_channel(uint8_t n)
+{
+#if ADC_AXES > 0 && HALL_BUTTON_COUNT > 0
+    if (n >= ADC_AXES)
+        return pgm_read_byte(&g_hallChannels[n - ADC_AXES]);
+    return pgm_read_byte(&g_adcChannels[n]);
+#elif ADC_AXES > 0
+    return pgm_read_byte(&g_adcChannels[n]);
+#else
+    return pgm_read_byte(&g_hallChannels[n]);
+#endif
+}
+
+
+/* this function starts converting the analog inputs, unless still busy.
+   Without switches, a round of ADC_AXES conversions takes 0.5 ms at most,
+   so each scan of a gamepad read every 1 ms finds the values of the round
+   its previous scan started. With them, the rounds follow each other
+   without end, once started */
+void
+source_adc_start(void)
+{
+    if (adcInput < ADC_INPUTS)
+        return;
+    adcInput = 0;
+    ADCSRB = 0;
+    ADC_START(adc_input_channel(0));
+}
+
+
+#if HALL_BUTTON_COUNT > 0
+/* this function decides on switch n from a new reading of it: pressed once
+   it has moved HALL_PRESS_DELTA down from its highest point since it was
+   released (and is past HALL_ACTUATION), released once it has come
+   HALL_RELEASE_DELTA back up from its lowest point since it was pressed
+   (or is back near rest) */
+static inline void
+hall_sample(uint8_t n, uint8_t value)
+{
+    uint8_t bit = 1 << n;
+    uint8_t state = g_hallState;
+    uint8_t rest, travel, extreme = hallExtreme[n];
+
+    if (!hallCalibrated)
+        hallRest[n] = value;
+    rest = hallRest[n];
+    // the magnet may face either way, the travel is the distance from rest
+    travel = (value > rest) ? value - rest : rest - value;
+    g_hallTravel[n] = travel;
+
+    if (travel < HALL_RELEASE_FLOOR)
+    {
+        state &= ~bit;
+        extreme = travel;
+    }
+    else if (state & bit)
+    {
+        if (travel > extreme)
+            extreme = travel;
+        else if (extreme - travel >= HALL_RELEASE_DELTA)
+        {
+            state &= ~bit;
+            extreme = travel;
+        }
+    }
+    else
+    {
+        if (travel < extreme)
+            extreme = travel;
+        else if (travel >= HALL_ACTUATION && travel - extreme >= HALL_PRESS_DELTA)
+        {
+            state |= bit;
+            g_hallPressed |= bit;
+            extreme = travel;
+        }
+    }
+    hallExtreme[n] = extreme;
+
+    if (state != g_hallState)
+    {
+        g_hallState = state;
+        if (!g_hallDecided)
+        {
+            g_hallDecided = 1;
+            g_hallDecidedRound = g_hallInfo.rounds;
+        }
+#if USE_IDLE_SLEEP
+        // sample at once, at full speed, like an input edge
+        CPU_PRESCALE(0);
+        g_inputEdge = 1;
+#endif
+    }
+}
+#endif
+
+
+/* this interrupt takes each result and starts the next input */
+ISR(ADC_vect)
+{
+    uint8_t input = adcInput;
+    uint8_t value = ADCH;
+
+#if ADC_AXES > 0 && HALL_BUTTON_COUNT > 0
+    if (input >= ADC_AXES)
+        hall_sample(input - ADC_AXES, value);
+    else
+        g_adcValues[input] = value;
+#elif ADC_AXES > 0
+    g_adcValues[input] = value;
+#else
+    hall_sample(input, value);
+#endif
+    if (++input >= ADC_INPUTS)
+    {
+#if HALL_BUTTON_COUNT > 0
+        // the switches are sampled round after round
+        input = 0;
+        hallCalibrated = 1;
+        g_hallInfo.rounds++;
+#else
+        adcInput = input;
+        return;
+#endif
+    }
+    ADC_START(adc_input_channel(input));
+    adcInput = input;
+}
+
+#endif
+
+
+#if ENCODER_INPUTS > 0
+
+/* the step for each previous and new A and B state: (previous << 2) | new,
+   0 for no change and for a skipped state */
+const int8_t PROGMEM g_encoderSteps[16] =
+{
+    0, -1,  1,  0,
+    1,  0,  0, -1,
+   -1,  0,  0,  1,
+    0,  1, -1,  0
+};
+
+/* the last two A and B states of each encoder */
+uint8_t g_encoderStates[ENCODER_INPUTS];
+
+#endif
@@ -0,0 +1,630 @@
+/* Teensy Simple Gamepad
+ * A Gamepad device with one 2-axis D-pad and 1 or more buttons
+ * Copyright (C) 2013 Robert Byam, robertbyam.com
+ *
+ * Derived from keyboard and serial examples for Teensy USB Development Board
+ * http://www.pjrc.com/teensy/usb_keyboard.html
+ * http://www.pjrc.com/teensy/usb_serial.html
+ * Copyright (c) 2008 PJRC.COM, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* ===========================================================================
+   This software implements a generic gamepad with one 2-axis (four direction)
+   D-Pad and 1 or more button.  The intended usage is that all of these files
+   remain constant, and only the file simple_gamepad_config.h is modified to
+   specify the configurable parameters for the gamepad
+
+   simple_gamepad_sources.h
+   This file defines the input sources other than the button pins, and the
+   hooks through which they are set up, read and told about each report.
+   Every hook is a static inline function, chosen when compiling, so the
+   gamepad is read by a single function with every source in it and no
+   calls through pointers. It is only included by simple_gamepad_defs.c,
+   after its INDEX_ port numbers.
+   ======================================================================== */
+
+#ifndef SIMPLE_GAMEPAD_SOURCES_H
+#define SIMPLE_GAMEPAD_SOURCES_H
+
+#include "simple_gamepad_defs.h"
+#include "simple_gamepad_expander.h"
+#include "simple_gamepad_link.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+
+/* Each source NAME in INPUT_SOURCES provides:
+
+     void source_name_init(void)
+        sets up its pins and hardware, at the end of simple_gamepad_configure
+     uint8_t source_name_scan(const uint8_t *ports, uint8_t *buttons)
+        ORs its pressed buttons into the buttons array (the first byte being
+        the first byte of the report buttons) at NAME_FIRST_BIT, and writes
+        its other controls into ANALOG_STATE (g_gamepadState, or the analog
+        report with USE_SPLIT_REPORTS), returning non-zero if they changed.
+        ports holds the pins, as sampled for the pin buttons
+     void source_name_loaded(void)
+        called with interrupts disabled once a report has been loaded
+     NAME_PIN_RESERVED(index, shift)
+        non-zero for the pins it uses, which are not read as pin buttons, a
+        constant expression so no two sources can be given the same pin
+
+   A source that is not configured has empty hooks, which compile to
+   nothing. The sources are read in this order, each after the pins. Any
+   further arguments are passed on to X after the names */
+#define INPUT_SOURCES(X, ...) \
+    X(expander, EXPANDER, __VA_ARGS__) \
+    X(matrix, MATRIX, __VA_ARGS__) \
+    X(shift, SHIFT, __VA_ARGS__) \
+    X(console, CONSOLE, __VA_ARGS__) \
+    X(adc, ADC, __VA_ARGS__) \
+    X(hall, HALL, __VA_ARGS__) \
+    X(encoder, ENCODER, __VA_ARGS__) \
+    X(link, LINK, __VA_ARGS__)
+
+#define SOURCE_NONE(name) \
+    static inline void source_##name##_init(void) {} \
+    static inline uint8_t source_##name##_scan(const uint8_t *ports, uint8_t *buttons) \
+        { return 0; } \
+    static inline void source_##name##_loaded(void) {}
+
+
+/* A pin is given as its port letter and bit, like F, 4. These take it apart
+   into its port registers, bit and port number */
+#define PIN_DDR(...)        PIN_DDR_(__VA_ARGS__)
+#define PIN_DDR_(port, bit) DDR##port
+#define PIN_PORT(...)       PIN_PORT_(__VA_ARGS__)
+#define PIN_PORT_(port, bit) PORT##port
+#define PIN_PIN(...)        PIN_PIN_(__VA_ARGS__)
+#define PIN_PIN_(port, bit) PIN##port
+#define PIN_BIT(...)        PIN_BIT_(__VA_ARGS__)
+#define PIN_BIT_(port, bit) (bit)
+#define PIN_INDEX(...)      PIN_INDEX_(__VA_ARGS__)
+#define PIN_INDEX_(port, bit) INDEX_##port
+
+#define PIN_HIGH(pin)       (PIN_PORT(pin) |= (1 << PIN_BIT(pin)))
+#define PIN_LOW(pin)        (PIN_PORT(pin) &= ~(1 << PIN_BIT(pin)))
+#define PIN_OUTPUT(pin)     (PIN_DDR(pin) |= (1 << PIN_BIT(pin)))
+#define PIN_INPUT_PULL_UP(pin) \
+    (PIN_DDR(pin) &= ~(1 << PIN_BIT(pin)), PIN_PORT(pin) |= (1 << PIN_BIT(pin)))
+#define PIN_IS_LOW(pin)     ((PIN_PIN(pin) & (1 << PIN_BIT(pin))) == 0)
+
+/* the pin, or n pins from it, is at port number index and bit shift */
+#define PIN_AT(pin, index, shift) \
+    ((index) == PIN_INDEX(pin) && (shift) == PIN_BIT(pin))
+#define PINS_AT(pin, n, index, shift) \
+    ((index) == PIN_INDEX(pin) && (uint8_t)((shift) - PIN_BIT(pin)) < (n))
+
+/* the port F bits of the first n analog channels of a list of up to 8 */
+#define CHANNEL_MASK(n, ...) \
+    CHANNEL_MASK_(n, __VA_ARGS__, 8, 8, 8, 8, 8, 8, 8, 8)
+#define CHANNEL_MASK_(n, c0, c1, c2, c3, c4, c5, c6, c7, ...) \
+    ((uint8_t)(CHANNEL_BIT(n, 0, c0) | CHANNEL_BIT(n, 1, c1) | \
+               CHANNEL_BIT(n, 2, c2) | CHANNEL_BIT(n, 3, c3) | \
+               CHANNEL_BIT(n, 4, c4) | CHANNEL_BIT(n, 5, c5) | \
+               CHANNEL_BIT(n, 6, c6) | CHANNEL_BIT(n, 7, c7)))
+#define CHANNEL_BIT(n, i, channel) \
+    ((n) > (i) && (channel) < 8 ? 1 << (channel) : 0)
+
+/* an input read back right after an output changed has not been through
+   the input synchronizer yet */
+#define PIN_SETTLE()        __asm__ __volatile__ ("nop\n\tnop")
+
+
+/* this function ORs up to 16 bits of value into the buttons array, from bit
+   on. The array must have two spare bytes after the last buttons byte */
+static inline void
+source_pack(uint8_t *buttons, uint8_t bit, uint16_t value)
+{
+    uint32_t bits = (uint32_t)value << (bit % 8);
+
+    buttons[bit / 8] |= bits;
+    buttons[bit / 8 + 1] |= bits >> 8;
+    buttons[bit / 8 + 2] |= bits >> 16;
+}
+
+
+/* ------------------------------------------------------------------------
+   MCP23017 port expanders, read by the TWI interrupt (see
+   simple_gamepad_expander.c) */
+#if USE_EXPANDERS
+static inline void
+source_expander_init(void)
+{
+    simple_gamepad_expander_init();
+}
+
+static inline uint8_t
+source_expander_scan(const uint8_t *ports, uint8_t *buttons)
+{
+    simple_gamepad_expander_merge(buttons);
+    return 0;
+}
+
+static inline void
+source_expander_loaded(void)
+{
+    simple_gamepad_expander_report_loaded();
+}
+#else
+SOURCE_NONE(expander)
+#define EXPANDER_PIN_RESERVED(index, shift) 0
+#endif
+
+
+/* ------------------------------------------------------------------------
+   Key matrix: each row is driven low in turn, and the columns it pulls low
+   are the pressed keys of that row. Rows not being read float on their
+   pull-ups, so two keys pressed in one column cannot short two rows */
+#if MATRIX_BUTTON_COUNT > 0
+#define MATRIX_ROW_MASK     ((uint8_t)(((1 << MATRIX_ROWS) - 1) << PIN_BIT(MATRIX_ROW_PINS)))
+#define MATRIX_COL_MASK     ((uint8_t)(((1 << MATRIX_COLS) - 1) << PIN_BIT(MATRIX_COL_PINS)))
+
+#define MATRIX_PIN_RESERVED(index, shift) \
+    (PINS_AT(MATRIX_ROW_PINS, MATRIX_ROWS, index, shift) || \
+     PINS_AT(MATRIX_COL_PINS, MATRIX_COLS, index, shift))
+
+static inline void
+source_matrix_init(void)
+{
+    PIN_DDR(MATRIX_ROW_PINS) &= ~MATRIX_ROW_MASK;
+    PIN_PORT(MATRIX_ROW_PINS) |= MATRIX_ROW_MASK;
+    PIN_DDR(MATRIX_COL_PINS) &= ~MATRIX_COL_MASK;
+    PIN_PORT(MATRIX_COL_PINS) |= MATRIX_COL_MASK;
+}
+
+static inline uint8_t
+source_matrix_scan(const uint8_t *ports, uint8_t *buttons)
+{
+    uint8_t row, rowBit, cols, bit = MATRIX_FIRST_BIT;
+
+    for (row = 0; row < MATRIX_ROWS; row++, bit += MATRIX_COLS)
+    {
+        rowBit = 1 << (PIN_BIT(MATRIX_ROW_PINS) + row);
+        PIN_PORT(MATRIX_ROW_PINS) &= ~rowBit;
+        PIN_DDR(MATRIX_ROW_PINS) |= rowBit;
+        // the columns are pulled back up through the switch capacitance
+        _delay_us(1);
+        cols = (uint8_t)(~PIN_PIN(MATRIX_COL_PINS) & MATRIX_COL_MASK) >> PIN_BIT(MATRIX_COL_PINS);
+        PIN_DDR(MATRIX_ROW_PINS) &= ~rowBit;
+        PIN_PORT(MATRIX_ROW_PINS) |= rowBit;
+        source_pack(buttons, bit, cols);
+    }
+    return 0;
+}
+
+static inline void source_matrix_loaded(void) {}
+#else
+SOURCE_NONE(matrix)
+#define MATRIX_PIN_RESERVED(index, shift) 0
+#endif
+
+
+/* ------------------------------------------------------------------------
+   74HC165 shift registers: a low pulse on LOAD latches every input, then
+   each rising CLOCK edge shifts the next one onto DATA. Inputs are pulled
+   up, so a pressed button reads low */
+#if SHIFT_BUTTON_COUNT > 0
+#define SHIFT_PIN_RESERVED(index, shift) \
+    (PIN_AT(SHIFT_LOAD_PIN, index, shift) || PIN_AT(SHIFT_CLOCK_PIN, index, shift) || \
+     PIN_AT(SHIFT_DATA_PIN, index, shift))
+
+static inline void
+source_shift_init(void)
+{
+    PIN_HIGH(SHIFT_LOAD_PIN);
+    PIN_OUTPUT(SHIFT_LOAD_PIN);
+    PIN_LOW(SHIFT_CLOCK_PIN);
+    PIN_OUTPUT(SHIFT_CLOCK_PIN);
+    PIN_INPUT_PULL_UP(SHIFT_DATA_PIN);
+}
+
+static inline uint8_t
+source_shift_scan(const uint8_t *ports, uint8_t *buttons)
+{
+    uint8_t i, bit = SHIFT_FIRST_BIT;
+
+    PIN_LOW(SHIFT_LOAD_PIN);
+    PIN_HIGH(SHIFT_LOAD_PIN);
+    for (i = 0; i < SHIFT_BUTTON_COUNT; i++, bit++)
+    {
+        PIN_SETTLE();
+        if (PIN_IS_LOW(SHIFT_DATA_PIN))
+            buttons[bit / 8] |= 1 << (bit % 8);
+        PIN_HIGH(SHIFT_CLOCK_PIN);
+        PIN_LOW(SHIFT_CLOCK_PIN);
+    }
+    return 0;
+}
+
+static inline void source_shift_loaded(void) {}
+#else
+SOURCE_NONE(shift)
+#define SHIFT_PIN_RESERVED(index, shift) 0
+#endif
+
+
+/* ------------------------------------------------------------------------
+   NES and SNES pads: a 12 us pulse on LATCH loads the buttons, the first
+   is then on DATA, and each CLOCK pulse (idle high) brings the next one.
+   A pressed button reads low. The timing is the consoles' own */
+#if CONSOLE_BUTTON_COUNT > 0
+#define CONSOLE_LATCH_US    12
+#define CONSOLE_CLOCK_US    6       // each half of a clock pulse
+
+#define CONSOLE_PIN_RESERVED(index, shift) \
+    (PIN_AT(CONSOLE_LATCH_PIN, index, shift) || PIN_AT(CONSOLE_CLOCK_PIN, index, shift) || \
+     PIN_AT(CONSOLE_DATA_PIN, index, shift))
+
+static inline void
+source_console_init(void)
+{
+    PIN_LOW(CONSOLE_LATCH_PIN);
+    PIN_OUTPUT(CONSOLE_LATCH_PIN);
+    PIN_HIGH(CONSOLE_CLOCK_PIN);
+    PIN_OUTPUT(CONSOLE_CLOCK_PIN);
+    PIN_INPUT_PULL_UP(CONSOLE_DATA_PIN);
+}
+
+static inline uint8_t
+source_console_scan(const uint8_t *ports, uint8_t *buttons)
+{
+    uint8_t i, bit = CONSOLE_FIRST_BIT;
+
+    PIN_HIGH(CONSOLE_LATCH_PIN);
+    _delay_us(CONSOLE_LATCH_US);
+    PIN_LOW(CONSOLE_LATCH_PIN);
+    _delay_us(CONSOLE_CLOCK_US);
+    for (i = 0; i < CONSOLE_BUTTON_COUNT; i++, bit++)
+    {
+        if (PIN_IS_LOW(CONSOLE_DATA_PIN))
+            buttons[bit / 8] |= 1 << (bit % 8);
+        PIN_LOW(CONSOLE_CLOCK_PIN);
+        _delay_us(CONSOLE_CLOCK_US);
+        PIN_HIGH(CONSOLE_CLOCK_PIN);
+        _delay_us(CONSOLE_CLOCK_US);
+    }
+    return 0;
+}
+
+static inline void source_console_loaded(void) {}
+#else
+SOURCE_NONE(console)
+#define CONSOLE_PIN_RESERVED(index, shift) 0
+#endif
+
+
+/* ------------------------------------------------------------------------
+   Analog axes: the ADC interrupt converts each channel in turn (see
+   simple_gamepad_sources.c), and each scan takes the last values and starts
+   the next round. The first axes of the report are set from them, signed,
+   0 being mid scale */
+#if ADC_AXES > 0 || HALL_BUTTON_COUNT > 0
+/* this function starts converting the analog inputs, unless still busy */
+void source_adc_start(void);
+#endif
+
+#if ADC_AXES > 0
+extern const uint8_t PROGMEM g_adcChannels[];
+extern volatile uint8_t g_adcValues[ADC_AXES];
+
+#define ADC_CHANNEL_MASK    CHANNEL_MASK(ADC_AXES, ADC_AXIS_CHANNELS)
+#define ADC_PIN_RESERVED(index, shift) \
+    ((index) == INDEX_F && ((ADC_CHANNEL_MASK >> (shift)) & 1))
+
+static inline void
+source_adc_init(void)
+{
+    // the analog pins have no pull-up, and no digital input to draw power
+    DDRF &= ~ADC_CHANNEL_MASK;
+    PORTF &= ~ADC_CHANNEL_MASK;
+    DIDR0 |= ADC_CHANNEL_MASK;
+    source_adc_start();
+}
+
+static inline uint8_t
+source_adc_scan(const uint8_t *ports, uint8_t *buttons)
+{
+    uint8_t i, changed = 0;
+    int8_t value;
+    int16_t diff;
+
+    for (i = 0; i < ADC_AXES; i++)
+    {
+        value = (int8_t)(g_adcValues[i] - 128);
+        if (value < -127)
+            value = -127;
+        // both are -127 to 127, so the difference needs 9 bits
+        diff = value - (int8_t)ANALOG_STATE.axes[i];
+        if (diff > ADC_AXIS_DEADBAND || diff < -ADC_AXIS_DEADBAND)
+        {
+            ANALOG_STATE.axes[i] = value;
+            changed = 1;
+        }
+    }
+    source_adc_start();
+    return changed;
+}
+
+static inline void source_adc_loaded(void) {}
+#else
+SOURCE_NONE(adc)
+#define ADC_PIN_RESERVED(index, shift) 0
+#endif
+
+
+/* ------------------------------------------------------------------------
+   Hall-effect switches with rapid trigger: the ADC interrupt decides on
+   each switch at each of its samples (see simple_gamepad_sources.c), and
+   each scan reports the switches pressed, and those pressed and already
+   released since the last report. The scan also hands the time of the
+   first decision it reports to the report, to measure the latency */
+#if HALL_BUTTON_COUNT > 0
+extern const uint8_t PROGMEM g_hallChannels[];
+extern volatile uint8_t g_hallPressed;
+extern volatile uint8_t g_hallDecided;
+extern volatile uint16_t g_hallDecidedRound;
+extern uint8_t g_hallScanned;
+extern uint16_t g_hallScannedRound;
+
+#define HALL_CHANNEL_MASK   CHANNEL_MASK(HALL_BUTTON_COUNT, HALL_CHANNELS)
+#define HALL_PIN_RESERVED(index, shift) \
+    ((index) == INDEX_F && ((HALL_CHANNEL_MASK >> (shift)) & 1))
+
+static inline void
+source_hall_init(void)
+{
+    // the analog pins have no pull-up, and no digital input to draw power
+    DDRF &= ~HALL_CHANNEL_MASK;
+    PORTF &= ~HALL_CHANNEL_MASK;
+    DIDR0 |= HALL_CHANNEL_MASK;
+    source_adc_start();
+}
+
+static inline uint8_t
+source_hall_scan(const uint8_t *ports, uint8_t *buttons)
+{
+    uint8_t pressed, intr_state = SREG;
+
+    cli();
+    pressed = g_hallState | g_hallPressed;
+    if (g_hallDecided && !g_hallScanned)
+    {
+        g_hallScanned = 1;
+        g_hallScannedRound = g_hallDecidedRound;
+        g_hallDecided = 0;
+    }
+    SREG = intr_state;
+    source_pack(buttons, HALL_FIRST_BIT, pressed);
+    return 0;
+}
+
+static inline void
+source_hall_loaded(void)
+{
+    uint16_t latency;
+
+    g_hallPressed = 0;
+    if (g_hallScanned)
+    {
+        latency = g_hallInfo.rounds - g_hallScannedRound;
+        g_hallInfo.last_latency = latency;
+        if (latency > g_hallInfo.max_latency)
+            g_hallInfo.max_latency = latency;
+        g_hallScanned = 0;
+    }
+}
+#else
+SOURCE_NONE(hall)
+#define HALL_PIN_RESERVED(index, shift) 0
+#endif
+
+
+/* ------------------------------------------------------------------------
+   Rotary encoders: the last two states of the A and B outputs give the
+   step, from a table. Each report carries the steps made since the last
+   report, the pins being sampled with the buttons */
+#if ENCODER_INPUTS > 0
+#define ENCODER_PORT_INDEX(...) ENCODER_PORT_INDEX_(__VA_ARGS__)
+#define ENCODER_PORT_INDEX_(port, a, b) INDEX_##port
+#define ENCODER_A(...)          ENCODER_A_(__VA_ARGS__)
+#define ENCODER_A_(port, a, b)  (a)
+#define ENCODER_B(...)          ENCODER_B_(__VA_ARGS__)
+#define ENCODER_B_(port, a, b)  (b)
+#define ENCODER_DDR(...)        ENCODER_DDR_(__VA_ARGS__)
+#define ENCODER_DDR_(port, a, b) DDR##port
+#define ENCODER_PORT(...)       ENCODER_PORT_(__VA_ARGS__)
+#define ENCODER_PORT_(port, a, b) PORT##port
+#define ENCODER_MASK(pins)      ((1 << ENCODER_A(pins)) | (1 << ENCODER_B(pins)))
+
+#define ENCODER_AT(pins, index, shift) \
+    ((index) == ENCODER_PORT_INDEX(pins) && \
+     ((shift) == ENCODER_A(pins) || (shift) == ENCODER_B(pins)))
+#if ENCODER_INPUTS > 1
+#define ENCODER_PIN_RESERVED(index, shift) \
+    (ENCODER_AT(ENCODER1_PINS, index, shift) || ENCODER_AT(ENCODER2_PINS, index, shift))
+#else
+#define ENCODER_PIN_RESERVED(index, shift) ENCODER_AT(ENCODER1_PINS, index, shift)
+#endif
+
+/* the A and B state of the encoder, from the sampled ports */
+#define ENCODER_STATE(ports, pins) \
+    ((((ports[ENCODER_PORT_INDEX(pins)] >> ENCODER_A(pins)) & 1) << 1) | \
+     ((ports[ENCODER_PORT_INDEX(pins)] >> ENCODER_B(pins)) & 1))
+
+extern const int8_t PROGMEM g_encoderSteps[16];
+extern uint8_t g_encoderStates[ENCODER_INPUTS];
+
+static inline void
+source_encoder_init(void)
+{
+    ENCODER_DDR(ENCODER1_PINS) &= ~ENCODER_MASK(ENCODER1_PINS);
+    ENCODER_PORT(ENCODER1_PINS) |= ENCODER_MASK(ENCODER1_PINS);
+#if ENCODER_INPUTS > 1
+    ENCODER_DDR(ENCODER2_PINS) &= ~ENCODER_MASK(ENCODER2_PINS);
+    ENCODER_PORT(ENCODER2_PINS) |= ENCODER_MASK(ENCODER2_PINS);
+#endif
+}
+
+/* this function takes the new A and B state of encoder n, and adds the
+   step made since the last one to its control */
+static inline uint8_t
+encoder_step(uint8_t n, uint8_t ab)
+{
+    int8_t step;
+
+    g_encoderStates[n] = ((g_encoderStates[n] << 2) | ab) & 0x0F;
+    step = pgm_read_byte(&g_encoderSteps[g_encoderStates[n]]);
+    if (step == 0 || ANALOG_STATE.encoders[n] == step * 127)
+        return 0;
+    ANALOG_STATE.encoders[n] += step;
+    return 1;
+}
+
+static inline uint8_t
+source_encoder_scan(const uint8_t *ports, uint8_t *buttons)
+{
+    uint8_t changed = encoder_step(0, ENCODER_STATE(ports, ENCODER1_PINS));
+#if ENCODER_INPUTS > 1
+    changed |= encoder_step(1, ENCODER_STATE(ports, ENCODER2_PINS));
+#endif
+    return changed;
+}
+
+/* the steps are relative, so each report only carries the new ones */
+static inline void
+encoder_clear(void)
+{
+    ANALOG_STATE.encoders[0] = 0;
+#if ENCODER_INPUTS > 1
+    ANALOG_STATE.encoders[1] = 0;
+#endif
+}
+
+static inline void
+source_encoder_loaded(void)
+{
+#if !USE_SPLIT_REPORTS
+    encoder_clear();
+#endif
+}
+#else
+SOURCE_NONE(encoder)
+#define ENCODER_PIN_RESERVED(index, shift) 0
+static inline void encoder_clear(void) {}
+#endif
+
+
+/* ------------------------------------------------------------------------
+   Secondary boards over the UART, on the primary (see
+   simple_gamepad_link.c). A secondary only sets its UART up here */
+#if LINK_MODE != LINK_NONE
+static inline void
+source_link_init(void)
+{
+    simple_gamepad_link_init();
+}
+
+#if USE_LINK_PRIMARY
+static inline uint8_t
+source_link_scan(const uint8_t *ports, uint8_t *buttons)
+{
+    simple_gamepad_link_merge(buttons);
+    return 0;
+}
+
+static inline void
+source_link_loaded(void)
+{
+    simple_gamepad_link_report_loaded();
+}
+#else
+static inline uint8_t
+source_link_scan(const uint8_t *ports, uint8_t *buttons)
+{
+    return 0;
+}
+
+static inline void source_link_loaded(void) {}
+#endif
+#else
+SOURCE_NONE(link)
+#define LINK_PIN_RESERVED(index, shift) 0
+#endif
+
+
+/* ------------------------------------------------------------------------
+   The hooks of every source together */
+#define SOURCE_INIT(name, NAME, ...)    source_##name##_init();
+#define SOURCE_SCAN(name, NAME, ...)    changed |= source_##name##_scan(ports, buttons);
+#define SOURCE_LOADED(name, NAME, ...)  source_##name##_loaded();
+#define SOURCE_USES(name, NAME, index, shift) + ((NAME##_PIN_RESERVED(index, shift)) ? 1 : 0)
+
+/* the number of sources using the pin at port number index and bit shift */
+#define SOURCES_AT(index, shift)    (0 INPUT_SOURCES(SOURCE_USES, index, shift))
+
+/* no pin of port number index is used by two sources */
+#define SOURCES_APART(index) \
+    (SOURCES_AT(index, 0) <= 1 && SOURCES_AT(index, 1) <= 1 && \
+     SOURCES_AT(index, 2) <= 1 && SOURCES_AT(index, 3) <= 1 && \
+     SOURCES_AT(index, 4) <= 1 && SOURCES_AT(index, 5) <= 1 && \
+     SOURCES_AT(index, 6) <= 1 && SOURCES_AT(index, 7) <= 1)
+typedef char source_pins_check[SOURCES_APART(0) && SOURCES_APART(1) && SOURCES_APART(2) &&
+                               SOURCES_APART(3) && SOURCES_APART(4) && SOURCES_APART(5)
+                               ? 1 : -1];
+
+static inline void
+sources_init(void)
+{
+    INPUT_SOURCES(SOURCE_INIT)
+}
+
+static inline uint8_t
+sources_scan(const uint8_t *ports, uint8_t *buttons)
+{
+    uint8_t changed = 0;
+
+    INPUT_SOURCES(SOURCE_SCAN)
+    return changed;
+}
+
+static inline void
+sources_loaded(void)
+{
+    INPUT_SOURCES(SOURCE_LOADED)
+}
+
+/* called with interrupts disabled once an analog report (USE_SPLIT_REPORTS)
+   has been loaded, the encoder steps being in it rather than in the state
+   report */
+static inline void
+sources_analog_loaded(void)
+{
+    encoder_clear();
+}
+
+static inline uint8_t
+sources_pin_reserved(uint8_t index, uint8_t shift)
+{
+    return SOURCES_AT(index, shift) != 0;
+}
+
+#endif /* SIMPLE_GAMEPAD_SOURCES_H */
@@ -0,0 +1,244 @@
+/* Teensy Simple Gamepad
+ * A Gamepad device with one 2-axis D-pad and 1 or more buttons
+ * Copyright (C) 2013 Robert Byam, robertbyam.com
+ *
+ * Derived from keyboard and serial examples for Teensy USB Development Board
+ * http://www.pjrc.com/teensy/usb_keyboard.html
+ * http://www.pjrc.com/teensy/usb_serial.html
+ * Copyright (c) 2008 PJRC.COM, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* ===========================================================================
+   This software implements a generic gamepad with one 2-axis (four direction)
+   D-Pad and 1 or more button.  The intended usage is that all of these files
+   remain constant, and only the file simple_gamepad_config.h is modified to
+   specify the configurable parameters for the gamepad
+
+   simple_gamepad_turbo.c
+   This file contains the turbo (autofire) and macro timing engine. It is
+   clocked by the USB frame counter rather than by delays, and every period it
+   uses is a whole number of host polls: any run of N poll intervals contains
+   exactly N polls whatever the host's phase, so each turbo toggle and each
+   macro step is seen by the host in at least one report.
+   ======================================================================== */
+
+#include "simple_gamepad_turbo.h"
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#if USE_TURBO_ENGINE
+
+/* frames each turbo half period (pressed or released) lasts */
+#define TURBO_PERIOD_FRAMES ((uint16_t)TURBO_RATE_POLLS * POLL_INTERVAL_MS)
+
+/* turbo and macro button masks are 32 bits, covering BTN1 to BTN32 */
+#if BUTTON_ARRAY_SIZE < (BUTTON_BIT_OFFSET + 32 + 7) / 8
+#define MASK_ARRAY_SIZE BUTTON_ARRAY_SIZE
+#else
+#define MASK_ARRAY_SIZE ((BUTTON_BIT_OFFSET + 32 + 7) / 8)
+#endif
+
+/* byte j of a button mask, laid out as in gamepad_state.buttons */
+static inline uint8_t
+mask_byte(uint32_t mask, uint8_t j)
+{
+#if BUTTON_BIT_OFFSET
+    if (j == 0)
+        return (uint8_t)(mask << BUTTON_BIT_OFFSET);
+    return (uint8_t)(mask >> (8 * j - BUTTON_BIT_OFFSET));
+#else
+    return (uint8_t)(mask >> (8 * j));
+#endif
+}
+
+/* the frame number (low byte) at the previous call */
+static uint8_t lastFrame;
+
+
+#if TURBO_BUTTONS != 0
+
+/* frames spent in the current turbo half period */
+static uint16_t turboFrames;
+/* non-zero while held turbo buttons are reported released */
+static uint8_t turboReleased;
+
+static inline void
+turbo_apply(uint8_t *buttons, uint8_t elapsed)
+{
+    uint8_t i;
+    uint8_t held = 0;
+
+    for (i = 0; i < MASK_ARRAY_SIZE; i++)
+        held |= buttons[i] & mask_byte(TURBO_BUTTONS, i);
+
+    if (!held)
+    {
+        // restart the cycle so the next press is reported straight away
+        turboFrames = 0;
+        turboReleased = 0;
+        return;
+    }
+
+    // an odd number of half periods gone by since the last call flips
+    // the phase, however many frames elapsed
+    turboFrames += elapsed;
+    if (turboFrames >= TURBO_PERIOD_FRAMES)
+    {
+        turboReleased ^= (turboFrames / TURBO_PERIOD_FRAMES) & 1;
+        turboFrames %= TURBO_PERIOD_FRAMES;
+    }
+
+    if (turboReleased)
+    {
+        for (i = 0; i < MASK_ARRAY_SIZE; i++)
+            buttons[i] &= ~mask_byte(TURBO_BUTTONS, i);
+    }
+}
+
+#endif /* TURBO_BUTTONS */
+
+
+#if MACRO_COUNT > 0
+
+typedef struct
+{
+    uint32_t buttons;   // buttons pressed during this step
+    uint8_t polls;      // step duration in host polls, 0 ends the macro
+} macro_step;
+
+typedef struct
+{
+    uint8_t trigger;    // button number (1-based) that starts the macro
+    macro_step steps[MACRO_MAX_STEPS];
+} macro_def;
+
+#define MACRO_ENTRY(trigger, ...) { trigger, __VA_ARGS__ },
+static const macro_def PROGMEM macro_table[MACRO_COUNT] =
+{
+    MACRO_TABLE
+};
+#undef MACRO_ENTRY
+
+/* MACRO_TABLE is checked when compiling: it has MACRO_COUNT entries, and
+   each trigger is one of BTN1 to BTN<BUTTON_COUNT> */
+#define MACRO_ENTRY(trigger, ...) + 1
+typedef char macro_count_check[(0 MACRO_TABLE) == MACRO_COUNT ? 1 : -1];
+#undef MACRO_ENTRY
+#define MACRO_ENTRY(trigger, ...) && (trigger) >= 1 && (trigger) <= BUTTON_COUNT
+typedef char macro_trigger_check[(1 MACRO_TABLE) ? 1 : -1];
+#undef MACRO_ENTRY
+
+#define MACRO_IDLE  0xFF
+
+typedef struct
+{
+    uint8_t step;       // current step, MACRO_IDLE when not playing
+    uint8_t held;       // trigger state at the previous call
+    uint16_t frames;    // frames spent in the current step
+} macro_run;
+
+static macro_run macroRuns[MACRO_COUNT] =
+{
+    [0 ... MACRO_COUNT - 1] = { MACRO_IDLE, 0, 0 }
+};
+
+static inline void
+macro_apply(uint8_t *buttons, uint8_t elapsed)
+{
+    uint8_t i, j, trigger, triggerBit, pressed, polls;
+    uint32_t stepButtons;
+    const macro_def *def;
+    macro_run *run;
+
+    for (i = 0; i < MACRO_COUNT; i++)
+    {
+        def = &macro_table[i];
+        run = &macroRuns[i];
+
+        // the trigger only starts the macro, it is never reported itself
+        trigger = pgm_read_byte(&def->trigger) - 1 + BUTTON_BIT_OFFSET;
+        triggerBit = 1 << (trigger % 8);
+        pressed = buttons[trigger / 8] & triggerBit;
+        buttons[trigger / 8] &= ~triggerBit;
+
+        if (run->step == MACRO_IDLE)
+        {
+            if (pressed && !run->held)
+            {
+                run->step = 0;
+                run->frames = 0;
+            }
+        }
+        else
+        {
+            run->frames += elapsed;
+        }
+        run->held = pressed;
+
+        // move past every step that has run its course; at most
+        // MACRO_MAX_STEPS iterations, and normally none
+        while (run->step != MACRO_IDLE)
+        {
+            polls = pgm_read_byte(&def->steps[run->step].polls);
+            if (polls == 0)
+            {
+                run->step = MACRO_IDLE;
+                break;
+            }
+            if (run->frames < (uint16_t)polls * POLL_INTERVAL_MS)
+                break;
+            run->frames -= (uint16_t)polls * POLL_INTERVAL_MS;
+            if (++run->step >= MACRO_MAX_STEPS)
+                run->step = MACRO_IDLE;
+        }
+
+        if (run->step != MACRO_IDLE)
+        {
+            stepButtons = pgm_read_dword(&def->steps[run->step].buttons);
+            for (j = 0; j < MASK_ARRAY_SIZE; j++)
+                buttons[j] |= mask_byte(stepButtons, j);
+        }
+    }
+}
+
+#endif /* MACRO_COUNT */
+
+
+/* this function applies turbo and macros to the freshly sampled buttons */
+void
+simple_gamepad_turbo_apply(uint8_t *buttons)
+{
+    uint8_t frame = UDFNUML;
+    // only the low byte of the frame number is used; the main loop samples
+    // far more often than every 255 frames so it cannot wrap unseen
+    uint8_t elapsed = frame - lastFrame;
+
+    lastFrame = frame;
+
+#if TURBO_BUTTONS != 0
+    turbo_apply(buttons, elapsed);
+#endif
+#if MACRO_COUNT > 0
+    macro_apply(buttons, elapsed);
+#endif
+}
+
+#endif /* USE_TURBO_ENGINE */
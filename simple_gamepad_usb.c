@@ -40,9 +40,13 @@
 
 #include "simple_gamepad_usb.h"
 #include "simple_gamepad_defs.h"
+#include "simple_gamepad_phase.h"
+#include "simple_gamepad_feature.h"
+#include "simple_gamepad_keyboard.h"
 #include <avr/io.h>
 #include <avr/pgmspace.h>
 #include <avr/interrupt.h>
+#include <avr/eeprom.h>
 
 
 // Mac OS-X and Linux automatically load the correct drivers.  On
@@ -121,6 +125,8 @@
 #define HID_SET_REPORT          9
 #define HID_SET_IDLE            10
 #define HID_SET_PROTOCOL        11
+#define HID_REPORT_OUTPUT       2   // report types, high byte of wValue
+#define HID_REPORT_FEATURE      3
 // CDC (communication class device)
 #define CDC_SET_LINE_CODING         0x20
 #define CDC_GET_LINE_CODING         0x21
@@ -136,14 +142,31 @@
 #define ENDPOINT0_SIZE  32
 
 #define GAMEPAD_INTERFACE   0
+// the analog report's interface follows the keyboard's, if any
+#define ANALOG_INTERFACE    (1 + USE_KEYBOARD)
+// the smallest endpoint buffer the report fits in
+#if GAMEPAD_REPORT_SIZE <= 8
 #define GAMEPAD_SIZE        8
+#elif GAMEPAD_REPORT_SIZE <= 16
+#define GAMEPAD_SIZE        16
+#else
+#define GAMEPAD_SIZE        32
+#endif
 #define GAMEPAD_BUFFER      EP_DOUBLE_BUFFER
 
 static const uint8_t PROGMEM endpoint_config_table[] =
 {
     1, EP_TYPE_INTERRUPT_IN,  EP_SIZE(GAMEPAD_SIZE) | GAMEPAD_BUFFER,
+#if USE_KEYBOARD
+    1, EP_TYPE_INTERRUPT_IN,  EP_SIZE(KEYBOARD_REPORT_SIZE) | EP_DOUBLE_BUFFER,
+#else
     0,
+#endif
+#if USE_SPLIT_REPORTS
+    1, EP_TYPE_INTERRUPT_IN,  EP_SIZE(8) | EP_DOUBLE_BUFFER,
+#else
     0,
+#endif
     0
 };
 
@@ -161,6 +184,7 @@ static const uint8_t PROGMEM endpoint_config_table[] =
 // spec and relevant portions of any USB class specifications!
 
 
+#define DEVICE_DESC_PRODUCT_ID  10  // offset of idProduct
 static const uint8_t PROGMEM device_descriptor[] =
 {
     18,                 // bLength
@@ -182,8 +206,13 @@ static const uint8_t PROGMEM device_descriptor[] =
 };
 
 
-#define CONFIG1_DESC_SIZE       (9+9+9+7)
+// each interface takes an interface, a HID and an endpoint descriptor
+#define INTERFACE_DESC_SIZE     (9+9+7)
+#define INTERFACE_COUNT         (1 + USE_KEYBOARD + USE_SPLIT_REPORTS)
+#define CONFIG1_DESC_SIZE       (9 + INTERFACE_COUNT * INTERFACE_DESC_SIZE)
 #define GAMEPAD_HID_DESC_OFFSET (9+9)
+#define KEYBOARD_HID_DESC_OFFSET (9 + INTERFACE_DESC_SIZE + 9)
+#define ANALOG_HID_DESC_OFFSET  (9 + ANALOG_INTERFACE * INTERFACE_DESC_SIZE + 9)
 static const uint8_t PROGMEM config1_descriptor[CONFIG1_DESC_SIZE] =
 {
     // configuration descriptor, USB spec 9.6.3, page 264-266, Table 9-10
@@ -191,7 +220,7 @@ static const uint8_t PROGMEM config1_descriptor[CONFIG1_DESC_SIZE] =
     2,                  // bDescriptorType;
     LSB(CONFIG1_DESC_SIZE), // wTotalLength
     MSB(CONFIG1_DESC_SIZE),
-    1,                  // bNumInterfaces
+    INTERFACE_COUNT,    // bNumInterfaces
     1,                  // bConfigurationValue
     0,                  // iConfiguration
     0x80,               // bmAttributes
@@ -221,7 +250,66 @@ static const uint8_t PROGMEM config1_descriptor[CONFIG1_DESC_SIZE] =
     GAMEPAD_ENDPOINT | 0x80, // bEndpointAddress
     0x03,               // bmAttributes (0x03=intr)
     GAMEPAD_SIZE, 0,    // wMaxPacketSize
-    10                  // bInterval
+    POLL_INTERVAL_MS    // bInterval
+#if USE_KEYBOARD
+    ,
+    // the keyboard: interface descriptor
+    9,                  // bLength
+    4,                  // bDescriptorType
+    KEYBOARD_INTERFACE, // bInterfaceNumber
+    0,                  // bAlternateSetting
+    1,                  // bNumEndpoints
+    0x03,               // bInterfaceClass (0x03 = HID)
+    0x00,               // bInterfaceSubClass (0x00 = No Boot, a bitmap
+                        //   report is not a boot keyboard report)
+    0x00,               // bInterfaceProtocol (0x00 = No Protocol)
+    0,                  // iInterface
+    // HID interface descriptor
+    9,                  // bLength
+    0x21,               // bDescriptorType
+    0x11, 0x01,         // bcdHID
+    0,                  // bCountryCode
+    1,                  // bNumDescriptors
+    0x22,               // bDescriptorType
+    sizeof(keyboard_hid_report_desc), // wDescriptorLength
+    0,
+    // endpoint descriptor, polled every frame whatever POLL_INTERVAL_MS
+    7,                  // bLength
+    5,                  // bDescriptorType
+    KEYBOARD_ENDPOINT | 0x80, // bEndpointAddress
+    0x03,               // bmAttributes (0x03=intr)
+    KEYBOARD_REPORT_SIZE, 0, // wMaxPacketSize
+    1                   // bInterval
+#endif
+#if USE_SPLIT_REPORTS
+    ,
+    // the analog report: interface descriptor
+    9,                  // bLength
+    4,                  // bDescriptorType
+    ANALOG_INTERFACE,   // bInterfaceNumber
+    0,                  // bAlternateSetting
+    1,                  // bNumEndpoints
+    0x03,               // bInterfaceClass (0x03 = HID)
+    0x00,               // bInterfaceSubClass (0x00 = No Boot)
+    0x00,               // bInterfaceProtocol (0x00 = No Protocol)
+    0,                  // iInterface
+    // HID interface descriptor
+    9,                  // bLength
+    0x21,               // bDescriptorType
+    0x11, 0x01,         // bcdHID
+    0,                  // bCountryCode
+    1,                  // bNumDescriptors
+    0x22,               // bDescriptorType
+    sizeof(analog_hid_report_desc), // wDescriptorLength
+    0,
+    // endpoint descriptor
+    7,                  // bLength
+    5,                  // bDescriptorType
+    ANALOG_ENDPOINT | 0x80, // bEndpointAddress
+    0x03,               // bmAttributes (0x03=intr)
+    8, 0,               // wMaxPacketSize
+    ANALOG_INTERVAL_MS  // bInterval
+#endif
 };
 
 // If you're desperate for a little extra code memory, these strings
@@ -272,6 +360,14 @@ static const struct descriptor_list_struct
     {0x0200, 0x0000, config1_descriptor, sizeof(config1_descriptor)},
     {0x2100, GAMEPAD_INTERFACE, config1_descriptor+GAMEPAD_HID_DESC_OFFSET, 9},
     {0x2200, GAMEPAD_INTERFACE, gamepad_hid_report_desc, sizeof(gamepad_hid_report_desc)},
+#if USE_KEYBOARD
+    {0x2100, KEYBOARD_INTERFACE, config1_descriptor+KEYBOARD_HID_DESC_OFFSET, 9},
+    {0x2200, KEYBOARD_INTERFACE, keyboard_hid_report_desc, sizeof(keyboard_hid_report_desc)},
+#endif
+#if USE_SPLIT_REPORTS
+    {0x2100, ANALOG_INTERFACE, config1_descriptor+ANALOG_HID_DESC_OFFSET, 9},
+    {0x2200, ANALOG_INTERFACE, analog_hid_report_desc, sizeof(analog_hid_report_desc)},
+#endif
     {0x0300, 0x0000, (const uint8_t *)&string0, 4},
     {0x0301, 0x0409, (const uint8_t *)&string1, sizeof(STR_MANUFACTURER)},
     {0x0302, 0x0409, (const uint8_t *)&string2, sizeof(STR_PRODUCT)},
@@ -279,6 +375,40 @@ static const struct descriptor_list_struct
 };
 #define NUM_DESC_LIST (sizeof(descriptor_list)/sizeof(struct descriptor_list_struct))
 
+#if USE_EEPROM_IDENTITY
+// The identity provisioned in EEPROM, at EEPROM_IDENTITY_ADDR:
+//   offset 0   IDENTITY_MAGIC
+//   offset 1   idProduct, low byte first, 0xFFFF to keep PRODUCT_ID
+//   offset 4   serial number string descriptor, sent as it is
+//   offset 68  product string descriptor, sent as it is
+// A string slot is only used when it holds a string descriptor that fits
+// in IDENTITY_STRING_SLOT bytes. tools/eep_identity.py uses this layout.
+#define IDENTITY_MAGIC          0x49
+#define IDENTITY_PRODUCT_ID     1
+#define IDENTITY_STRING_SLOT    64
+#define IDENTITY_SERIAL         4
+#define IDENTITY_PRODUCT        (IDENTITY_SERIAL + IDENTITY_STRING_SLOT)
+#define IDENTITY_EEPROM(offset) ((const uint8_t *)(EEPROM_IDENTITY_ADDR + (offset)))
+
+// where the descriptor being sent on endpoint 0 is read from
+#define EP0_FROM_FLASH          0
+#define EP0_FROM_EEPROM         1
+#define EP0_FROM_DEVICE         2   // flash, with the provisioned idProduct
+#endif
+
+// the data stage of a request, other than GET_DESCRIPTOR, carried out from
+// the interrupt of the host being ready for it: TXINI for a reply, RXOUTI
+// for the report it sends
+#define EP0_NONE                0
+#define EP0_REPLY_BYTES         1   // ep0_reply_len bytes of ep0_reply
+#define EP0_REPLY_GAMEPAD       2   // the state report
+#define EP0_REPLY_FEATURE       3   // ep0_reply_len bytes of the feature report
+#define EP0_REPLY_KEYBOARD      4   // the keyboard report
+#define EP0_REPLY_ANALOG        5   // the analog report
+#define EP0_RECEIVE_IGNORE      6   // an output report not used
+#define EP0_RECEIVE_FEATURE     7   // a feature report request
+#define EP0_RECEIVE_PROBE       8   // a loopback probe token
+
 
 /**************************************************************************
  *
@@ -296,6 +426,37 @@ static uint8_t gamepad_protocol = 1;
 
 static uint8_t gamepad_idle_config = 0;
 
+#if USE_KEYBOARD
+// the same for the keyboard interface
+static uint8_t keyboard_protocol = 1;
+static uint8_t keyboard_idle_config = 0;
+#endif
+
+#if USE_SPLIT_REPORTS
+// the same for the analog report's interface
+static uint8_t analog_protocol = 1;
+static uint8_t analog_idle_config = 0;
+#endif
+
+// endpoint 0 transfers that need more than one packet, or that must wait
+// for the host, are continued from later interrupts rather than waited on
+// with interrupts disabled
+static const uint8_t *ep0_desc_addr;    // next descriptor byte to send
+static uint8_t ep0_desc_len;            // descriptor bytes left to send
+static uint8_t ep0_new_address;         // UDADDR value once the status stage is done
+static uint8_t ep0_stage;               // EP0_NONE or the data stage to carry out
+static uint8_t ep0_reply[2];            // a reply of a byte or two
+static uint8_t ep0_reply_len;
+
+#if USE_EEPROM_IDENTITY
+static uint8_t ep0_desc_source;         // EP0_FROM_FLASH, EEPROM or DEVICE
+
+// the identity found in EEPROM by usb_init, lengths are 0 when not present
+static uint16_t usb_product_id = PRODUCT_ID;
+static uint8_t usb_serial_length;
+static uint8_t usb_product_length;
+#endif
+
 
 /**************************************************************************
  *
@@ -303,9 +464,40 @@ static uint8_t gamepad_idle_config = 0;
  *
  **************************************************************************/
 
+#if USE_EEPROM_IDENTITY
+// return the length of the string descriptor in an identity slot, or 0 if
+// the slot does not hold one
+static uint8_t usb_identity_string(uint8_t offset)
+{
+    uint8_t len = eeprom_read_byte(IDENTITY_EEPROM(offset));
+
+    if (len < 2 || len > IDENTITY_STRING_SLOT || (len & 1) ||
+        eeprom_read_byte(IDENTITY_EEPROM(offset + 1)) != 3)
+        return 0;
+    return len;
+}
+
+// look for an identity provisioned in EEPROM
+static void usb_identity_load(void)
+{
+    uint16_t id;
+
+    if (eeprom_read_byte(IDENTITY_EEPROM(0)) != IDENTITY_MAGIC)
+        return;
+    id = eeprom_read_word((const uint16_t *)IDENTITY_EEPROM(IDENTITY_PRODUCT_ID));
+    if (id != 0xFFFF)
+        usb_product_id = id;
+    usb_serial_length = usb_identity_string(IDENTITY_SERIAL);
+    usb_product_length = usb_identity_string(IDENTITY_PRODUCT);
+}
+#endif
+
 // initialize USB
 void usb_init(void)
 {
+#if USE_EEPROM_IDENTITY
+    usb_identity_load();
+#endif
     HW_CONFIG();
     USB_FREEZE();               // enable USB
     PLL_CONFIG();               // config PLL
@@ -344,27 +536,184 @@ ISR(USB_GEN_vect)
         UECFG1X = EP_SIZE(ENDPOINT0_SIZE) | EP_SINGLE_BUFFER;
         UEIENX = (1<<RXSTPE);
         usb_configuration = 0;
+        ep0_new_address = 0;
+        ep0_stage = EP0_NONE;
     }
+#if USE_POLL_PHASE_TRACKING
+    if (intbits & (1<<SOFI))
+        poll_phase_sof();
+#endif
 }
 
-// Misc functions to wait for ready and send/receive packets
-static inline void usb_wait_in_ready(void)
-{
-    while (!(UEINTX & (1<<TXINI))) ;
-}
+// Misc functions to send/receive packets
 static inline void usb_send_in(void)
 {
     UEINTX = ~(1<<TXINI);
 }
-static inline void usb_wait_receive_out(void)
-{
-    while (!(UEINTX & (1<<RXOUTI))) ;
-}
 static inline void usb_ack_out(void)
 {
     UEINTX = ~(1<<RXOUTI);
 }
 
+// Carry out the data stage of a request once the host is ready for it,
+// from a later interrupt, rather than waiting for it here
+static inline void usb_ep0_defer(uint8_t stage)
+{
+    ep0_stage = stage;
+    UEIENX = (1<<RXSTPE) | (stage >= EP0_RECEIVE_IGNORE ? (1<<RXOUTE) : (1<<TXINE));
+}
+
+// Reply with a byte, or two
+static inline void usb_ep0_reply(uint8_t b0, uint8_t b1, uint8_t len)
+{
+    ep0_reply[0] = b0;
+    ep0_reply[1] = b1;
+    ep0_reply_len = len;
+    usb_ep0_defer(EP0_REPLY_BYTES);
+}
+
+#if USE_EEPROM_IDENTITY
+// Read an EEPROM byte from the interrupt. The main loop may be part way
+// through an EEPROM access of its own, so its address and data are put back
+static inline uint8_t usb_eeprom_read(const uint8_t *addr)
+{
+    uint16_t address = EEAR;
+    uint8_t data = EEDR;
+    uint8_t c;
+
+    EEAR = (uint16_t)addr;
+    EECR |= (1<<EERE);
+    c = EEDR;
+    EEAR = address;
+    EEDR = data;
+    return c;
+}
+#endif
+
+// Return the next descriptor byte to send
+static inline uint8_t usb_ep0_byte(void)
+{
+    const uint8_t *addr = ep0_desc_addr++;
+
+#if USE_EEPROM_IDENTITY
+    if (ep0_desc_source == EP0_FROM_EEPROM)
+        return usb_eeprom_read(addr);
+    if (ep0_desc_source == EP0_FROM_DEVICE)
+    {
+        if (addr == device_descriptor + DEVICE_DESC_PRODUCT_ID)
+            return LSB(usb_product_id);
+        if (addr == device_descriptor + DEVICE_DESC_PRODUCT_ID + 1)
+            return MSB(usb_product_id);
+    }
+#endif
+    return pgm_read_byte(addr);
+}
+
+// Carry out the data stage deferred, if the host is ready for it
+static inline void usb_ep0_stage(uint8_t intbits)
+{
+    uint8_t stage = ep0_stage;
+    uint8_t i;
+
+    if (stage >= EP0_RECEIVE_IGNORE)
+    {
+        if (!(intbits & (1<<RXOUTI)))
+            return;
+#if USE_FEATURE_REPORT
+        if (stage == EP0_RECEIVE_FEATURE)
+            simple_gamepad_feature_receive();
+#endif
+#if USE_LOOPBACK_PROBE
+        if (stage == EP0_RECEIVE_PROBE)
+            simple_gamepad_probe_receive();
+#endif
+        usb_ack_out();
+    }
+    else
+    {
+        if (!(intbits & (1<<TXINI)))
+            return;
+        if (stage == EP0_REPLY_BYTES)
+        {
+            for (i = 0; i < ep0_reply_len; i++)
+            {
+                UEDATX = ep0_reply[i];
+            }
+        }
+#if USE_FEATURE_REPORT
+        if (stage == EP0_REPLY_FEATURE)
+            simple_gamepad_feature_send(ep0_reply_len);
+#endif
+#if USE_KEYBOARD
+        if (stage == EP0_REPLY_KEYBOARD)
+        {
+            const uint8_t *report = (const uint8_t *)&g_keyboardState;
+
+            for (i = 0; i < KEYBOARD_REPORT_SIZE; i++)
+            {
+                UEDATX = report[i];
+            }
+        }
+#endif
+#if USE_SPLIT_REPORTS
+        if (stage == EP0_REPLY_ANALOG)
+            analog_report_write(&g_analogState);
+#endif
+        if (stage == EP0_REPLY_GAMEPAD)
+            gamepad_report_write(&g_gamepadState);
+    }
+    usb_send_in();
+    ep0_stage = EP0_NONE;
+    UEIENX = (1<<RXSTPE);
+}
+
+// Continue an endpoint 0 transfer, one packet per interrupt
+static inline void usb_ep0_continue(uint8_t intbits)
+{
+    uint8_t i, n;
+
+    if (ep0_new_address)
+    {
+        // the status stage of SET_ADDRESS has completed
+        if (intbits & (1<<TXINI))
+        {
+            UDADDR = ep0_new_address;
+            ep0_new_address = 0;
+            UEIENX = (1<<RXSTPE);
+        }
+        return;
+    }
+    if (ep0_stage)
+    {
+        usb_ep0_stage(intbits);
+        return;
+    }
+    if (intbits & (1<<RXOUTI))
+    {
+        UEIENX = (1<<RXSTPE);   // abort
+        return;
+    }
+    if (!(intbits & (1<<TXINI)))
+        return;
+#if USE_EEPROM_IDENTITY
+    // the EEPROM cannot be read while the main loop is writing it, the
+    // interrupt comes back here until the write has finished
+    if (ep0_desc_source == EP0_FROM_EEPROM && (EECR & (1<<EEPE)))
+        return;
+#endif
+    // send IN packet
+    n = ep0_desc_len < ENDPOINT0_SIZE ? ep0_desc_len : ENDPOINT0_SIZE;
+    for (i = n; i; i--)
+    {
+        UEDATX = usb_ep0_byte();
+    }
+    ep0_desc_len -= n;
+    usb_send_in();
+    // a full size last packet must be followed by a zero length one
+    if (!ep0_desc_len && n != ENDPOINT0_SIZE)
+        UEIENX = (1<<RXSTPE);
+}
+
 // USB Endpoint Interrupt - endpoint 0 is handled here.  The
 // other endpoints are manipulated by the user-callable
 // functions, and the start-of-frame interrupt.
@@ -374,7 +723,7 @@ ISR(USB_COM_vect)
     uint8_t intbits;
     const uint8_t *list;
     const uint8_t *cfg;
-    uint8_t i, n, len, en;
+    uint8_t i, len, en;
     uint8_t bmRequestType;
     uint8_t bRequest;
     uint16_t wValue;
@@ -384,10 +733,34 @@ ISR(USB_COM_vect)
     const uint8_t *desc_addr;
     uint8_t desc_length;
 
+#if USE_POLL_PHASE_TRACKING
+    // the gamepad endpoint only interrupts on NAKed polls, for the tracker
+    if (UEINT & (1<<GAMEPAD_ENDPOINT))
+    {
+        UENUM = GAMEPAD_ENDPOINT;
+        UEINTX = ~((1<<NAKINI) | (1<<KILLBK));
+        poll_phase_in_token();
+        if (!(UEINT & (1<<0)))
+        {
+            UENUM = 0;
+            return;
+        }
+    }
+#endif
+
     UENUM = 0;
     intbits = UEINTX;
+    if (!(intbits & (1<<RXSTPI)))
+    {
+        usb_ep0_continue(intbits);
+        return;
+    }
     if (intbits & (1<<RXSTPI))
     {
+        // a new request replaces any transfer still in progress
+        UEIENX = (1<<RXSTPE);
+        ep0_new_address = 0;
+        ep0_stage = EP0_NONE;
         bmRequestType = UEDATX;
         bRequest = UEDATX;
         wValue = UEDATX;
@@ -426,33 +799,41 @@ ISR(USB_COM_vect)
                 desc_length = pgm_read_byte(list);
                 break;
             }
+#if USE_EEPROM_IDENTITY
+            // the identity provisioned in EEPROM replaces the compiled one
+            ep0_desc_source = EP0_FROM_FLASH;
+            if (wValue == 0x0100)
+            {
+                ep0_desc_source = EP0_FROM_DEVICE;
+            }
+            else if (wValue == 0x0302 && usb_product_length)
+            {
+                desc_addr = IDENTITY_EEPROM(IDENTITY_PRODUCT);
+                desc_length = usb_product_length;
+                ep0_desc_source = EP0_FROM_EEPROM;
+            }
+            else if (wValue == 0x0303 && usb_serial_length)
+            {
+                desc_addr = IDENTITY_EEPROM(IDENTITY_SERIAL);
+                desc_length = usb_serial_length;
+                ep0_desc_source = EP0_FROM_EEPROM;
+            }
+#endif
             len = (wLength < 256) ? wLength : 255;
             if (len > desc_length) len = desc_length;
-            do
-            {
-                // wait for host ready for IN packet
-                do
-                {
-                    i = UEINTX;
-                } while (!(i & ((1<<TXINI)|(1<<RXOUTI))));
-                if (i & (1<<RXOUTI))
-                    return; // abort
-                // send IN packet
-                n = len < ENDPOINT0_SIZE ? len : ENDPOINT0_SIZE;
-                for (i = n; i; i--)
-                {
-                    UEDATX = pgm_read_byte(desc_addr++);
-                }
-                len -= n;
-                usb_send_in();
-            } while (len || n == ENDPOINT0_SIZE);
+            // the packets are sent from the following interrupts, each
+            // time the host is ready for one
+            ep0_desc_addr = desc_addr;
+            ep0_desc_len = len;
+            UEIENX = (1<<RXSTPE) | (1<<RXOUTE) | (1<<TXINE);
             return;
         }
         if (bRequest == SET_ADDRESS)
         {
+            // the address is applied once the host has read the status
             usb_send_in();
-            usb_wait_in_ready();
-            UDADDR = wValue | (1<<ADDEN);
+            ep0_new_address = wValue | (1<<ADDEN);
+            UEIENX = (1<<RXSTPE) | (1<<TXINE);
             return;
         }
         if (bRequest == SET_CONFIGURATION && bmRequestType == 0)
@@ -473,19 +854,21 @@ ISR(USB_COM_vect)
             }
             UERST = 0x1E;
             UERST = 0;
+#if USE_POLL_PHASE_TRACKING
+            UENUM = GAMEPAD_ENDPOINT;
+            UEIENX = (1<<NAKINE);
+            UENUM = 0;
+#endif
             return;
         }
         if (bRequest == GET_CONFIGURATION && bmRequestType == 0x80)
         {
-            usb_wait_in_ready();
-            UEDATX = usb_configuration;
-            usb_send_in();
+            usb_ep0_reply(usb_configuration, 0, 1);
             return;
         }
 
         if (bRequest == GET_STATUS)
         {
-            usb_wait_in_ready();
             i = 0;
             #ifdef SUPPORT_ENDPOINT_HALT
             if (bmRequestType == 0x82)
@@ -495,9 +878,7 @@ ISR(USB_COM_vect)
                 UENUM = 0;
             }
             #endif
-            UEDATX = i;
-            UEDATX = 0;
-            usb_send_in();
+            usb_ep0_reply(i, 0, 2);
             return;
         }
         #ifdef SUPPORT_ENDPOINT_HALT
@@ -529,26 +910,25 @@ ISR(USB_COM_vect)
             {
                 if (bRequest == HID_GET_REPORT)
                 {
-                    usb_wait_in_ready();
-                    UEDATX = g_gamepadState.x_axis;
-                    UEDATX = g_gamepadState.y_axis;
-                    for (i = 0; i < BUTTON_ARRAY_SIZE; i++)
-                        UEDATX = g_gamepadState.buttons[i];
-                    usb_send_in();
+#if USE_FEATURE_REPORT
+                    if ((wValue >> 8) == HID_REPORT_FEATURE)
+                    {
+                        ep0_reply_len = wLength < 256 ? wLength : 255;
+                        usb_ep0_defer(EP0_REPLY_FEATURE);
+                        return;
+                    }
+#endif
+                    usb_ep0_defer(EP0_REPLY_GAMEPAD);
                     return;
                 }
                 if (bRequest == HID_GET_IDLE)
                 {
-                    usb_wait_in_ready();
-                    UEDATX = gamepad_idle_config;
-                    usb_send_in();
+                    usb_ep0_reply(gamepad_idle_config, 0, 1);
                     return;
                 }
                 if (bRequest == HID_GET_PROTOCOL)
                 {
-                    usb_wait_in_ready();
-                    UEDATX = gamepad_protocol;
-                    usb_send_in();
+                    usb_ep0_reply(gamepad_protocol, 0, 1);
                     return;
                 }
             }
@@ -556,9 +936,28 @@ ISR(USB_COM_vect)
             {
                 if (bRequest == HID_SET_REPORT)
                 {
-                    usb_wait_receive_out();
-                    usb_ack_out();
-                    usb_send_in();
+#if USE_FEATURE_REPORT
+                    if ((wValue >> 8) == HID_REPORT_FEATURE)
+                    {
+                        // refused until the main loop has carried out
+                        // the previous request
+                        if (g_featurePending)
+                        {
+                            UECONX = (1<<STALLRQ) | (1<<EPEN);  // stall
+                            return;
+                        }
+                        usb_ep0_defer(EP0_RECEIVE_FEATURE);
+                        return;
+                    }
+#endif
+#if USE_LOOPBACK_PROBE
+                    if ((wValue >> 8) == HID_REPORT_OUTPUT)
+                    {
+                        usb_ep0_defer(EP0_RECEIVE_PROBE);
+                        return;
+                    }
+#endif
+                    usb_ep0_defer(EP0_RECEIVE_IGNORE);
                     return;
                 }
                 if (bRequest == HID_SET_IDLE)
@@ -575,6 +974,93 @@ ISR(USB_COM_vect)
                 }
             }
         }
+#if USE_KEYBOARD
+        if (wIndex == KEYBOARD_INTERFACE)
+        {
+            if (bmRequestType == 0xA1)
+            {
+                if (bRequest == HID_GET_REPORT)
+                {
+                    usb_ep0_defer(EP0_REPLY_KEYBOARD);
+                    return;
+                }
+                if (bRequest == HID_GET_IDLE)
+                {
+                    usb_ep0_reply(keyboard_idle_config, 0, 1);
+                    return;
+                }
+                if (bRequest == HID_GET_PROTOCOL)
+                {
+                    usb_ep0_reply(keyboard_protocol, 0, 1);
+                    return;
+                }
+            }
+            if (bmRequestType == 0x21)
+            {
+                if (bRequest == HID_SET_REPORT)
+                {
+                    // the LEDs output report a host may send, not used
+                    usb_ep0_defer(EP0_RECEIVE_IGNORE);
+                    return;
+                }
+                if (bRequest == HID_SET_IDLE)
+                {
+                    keyboard_idle_config = (wValue >> 8);
+                    usb_send_in();
+                    return;
+                }
+                if (bRequest == HID_SET_PROTOCOL)
+                {
+                    keyboard_protocol = wValue;
+                    usb_send_in();
+                    return;
+                }
+            }
+        }
+#endif
+#if USE_SPLIT_REPORTS
+        if (wIndex == ANALOG_INTERFACE)
+        {
+            if (bmRequestType == 0xA1)
+            {
+                if (bRequest == HID_GET_REPORT)
+                {
+                    usb_ep0_defer(EP0_REPLY_ANALOG);
+                    return;
+                }
+                if (bRequest == HID_GET_IDLE)
+                {
+                    usb_ep0_reply(analog_idle_config, 0, 1);
+                    return;
+                }
+                if (bRequest == HID_GET_PROTOCOL)
+                {
+                    usb_ep0_reply(analog_protocol, 0, 1);
+                    return;
+                }
+            }
+            if (bmRequestType == 0x21)
+            {
+                if (bRequest == HID_SET_REPORT)
+                {
+                    usb_ep0_defer(EP0_RECEIVE_IGNORE);
+                    return;
+                }
+                if (bRequest == HID_SET_IDLE)
+                {
+                    analog_idle_config = (wValue >> 8);
+                    usb_send_in();
+                    return;
+                }
+                if (bRequest == HID_SET_PROTOCOL)
+                {
+                    analog_protocol = wValue;
+                    usb_send_in();
+                    return;
+                }
+            }
+        }
+#endif
     }
     UECONX = (1<<STALLRQ) | (1<<EPEN);  // stall
 }
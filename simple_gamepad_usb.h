@@ -40,8 +40,17 @@
 #define SIMPLE_GAMEPAD_USB_H
 
 #include <stdint.h>
+#include <avr/io.h>
 
 #define GAMEPAD_ENDPOINT    1
+// the analog report, with USE_SPLIT_REPORTS
+#define ANALOG_ENDPOINT     3
+
+// the IN endpoint "kill bank" bit shares its position with RXOUTI, and
+// writing a 1 there on an IN endpoint kills the last written bank
+#ifndef KILLBK
+#define KILLBK  RXOUTI
+#endif
 
 void usb_init(void);            // initialize everything
 uint8_t usb_configured(void);   // is the USB port configured
@@ -0,0 +1,264 @@
+#!/usr/bin/env python3
+# Teensy Simple Gamepad - benchmark matrix over BUTTON_COUNT.
+#
+#   tools/avr_benchmark.py --mcu MCU [options] > benchmark.csv
+#
+# Builds the gamepad once for every BUTTON_COUNT (1 to the number of button
+# pins of the board, or the --counts given) and every variant, each in its
+# own copy of the sources under --workdir with simple_gamepad_config.h
+# changed, and prints one comma separated line per build:
+#
+#   button_count, mcu      the configuration
+#   variant                base: the configuration as it is
+#                          engine: with turbo on BTN1 to BTN32 (as many as
+#                          there are) and a macro of MACRO_MAX_STEPS steps
+#                          pressing them, to measure the turbo and macro
+#                          engine
+#   report_bytes           size of the input report
+#   flash, static_ram      bytes, as in tools/avr_footprint.py
+#   stack_static           static estimate of the worst-case stack bytes,
+#                          from the -fstack-usage files and the call graph,
+#                          main plus interrupt
+#   read_cycles_static     static estimate of simple_gampad_read_buttons,
+#                          worst path, for the worst remapping: its button
+#                          run loop taken once per pin button, every button
+#                          in a run of its own, as 'make wcet' checks it
+#   send_cycles_static     static estimate of usb_simple_gamepad_send,
+#                          worst path with each of its loops taken once per
+#                          report byte, which covers copying the report and
+#                          the bank kill checks; it never waits for the
+#                          host, so this is a worst case
+#   stack_used             stack high-water mark measured on a gamepad,
+#                          with --load only (empty otherwise)
+#
+# The static estimates come from tools/avr_footprint.py and the analysis
+# of tools/avr_wcet.py on the built code, not from running it: they do not
+# depend on the input pattern, and two runs of the same sources give the
+# same table. Comparing the tables of two revisions (e.g. with diff) shows
+# which configurations a change made bigger or slower.
+#
+# With --load CMD, each configuration is also built with USE_STACK_MONITOR
+# and loaded onto a gamepad connected through USB by running CMD with the
+# .hex file as its last argument (e.g. --load 'teensy_loader_cli
+# --mcu=atmega32u4 -w'). Once the gamepad is back, it runs for --settle
+# seconds (press its buttons meanwhile for the worst case) and the most
+# stack it used is read as tools/gamepad_stack.py does (Linux hidraw).
+#
+# Other options can be set for every build with --set NAME=VALUE, e.g.
+# --set DPAD_MODE=DPAD_HAT.
+
+import argparse
+import glob
+import os
+import re
+import shutil
+import subprocess
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import avr_footprint
+import avr_wcet
+import gamepad_remap
+import gamepad_stack
+
+TREE = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+PIN_BUTTONS = {
+    'at90usb162': 16,
+    'atmega32u4': 20,
+    'at90usb646': 41,
+    'at90usb1286': 41,
+}
+READ_FUNC = 'simple_gampad_read_buttons'
+SEND_FUNC = 'usb_simple_gamepad_send'
+TURBO_FUNC = 'simple_gamepad_turbo_apply'
+# the send and the functions it calls with loops over the report bytes, or
+# the KILLBK checks of a bank kill (KILLBK_SPINS in simple_gamepad_defs.h)
+SEND_FUNCS = (SEND_FUNC, 'usb_fresh_banks')
+KILLBK_SPINS = 8
+COLUMNS = ('button_count', 'mcu', 'variant', 'report_bytes', 'flash', 'static_ram',
+           'stack_static', 'read_cycles_static', 'send_cycles_static', 'stack_used')
+VARIANTS = ('base', 'engine')
+
+
+def variant_settings(variant, count):
+    """returns the configuration options of a variant"""
+    if variant == 'base':
+        return []
+    mask = '0x%08X' % ((1 << min(count, 32)) - 1)
+    # every step presses the buttons, so the longest macro plays through
+    steps = ', '.join('{ %s, 1 }' % mask
+                      for _ in range(config_value(TREE, 'MACRO_MAX_STEPS')))
+    return [('TURBO_BUTTONS', mask), ('MACRO_COUNT', '1'),
+            ('MACRO_TABLE', 'MACRO_ENTRY(%d, { %s })' % (count, steps))]
+
+
+def prepare(workdir, count, settings):
+    """copies the sources into workdir and sets the configuration there"""
+    if os.path.isdir(workdir):
+        shutil.rmtree(workdir)
+    os.makedirs(workdir)
+    for path in glob.glob(os.path.join(TREE, '*.[ch]')) + [os.path.join(TREE, 'Makefile')]:
+        shutil.copy(path, workdir)
+    config = os.path.join(workdir, 'simple_gamepad_config.h')
+    with open(config) as f:
+        text = f.read()
+    for name, value in [('BUTTON_COUNT', str(count))] + settings:
+        # MACRO_TABLE is defined empty, with no value to replace
+        text, n = re.subn(r'^(#define\s+%s)\b.*$' % name,
+                          lambda m: m.group(1) + ' ' + value, text, flags=re.M)
+        if n != 1:
+            sys.exit('%s not found in simple_gamepad_config.h' % name)
+    with open(config, 'w') as f:
+        f.write(text)
+
+
+def symbol_size(nm_prog, elf, name):
+    for line in avr_footprint.run([nm_prog, '-S', elf]).splitlines():
+        f = line.split()
+        if len(f) == 4 and f[3] == name:
+            return int(f[1], 16)
+    return 0
+
+
+def config_value(workdir, name):
+    with open(os.path.join(workdir, 'simple_gamepad_config.h')) as f:
+        m = re.search(r'^#define\s+%s\s+(\w+)' % name, f.read(), re.M)
+    return int(m.group(1), 0)
+
+
+def measure(args, workdir, count, variant):
+    elf = os.path.join(workdir, 'simple_gamepad.elf')
+    su = glob.glob(os.path.join(workdir, '*.su'))
+    fp = avr_footprint.measure(elf, su, args.size, args.objdump)
+
+    listing = avr_footprint.run([args.objdump, '-d', elf]).splitlines()
+    funcs, addr_to_func = avr_wcet.parse(listing)
+    pins = min(count, PIN_BUTTONS[args.mcu])
+    # the turbo and macro loops run over the macro steps or the mask bytes,
+    # and the turbo phase takes a 16-bit division (17 trips)
+    report_bytes = symbol_size(args.nm, elf, 'g_gamepadState')
+    bounds = {READ_FUNC: max(pins, 1),
+              TURBO_FUNC: max(config_value(workdir, 'MACRO_MAX_STEPS'), 5),
+              '__udivmodhi4': 17}
+    for func in SEND_FUNCS:
+        bounds[func] = max(report_bytes, KILLBK_SPINS)
+    an = avr_wcet.Analyzer(funcs, addr_to_func, bounds)
+
+    def cycles(func):
+        total = an.function_cycles(func)
+        return 'no bound' if func in an.unbounded else total
+
+    return {
+        'button_count': count,
+        'mcu': args.mcu,
+        'variant': variant,
+        'report_bytes': report_bytes,
+        'flash': fp['flash'],
+        'static_ram': fp['static_ram'],
+        'stack_static': fp['stack'],
+        'read_cycles_static': cycles(READ_FUNC),
+        'send_cycles_static': cycles(SEND_FUNC),
+        'stack_used': '',
+    }
+
+
+def build(args, workdir, count, settings):
+    prepare(workdir, count, settings)
+    targets = ['elf', 'hex'] if args.load else ['elf']
+    result = subprocess.run([args.make, '-C', workdir, 'MCU=' + args.mcu] + targets,
+                            stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                            universal_newlines=True)
+    if result.returncode != 0:
+        sys.stderr.write(result.stdout)
+    return result.returncode == 0
+
+
+def stack_used(args, workdir):
+    """loads the build in workdir onto the gamepad, and reads the most stack
+    it used after --settle seconds, or returns None"""
+    hexfile = os.path.join(workdir, 'simple_gamepad.hex')
+    if subprocess.run(args.load.split() + [hexfile]).returncode != 0:
+        return None
+    # the gamepad reboots into the new build and enumerates again
+    deadline = time.time() + 10
+    device = None
+    while device is None and time.time() < deadline:
+        time.sleep(0.5)
+        device = gamepad_remap.find_device(args.vid, args.pid)
+    if device is None:
+        return None
+    time.sleep(args.settle)
+    fd = os.open(device, os.O_RDWR)
+    try:
+        used, _ = gamepad_stack.read_stack(fd)
+    finally:
+        os.close(fd)
+    return used
+
+
+def parse_counts(text):
+    counts = []
+    for part in text.split(','):
+        first, _, last = part.partition('-')
+        counts.extend(range(int(first), int(last or first) + 1))
+    return counts
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Gamepad benchmark over BUTTON_COUNT")
+    ap.add_argument('--mcu', default='atmega32u4', choices=sorted(PIN_BUTTONS))
+    ap.add_argument('--counts', help='button counts, e.g. 1-20 or 1,8,16 '
+                    '(default 1 to the number of button pins)')
+    ap.add_argument('--set', action='append', default=[], metavar='NAME=VALUE',
+                    help='configuration option for every build')
+    ap.add_argument('--workdir', default='_benchmark')
+    ap.add_argument('--make', default='make')
+    ap.add_argument('--size', default='avr-size')
+    ap.add_argument('--objdump', default='avr-objdump')
+    ap.add_argument('--nm', default='avr-nm')
+    ap.add_argument('--no-header', action='store_true')
+    ap.add_argument('--load', metavar='CMD',
+                    help='command loading a .hex onto the gamepad, to measure its stack')
+    ap.add_argument('--settle', type=float, default=5.0,
+                    help='seconds the gamepad runs before its stack is read')
+    ap.add_argument('--vid', type=lambda s: int(s, 0), default=0x16C0)
+    ap.add_argument('--pid', type=lambda s: int(s, 0), default=0x047A)
+    args = ap.parse_args()
+
+    counts = parse_counts(args.counts) if args.counts else \
+        range(1, PIN_BUTTONS[args.mcu] + 1)
+    settings = [tuple(item.split('=', 1)) for item in args.set]
+
+    if not args.no_header:
+        print(','.join(COLUMNS))
+    failed = 0
+    for count in counts:
+        for variant in VARIANTS:
+            workdir = os.path.join(args.workdir, '%s-%d-%s' % (args.mcu, count, variant))
+            options = settings + variant_settings(variant, count)
+            if not build(args, workdir, count, options):
+                sys.stderr.write('BUTTON_COUNT %d, %s: build failed\n' % (count, variant))
+                failed += 1
+                continue
+            row = measure(args, workdir, count, variant)
+            if args.load:
+                # the monitor adds code, so it is measured in a build of its own
+                monitored = workdir + '-stack'
+                used = None
+                if build(args, monitored, count, options + [('USE_STACK_MONITOR', '1')]):
+                    used = stack_used(args, monitored)
+                if used is None:
+                    sys.stderr.write('BUTTON_COUNT %d, %s: stack not measured\n'
+                                     % (count, variant))
+                    failed += 1
+                else:
+                    row['stack_used'] = used
+            print(','.join(str(row[c]) for c in COLUMNS))
+            sys.stdout.flush()
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+# Teensy Simple Gamepad - flash, RAM and stack budget report for a build.
+#
+#   tools/avr_footprint.py --mcu MCU simple_gamepad.elf *.su [options]
+#
+# Flash is .text plus .data (its initial values are stored in flash). RAM
+# is .data, .bss and .noinit, plus the stack: the deepest call chain from
+# main, then the deepest from any interrupt handler on top of it, each
+# function taking its frame from the -fstack-usage (.su) files and 2 bytes
+# for its return address (interrupts also push the status register and the
+# registers they use, which the .su frames of handlers already count).
+# Calls through a pointer cannot be followed and are reported.
+#
+# The budgets default to what the board leaves to the program (the Teensy
+# bootloader takes the top of the flash) and make the report fail (exit
+# status 1) when exceeded:
+#   --flash-budget N      bytes of flash
+#   --ram-budget N        bytes of RAM, static data and stack together
+#
+# --csv prints the report as one line of comma separated values, after a
+# header line unless --no-header is given, to collect several builds into
+# one table.
+
+import argparse
+import re
+import subprocess
+import sys
+
+# flash left by the bootloader, RAM
+BOARDS = {
+    'at90usb162': (16384 - 512, 512),
+    'atmega32u4': (32768 - 512, 2560),
+    'at90usb646': (65536 - 1024, 4096),
+    'at90usb1286': (131072 - 1024, 8192),
+}
+RETURN_ADDRESS = 2
+
+FUNC_RE = re.compile(r'^([0-9a-f]+) <([^>]+)>:$')
+CALL_RE = re.compile(r'^\s*[0-9a-f]+:\t(?:[0-9a-f]{2} )+\s*\t?(r?call|icall|eicall)\b[^;]*(?:;\s*0x[0-9a-f]+ <([^>+]+)>)?')
+
+
+def run(cmd):
+    return subprocess.check_output(cmd, universal_newlines=True)
+
+
+def sections(size_prog, elf):
+    sizes = {}
+    for line in run([size_prog, '-A', elf]).splitlines():
+        f = line.split()
+        if len(f) >= 2 and f[0].startswith('.') and f[1].isdigit():
+            sizes[f[0]] = int(f[1])
+    return sizes
+
+
+def frames(su_files):
+    # file.c:line:col:name<tab>bytes<tab>static|dynamic,bounded
+    frame = {}
+    dynamic = set()
+    for path in su_files:
+        with open(path) as f:
+            for line in f:
+                fields = line.rstrip('\n').split('\t')
+                if len(fields) < 3:
+                    continue
+                name = fields[0].rsplit(':', 1)[-1]
+                frame[name] = max(frame.get(name, 0), int(fields[1]))
+                if not fields[2].startswith('static'):
+                    dynamic.add(name)
+    return frame, dynamic
+
+
+def call_graph(objdump_prog, elf):
+    calls = {}
+    indirect = set()
+    name = None
+    for line in run([objdump_prog, '-d', elf]).splitlines():
+        m = FUNC_RE.match(line)
+        if m:
+            name = m.group(2)
+            calls.setdefault(name, set())
+            continue
+        m = CALL_RE.match(line)
+        if m and name:
+            if m.group(2):
+                calls[name].add(m.group(2))
+            else:
+                indirect.add(name)
+    return calls, indirect
+
+
+def deepest(name, calls, frame, path=()):
+    """returns the stack depth of the deepest chain from name, and the chain"""
+    if name in path:
+        return 0, [name + ' (recursion)']
+    best, chain = 0, []
+    for callee in sorted(calls.get(name, ())):
+        depth, sub = deepest(callee, calls, frame, path + (name,))
+        if depth > best:
+            best, chain = depth, sub
+    return frame.get(name, 0) + RETURN_ADDRESS + best, [name] + chain
+
+
+def measure(elf, su_files, size_prog='avr-size', objdump_prog='avr-objdump'):
+    """returns the flash, RAM and stack used by a build, in a dict"""
+    sizes = sections(size_prog, elf)
+    frame, dynamic = frames(su_files)
+    calls, indirect = call_graph(objdump_prog, elf)
+
+    m = {}
+    m['data'] = sizes.get('.data', 0)
+    m['bss'] = sizes.get('.bss', 0) + sizes.get('.noinit', 0)
+    m['flash'] = sizes.get('.text', 0) + m['data']
+    m['static_ram'] = m['data'] + m['bss']
+    m['stack_main'], m['main_chain'] = deepest('main', calls, frame)
+    m['stack_isr'], m['isr_chain'] = 0, []
+    for name in calls:
+        if name.startswith('__vector_') and name != '__vector_default':
+            depth, chain = deepest(name, calls, frame)
+            if depth > m['stack_isr']:
+                m['stack_isr'], m['isr_chain'] = depth, chain
+    m['stack'] = m['stack_main'] + m['stack_isr']
+    m['ram'] = m['static_ram'] + m['stack']
+    m['unbounded'] = [(name, 'call through pointer' if name in indirect else 'dynamic frame')
+                      for name in sorted(indirect | dynamic)]
+    return m
+
+
+def main():
+    ap = argparse.ArgumentParser(description="AVR flash, RAM and stack budget report")
+    ap.add_argument('elf')
+    ap.add_argument('su', nargs='*', help='-fstack-usage files of the build')
+    ap.add_argument('--mcu', required=True, choices=sorted(BOARDS))
+    ap.add_argument('--name', default='', help='configuration name for the report')
+    ap.add_argument('--size', default='avr-size', help='avr-size program')
+    ap.add_argument('--objdump', default='avr-objdump', help='avr-objdump program')
+    ap.add_argument('--flash-budget', type=int)
+    ap.add_argument('--ram-budget', type=int)
+    ap.add_argument('--csv', action='store_true')
+    ap.add_argument('--no-header', action='store_true')
+    args = ap.parse_args()
+
+    flash_budget, ram_budget = BOARDS[args.mcu]
+    if args.flash_budget is not None:
+        flash_budget = args.flash_budget
+    if args.ram_budget is not None:
+        ram_budget = args.ram_budget
+
+    m = measure(args.elf, args.su, args.size, args.objdump)
+    ok = m['flash'] <= flash_budget and m['ram'] <= ram_budget
+
+    if args.csv:
+        if not args.no_header:
+            print('config,mcu,flash,flash_budget,data,bss,static_ram,'
+                  'stack_main,stack_isr,stack,ram,ram_budget,ok')
+        print(','.join(str(v) for v in (
+            args.name, args.mcu, m['flash'], flash_budget, m['data'], m['bss'],
+            m['static_ram'], m['stack_main'], m['stack_isr'], m['stack'],
+            m['ram'], ram_budget, int(ok))))
+    else:
+        if args.name:
+            print('configuration %s' % args.name)
+        print('flash  %6d of %6d bytes  (%.1f%%)'
+              % (m['flash'], flash_budget, 100.0 * m['flash'] / flash_budget))
+        print('RAM    %6d of %6d bytes  (%.1f%%)'
+              % (m['ram'], ram_budget, 100.0 * m['ram'] / ram_budget))
+        print('  static %5d  (.data %d, .bss %d)' % (m['static_ram'], m['data'], m['bss']))
+        print('  stack  %5d  (main %d, interrupt %d)'
+              % (m['stack'], m['stack_main'], m['stack_isr']))
+        print('    main:      %s' % ' > '.join(m['main_chain']))
+        if m['isr_chain']:
+            print('    interrupt: %s' % ' > '.join(m['isr_chain']))
+    for name, why in m['unbounded']:
+        sys.stderr.write('warning: stack of %s not bounded (%s)\n' % (name, why))
+    if not ok:
+        sys.stderr.write('footprint over budget\n')
+    return 0 if ok else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,409 @@
+#!/usr/bin/env python3
+# Teensy Simple Gamepad - worst-case execution time and interrupt latency
+# check, by static analysis of an avr-objdump disassembly.
+#
+#   avr-objdump -d simple_gamepad.elf | tools/avr_wcet.py [options]
+#
+# For each function the longest path through its control flow is found,
+# counting the cycles of every instruction on it (including the functions
+# it calls). The loops of FUNC are counted N times through their body with
+# --loop-bound FUNC=N: every loop on the path adds N - 1 more trips round
+# its body (all of its instructions and the functions they call), times the
+# trips of the loops it is nested in. With --loop-bound FUNC=N,M,... the
+# loops nested in one other are counted M times, and so on, the last number
+# given applying to any deeper. The delay loops of _delay_us and _delay_ms
+# need no bound: their trips are read from the counter they load. A function with a loop and no --loop-bound, or that
+# calls one, has no static bound: loops that poll the hardware (waiting
+# for the host to collect a bank, for a bank to be killed, for the control
+# endpoint) run for as long as the host takes. Such a function shows 'no
+# bound' instead of its cycles, as does an interrupts-disabled window
+# running through one.
+#
+# Interrupts are disabled for the whole of every interrupt handler
+# (__vector_N, from the vector jump to reti or sei), and from every cli to
+# the following sei, SREG restore (out 0x3f), ret or reti. The longest of
+# all these windows is the worst latency any interrupt can see.
+#
+# Budgets, in cycles, make the check fail (exit status 1) when exceeded,
+# or when what they apply to has no bound:
+#   --irq-off-budget N    longest interrupts-disabled window
+#   --isr-budget N        any interrupt handler
+#   --func NAME=N         a named function, e.g. simple_gampad_read_buttons
+
+import argparse
+import re
+import sys
+
+# cycles for AVRe+ cores with a 16-bit program counter (ATmega32U4,
+# AT90USB162/646/1286); anything not listed takes 1
+CYCLES = {
+    'adiw': 2, 'sbiw': 2, 'mul': 2, 'muls': 2, 'mulsu': 2,
+    'fmul': 2, 'fmuls': 2, 'fmulsu': 2,
+    'ld': 2, 'ldd': 2, 'lds': 2, 'st': 2, 'std': 2, 'sts': 2,
+    'push': 2, 'pop': 2, 'cbi': 2, 'sbi': 2,
+    'lpm': 3, 'elpm': 3,
+    'rjmp': 2, 'ijmp': 2, 'eijmp': 2, 'jmp': 3,
+    'rcall': 3, 'icall': 3, 'eicall': 4, 'call': 4,
+    'ret': 4, 'reti': 4,
+}
+SKIPS = ('cpse', 'sbrc', 'sbrs', 'sbic', 'sbis')
+# interrupt response plus the jmp in the vector table
+ISR_ENTRY_CYCLES = 5 + 3
+
+FUNC_RE = re.compile(r'^([0-9a-f]+) <([^>]+)>:$')
+INSN_RE = re.compile(r'^\s*([0-9a-f]+):\t((?:[0-9a-f]{2} )+)\s*\t?(\S+)\s*([^;]*)(?:;\s*(0x[0-9a-f]+))?')
+
+
+class Insn(object):
+    def __init__(self, addr, size, op, args, target):
+        self.addr = addr
+        self.size = size
+        self.op = op
+        self.args = args.strip()
+        self.target = target
+
+
+def parse(lines):
+    funcs = {}
+    order = []
+    name = None
+    for line in lines:
+        line = line.rstrip('\n')
+        m = FUNC_RE.match(line)
+        if m:
+            name = m.group(2)
+            funcs[name] = {}
+            order.append((int(m.group(1), 16), name))
+            continue
+        m = INSN_RE.match(line)
+        if m and name:
+            addr = int(m.group(1), 16)
+            size = len(m.group(2).split())
+            target = int(m.group(5), 16) if m.group(5) else None
+            if target is None and m.group(3) in ('rjmp', 'rcall', 'jmp', 'call') \
+                    or m.group(3).startswith('br'):
+                # relative targets print as ".+N" / ".-N" with the
+                # absolute address in the comment; fall back on the operand
+                t = re.search(r'0x([0-9a-f]+)', m.group(4))
+                if t:
+                    target = int(t.group(1), 16)
+            funcs[name][addr] = Insn(addr, size, m.group(3), m.group(4), target)
+    addr_to_func = dict(order)
+    return funcs, addr_to_func
+
+
+class Analyzer(object):
+    def __init__(self, funcs, addr_to_func, loop_bounds):
+        self.funcs = funcs
+        self.addr_to_func = addr_to_func
+        self.loop_bounds = loop_bounds
+        self.memo = {}
+        self.loop_memo = {}
+        self.extra_memo = {}
+        # the trips of the delay loops, by function and first instruction
+        self.delay_loops = {}
+        self.notes = {}
+        self.unbounded = set()
+        # one flag per longest() in progress, set by an unbounded loop or call
+        self.open = []
+
+    def note(self, func, text):
+        self.notes.setdefault(func, set()).add(text)
+
+    def successors(self, func, insn):
+        # (next address or None for exit, extra cycles on that edge)
+        code = self.funcs[func]
+        op = insn.op
+        nxt = insn.addr + insn.size
+        base = CYCLES.get(op, 1)
+        if op in ('ret', 'reti'):
+            return [(None, base)]
+        if op in ('rjmp', 'jmp'):
+            if insn.target in code:
+                return [(insn.target, base)]
+            # tail call into another function
+            return [(None, base + self.function_cycles(self.func_at(insn.target)))]
+        if op in ('ijmp', 'eijmp', 'icall', 'eicall'):
+            self.note(func, 'indirect jump/call not followed')
+            return [(nxt if op.endswith('call') else None, base)]
+        if op in ('rcall', 'call'):
+            callee = self.func_at(insn.target)
+            return [(nxt, base + self.function_cycles(callee))]
+        if op.startswith('br'):
+            return [(nxt, 1), (insn.target, 2)]
+        if op in SKIPS:
+            skipped = code.get(nxt)
+            size = skipped.size if skipped else 1
+            return [(nxt, 1), (nxt + size, 1 + size // 2)]
+        return [(nxt, base)]
+
+    def func_at(self, addr):
+        return self.addr_to_func.get(addr)
+
+    def function_cycles(self, func):
+        if func is None or func not in self.funcs:
+            return 0
+        if func not in self.memo:
+            self.memo[func] = None      # recursion guard
+            code = self.funcs[func]
+            start = min(code) if code else 0
+            cycles = self.longest(func, start, ())
+            if self.last_unbounded:
+                self.unbounded.add(func)
+            self.memo[func] = cycles
+        if func in self.unbounded and self.open:
+            self.open[-1] = True
+        return self.memo[func] or 0
+
+    def bound(self, func, depth):
+        """trips of the loops of func nested in depth others, None if not
+        given"""
+        bounds = self.loop_bounds.get(func)
+        if bounds is None:
+            return None
+        if isinstance(bounds, int):
+            return bounds
+        return bounds[min(depth, len(bounds) - 1)]
+
+    def loops(self, func):
+        """the loops of func, by the instruction they are entered at: the
+        instructions of each, those that reach a back edge without passing
+        that one"""
+        if func in self.loop_memo:
+            return self.loop_memo[func]
+        code = self.funcs[func]
+        preds = {}
+        back = {}
+        seen = set()
+        onstack = set()
+
+        def dfs(addr):
+            seen.add(addr)
+            onstack.add(addr)
+            for nxt, _ in self.successors(func, code[addr]):
+                if nxt is None or nxt not in code:
+                    continue
+                preds.setdefault(nxt, set()).add(addr)
+                if nxt in onstack:
+                    back.setdefault(nxt, []).append(addr)
+                elif nxt not in seen:
+                    dfs(nxt)
+            onstack.discard(addr)
+
+        if code:
+            dfs(min(code))
+        loops = {}
+        for head, tails in back.items():
+            body = set([head])
+            work = list(tails)
+            while work:
+                a = work.pop()
+                if a not in body:
+                    body.add(a)
+                    work.extend(preds.get(a, ()))
+            loops[head] = body
+            trips = self.delay_trips(code, head, body)
+            if trips:
+                self.delay_loops[(func, head)] = trips
+        self.loop_memo[func] = loops
+        return loops
+
+    def delay_trips(self, code, head, body):
+        """the trips of a delay loop (_delay_us, _delay_ms): a counter of
+        one to three registers loaded with ldi just before the loop and
+        counted down to 0 by it, with nothing else in it. None for any
+        other loop"""
+        counter = []
+        for a in sorted(body):
+            insn = code[a]
+            regs = re.findall(r'r(\d+)', insn.args)
+            if insn.op == 'sbiw' and regs:
+                counter += [int(regs[0]), int(regs[0]) + 1]
+            elif insn.op in ('dec', 'subi', 'sbci') and regs:
+                counter.append(int(regs[0]))
+            elif insn.op not in ('brne', 'nop'):
+                return None
+        loaded = {}
+        before = sorted(a for a in code if a < head)
+        while before and code[before[-1]].op == 'ldi':
+            m = re.match(r'r(\d+),\s*(0x[0-9a-fA-F]+|\d+)', code[before.pop()].args)
+            if m:
+                loaded.setdefault(int(m.group(1)), int(m.group(2), 0))
+        if not counter or any(r not in loaded for r in counter):
+            return None
+        trips = 0
+        for i, r in enumerate(counter):
+            trips |= loaded[r] << (8 * i)
+        return trips or 1 << (8 * len(counter))
+
+    def loop_extra(self, func, head):
+        """the cycles of the trips after the first round the loop entered
+        at head, 0 if there is none there or it has no bound; one trip
+        counts every instruction of the loop once, its branches taken,
+        the functions it calls and the extra trips of the loops nested in
+        it"""
+        loops = self.loops(func)
+        if head not in loops:
+            return 0
+        key = (func, head)
+        if key not in self.extra_memo:
+            body = loops[head]
+            depth = sum(1 for h, b in loops.items() if h != head and head in b)
+            bound = self.delay_loops.get(key) or self.bound(func, depth)
+            cycles = 0
+            if bound is not None:
+                code = self.funcs[func]
+                for a in body:
+                    insn = code[a]
+                    cycles += 2 if insn.op.startswith('br') else CYCLES.get(insn.op, 1)
+                    if insn.op in ('rcall', 'call'):
+                        cycles += self.function_cycles(self.func_at(insn.target))
+                    if a != head:
+                        cycles += self.loop_extra(func, a)
+                cycles *= bound - 1
+            self.extra_memo[key] = cycles
+        return self.extra_memo[key]
+
+    def longest(self, func, start, stops):
+        """Longest path from start to an exit, or to (and including) an
+        instruction whose mnemonic/args match one of stops."""
+        code = self.funcs[func]
+        best = {}
+        onstack = set()
+        bounded = func in self.loop_bounds
+        self.loops(func)
+
+        def visit(addr):
+            if addr in best:
+                return best[addr]
+            insn = code.get(addr)
+            if insn is None:
+                return 0
+            if addr != start and stop_here(insn):
+                best[addr] = CYCLES.get(insn.op, 1)
+                return best[addr]
+            onstack.add(addr)
+            worst = 0
+            for nxt, cost in self.successors(func, insn):
+                if nxt is None:
+                    total = cost
+                elif nxt in onstack:
+                    # back edge: the trips after the first are counted
+                    # where the loop is entered
+                    total = cost
+                    if not bounded and (func, nxt) not in self.delay_loops:
+                        self.note(func, 'loop with no --loop-bound')
+                        self.open[-1] = True
+                else:
+                    total = cost + visit(nxt)
+                worst = max(worst, total)
+            onstack.discard(addr)
+            best[addr] = worst + self.loop_extra(func, addr)
+            return best[addr]
+
+        def stop_here(insn):
+            for op, args in stops:
+                if insn.op == op and (args is None or insn.args.replace(' ', '') == args):
+                    return True
+            return False
+
+        self.open.append(False)
+        result = visit(start)
+        self.last_unbounded = self.open.pop()
+        return result
+
+
+def main():
+    ap = argparse.ArgumentParser(description="AVR WCET and interrupt latency check")
+    ap.add_argument('listing', nargs='?', help='avr-objdump -d output (default stdin)')
+    ap.add_argument('--f-cpu', type=float, default=16e6)
+    ap.add_argument('--irq-off-budget', type=int)
+    ap.add_argument('--isr-budget', type=int)
+    ap.add_argument('--func', action='append', default=[], metavar='NAME[=BUDGET]')
+    ap.add_argument('--loop-bound', action='append', default=[], metavar='FUNC=N[,M...]')
+    args = ap.parse_args()
+    # the paths are followed an instruction per call
+    sys.setrecursionlimit(100000)
+
+    lines = open(args.listing) if args.listing else sys.stdin
+    funcs, addr_to_func = parse(lines)
+    bounds = {}
+    for item in args.loop_bound:
+        name, n = item.split('=')
+        bounds[name] = [int(x) for x in n.split(',')]
+    an = Analyzer(funcs, addr_to_func, bounds)
+
+    def us(c):
+        return c * 1e6 / args.f_cpu
+
+    def cycles(c):
+        return 'no bound' if c is None else '%d cycles' % c
+
+    failed = []
+    rows = []
+
+    # interrupt handlers: disabled from entry to reti, or to an early sei
+    isrs = sorted(f for f in funcs if re.match(r'__vector_\d+$', f))
+    irq_off = []
+    for f in isrs:
+        total = an.function_cycles(f) + ISR_ENTRY_CYCLES
+        if f in an.unbounded:
+            total = None
+        window = an.longest(f, min(funcs[f]), [('sei', None)]) + ISR_ENTRY_CYCLES
+        rows.append(('isr', f, total))
+        irq_off.append((None if an.last_unbounded else window, f))
+        if args.isr_budget is not None and (total is None or total > args.isr_budget):
+            failed.append('%s: %s > isr budget %d' % (f, cycles(total), args.isr_budget))
+
+    # cli sections anywhere
+    for f, code in funcs.items():
+        for addr, insn in sorted(code.items()):
+            if insn.op == 'cli':
+                window = an.longest(f, addr, [('sei', None), ('out', '0x3f,r0'), ('ret', None),
+                                              ('reti', None)] +
+                                    [('out', '0x3f,r%d' % r) for r in range(32)])
+                irq_off.append((None if an.last_unbounded else window,
+                                '%s+0x%x' % (f, addr - min(code))))
+
+    for item in args.func:
+        name, _, budget = item.partition('=')
+        if name not in funcs:
+            failed.append('%s: not found' % name)
+            continue
+        total = an.function_cycles(name)
+        if name in an.unbounded:
+            total = None
+        rows.append(('func', name, total))
+        if budget and (total is None or total > int(budget)):
+            failed.append('%s: %s > budget %s' % (name, cycles(total), budget))
+
+    def line(kind, name, total):
+        if total is None:
+            return '%-5s %-40s %8s' % (kind, name, 'no bound')
+        return '%-5s %-40s %8d %9.2f' % (kind, name, total, us(total))
+
+    print('%-5s %-40s %8s %9s' % ('kind', 'name', 'cycles', 'us'))
+    for kind, name, total in rows:
+        print(line(kind, name, total))
+    # the windows with no bound first
+    irq_off.sort(key=lambda w: (w[0] is None, w[0] or 0), reverse=True)
+    for window, where in irq_off[:10]:
+        print(line('irqof', where, window))
+    worst = irq_off[0][0] if irq_off else 0
+    if worst is None:
+        print('worst interrupts-disabled window: no bound')
+    else:
+        print('worst interrupts-disabled window: %d cycles (%.2f us)' % (worst, us(worst)))
+    for name, notes in sorted(an.notes.items()):
+        print('note: %s: %s' % (name, ', '.join(sorted(notes))))
+
+    if args.irq_off_budget is not None and (worst is None or worst > args.irq_off_budget):
+        failed.append('interrupts-disabled window: %s > budget %d'
+                      % (cycles(worst), args.irq_off_budget))
+    for f in failed:
+        print('FAIL: ' + f)
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
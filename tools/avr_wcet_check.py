@@ -0,0 +1,173 @@
+#!/usr/bin/env python3
+# Teensy Simple Gamepad - checks of the static timing analysis of
+# tools/avr_wcet.py against canned disassemblies.
+#
+#   tools/avr_wcet_check.py [-v]
+#
+# Runs the analysis on a few small functions in the form avr-objdump -d
+# prints them, whose cycles are counted by hand below, and compares. Prints
+# one line per check, PASS or FAIL with the cycles found (and the listing
+# with -v), and exits non-zero if any failed.
+#
+#   two_loops      two loops one after the other each add their trips
+#   nested_loops   an inner loop runs its trips for each trip of the outer
+#                  one
+#   nested_bounds  the same with bounds of their own, 2 trips of the outer
+#                  loop and 3 of the inner one
+#   loop_call      a loop counts the function it calls on every trip
+#   rotated_loop   a loop entered at its test, as the compiler lays out most
+#   either_loop    of two loops on different paths, only one is counted
+#   wait_loop      a loop with no --loop-bound has no bound, nor has its
+#                  caller
+#   delay_loop     the delay loops of _delay_us need no --loop-bound,
+#                  inside a loop that has one or not
+
+import argparse
+import os
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import avr_wcet
+
+# (name, listing, --loop-bound of each function, function checked, cycles
+# expected, or None for no bound)
+CHECKS = [
+    # 1 + 2 x (4 trips: 3 x (1 + 1 + 2) taken + 3) + 4
+    ('two_loops', '''
+00000000 <two_loops>:
+   0:\t80 e0       \tldi\tr24, 0x00\t; 0
+   2:\t8f 5f       \tsubi\tr24, 0xFF\t; 255
+   4:\t84 30       \tcpi\tr24, 0x04\t; 4
+   6:\te9 f7       \tbrne\t.-6      \t; 0x2 <two_loops+0x2>
+   8:\t90 e0       \tldi\tr25, 0x00\t; 0
+   a:\t9f 5f       \tsubi\tr25, 0xFF\t; 255
+   c:\t94 30       \tcpi\tr25, 0x04\t; 4
+   e:\te9 f7       \tbrne\t.-6      \t; 0xa <two_loops+0xa>
+  10:\t08 95       \tret
+''', {'two_loops': 4}, 'two_loops', 36),
+    # 3 trips of the outer loop, each with 3 of the inner one: 52 cycles,
+    # counted 54 as the last inner branch of each outer trip is not taken
+    ('nested_loops', '''
+00000000 <nested_loops>:
+   0:\t80 e0       \tldi\tr24, 0x00\t; 0
+   2:\t90 e0       \tldi\tr25, 0x00\t; 0
+   4:\t9f 5f       \tsubi\tr25, 0xFF\t; 255
+   6:\t93 30       \tcpi\tr25, 0x03\t; 3
+   8:\te9 f7       \tbrne\t.-6      \t; 0x4 <nested_loops+0x4>
+   a:\t8f 5f       \tsubi\tr24, 0xFF\t; 255
+   c:\t83 30       \tcpi\tr24, 0x03\t; 3
+   e:\td1 f7       \tbrne\t.-12     \t; 0x2 <nested_loops+0x2>
+  10:\t08 95       \tret
+''', {'nested_loops': 3}, 'nested_loops', 54),
+    # 2 trips of the outer loop, each with 3 of the inner one: 36 cycles,
+    # counted 37 as the last inner branch of each outer trip is not taken
+    ('nested_bounds', '''
+00000000 <nested_loops>:
+   0:\t80 e0       \tldi\tr24, 0x00\t; 0
+   2:\t90 e0       \tldi\tr25, 0x00\t; 0
+   4:\t9f 5f       \tsubi\tr25, 0xFF\t; 255
+   6:\t93 30       \tcpi\tr25, 0x03\t; 3
+   8:\te9 f7       \tbrne\t.-6      \t; 0x4 <nested_loops+0x4>
+   a:\t8f 5f       \tsubi\tr24, 0xFF\t; 255
+   c:\t83 30       \tcpi\tr24, 0x03\t; 3
+   e:\td1 f7       \tbrne\t.-12     \t; 0x2 <nested_loops+0x2>
+  10:\t08 95       \tret
+''', {'nested_loops': [2, 3]}, 'nested_loops', 37),
+    # 1 + (3 + 5 + 1 + 1 + 2) + (3 + 5 + 1 + 1 + 1) + 4
+    ('loop_call', '''
+00000020 <leaf>:
+  20:\t00 00       \tnop
+  22:\t08 95       \tret
+
+00000030 <loop_call>:
+  30:\t80 e0       \tldi\tr24, 0x00\t; 0
+  32:\tf6 df       \trcall\t.-20     \t; 0x20 <leaf>
+  34:\t8f 5f       \tsubi\tr24, 0xFF\t; 255
+  36:\t82 30       \tcpi\tr24, 0x02\t; 2
+  38:\te1 f7       \tbrne\t.-8      \t; 0x32 <loop_call+0x2>
+  3a:\t08 95       \tret
+''', {'loop_call': 2}, 'loop_call', 28),
+    # 1 + 2, then the test 4 times (3 taken) and the body 3 times, + 4
+    ('rotated_loop', '''
+00000060 <rotated_loop>:
+  60:\t80 e0       \tldi\tr24, 0x00\t; 0
+  62:\t01 c0       \trjmp\t.+2      \t; 0x66 <rotated_loop+0x6>
+  64:\t00 00       \tnop
+  66:\t8f 5f       \tsubi\tr24, 0xFF\t; 255
+  68:\t84 30       \tcpi\tr24, 0x04\t; 4
+  6a:\te1 f7       \tbrne\t.-8      \t; 0x64 <rotated_loop+0x4>
+  6c:\t08 95       \tret
+''', {'rotated_loop': 4}, 'rotated_loop', 25),
+    # 1 + 2 for the jump to the second loop, 4 trips: 3 x 4 + 3, + 4
+    ('either_loop', '''
+00000080 <either_loop>:
+  80:\t80 ff       \tsbrs\tr24, 0
+  82:\t04 c0       \trjmp\t.+8      \t; 0x8c <either_loop+0xc>
+  84:\t9f 5f       \tsubi\tr25, 0xFF\t; 255
+  86:\t94 30       \tcpi\tr25, 0x04\t; 4
+  88:\te9 f7       \tbrne\t.-6      \t; 0x84 <either_loop+0x4>
+  8a:\t08 95       \tret
+  8c:\taf 5f       \tsubi\tr26, 0xFF\t; 255
+  8e:\ta4 30       \tcpi\tr26, 0x04\t; 4
+  90:\te9 f7       \tbrne\t.-6      \t; 0x8c <either_loop+0xc>
+  92:\t08 95       \tret
+''', {'either_loop': 4}, 'either_loop', 22),
+    # _delay_us(6) at 16 MHz, 96 cycles with its ldi, then 2 trips of a
+    # loop with a 15 cycle delay in it: 96 + 1 + 2 x (1 + 14 + 1 + 1 + 2)
+    # - 1 + 4 = 138, counted 139 as the loop's last branch is not taken
+    ('delay_loop', '''
+000000a0 <delay_loop>:
+  a0:\t80 e2       \tldi\tr24, 0x20\t; 32
+  a2:\t8a 95       \tdec\tr24
+  a4:\tf1 f7       \tbrne\t.-4      \t; 0xa2 <delay_loop+0x2>
+  a6:\t92 e0       \tldi\tr25, 0x02\t; 2
+  a8:\t85 e0       \tldi\tr24, 0x05\t; 5
+  aa:\t8a 95       \tdec\tr24
+  ac:\tf1 f7       \tbrne\t.-4      \t; 0xaa <delay_loop+0xa>
+  ae:\t00 00       \tnop
+  b0:\t9a 95       \tdec\tr25
+  b2:\td1 f7       \tbrne\t.-12     \t; 0xa8 <delay_loop+0x8>
+  b4:\t08 95       \tret
+''', {'delay_loop': 2}, 'delay_loop', 139),
+    ('wait_loop', '''
+00000040 <wait>:
+  40:\t80 91 e8 00 \tlds\tr24, 0x00E8\t; 0x8000e8 <__TEXT_REGION_LENGTH__+0x7e00e8>
+  44:\t80 ff       \tsbrs\tr24, 0
+  46:\tfc cf       \trjmp\t.-8      \t; 0x40 <wait>
+  48:\t08 95       \tret
+
+00000050 <caller>:
+  50:\tf7 df       \trcall\t.-18     \t; 0x40 <wait>
+  52:\t08 95       \tret
+''', {}, 'caller', None),
+]
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Checks of tools/avr_wcet.py')
+    ap.add_argument('-v', '--verbose', action='store_true')
+    args = ap.parse_args()
+
+    failed = 0
+    for name, listing, bounds, func, expected in CHECKS:
+        funcs, addr_to_func = avr_wcet.parse(listing.splitlines())
+        an = avr_wcet.Analyzer(funcs, addr_to_func, bounds)
+        cycles = an.function_cycles(func)
+        if func in an.unbounded:
+            cycles = None
+        if cycles == expected:
+            print('PASS %s' % name)
+            continue
+        failed += 1
+        print('FAIL %s: %s cycles, expected %s' % (name, cycles, expected))
+        if args.verbose:
+            print(listing)
+    if failed:
+        print('%d of %d checks failed' % (failed, len(CHECKS)))
+        return 1
+    print('all %d checks passed' % len(CHECKS))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
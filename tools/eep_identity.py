@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+# Teensy Simple Gamepad - write EEPROM images (.eep, Intel HEX) holding the
+# USB identity of a range of gamepads, for firmware built with
+# USE_EEPROM_IDENTITY. One image is written per serial number, named after
+# it, so a whole batch can be programmed from the same firmware build.
+#
+#   eep_identity.py --prefix GP- --first 1 --count 500 --digits 5 \
+#                   --product "Arcade Stick" --pid 0x047B --out eep/
+#
+# writes eep/GP-00001.eep to eep/GP-00500.eep. The product name and ID are
+# optional, the ones compiled into the firmware are kept when not given.
+# --template merges each identity into an existing image, such as the
+# simple_gamepad.eep made by the build, keeping its other contents.
+#
+# Program an image with an ISP programmer, for example
+#   avrdude -p atmega32u4 -c usbtiny -U eeprom:w:eep/GP-00001.eep:i
+# (the Teensy bootloader only programs the flash).
+
+import argparse
+import os
+import sys
+
+# identity record layout, as read by simple_gamepad_usb.c
+EEPROM_IDENTITY_ADDR = 0x000
+IDENTITY_MAGIC = 0x49
+IDENTITY_PRODUCT_ID = 1
+IDENTITY_STRING_SLOT = 64
+IDENTITY_SERIAL = 4
+IDENTITY_PRODUCT = IDENTITY_SERIAL + IDENTITY_STRING_SLOT
+IDENTITY_SIZE = IDENTITY_PRODUCT + IDENTITY_STRING_SLOT
+
+
+def string_descriptor(text):
+    data = text.encode('utf-16-le')
+    if 2 + len(data) > IDENTITY_STRING_SLOT:
+        raise ValueError('"%s" is too long, at most %d characters'
+                         % (text, (IDENTITY_STRING_SLOT - 2) // 2))
+    return bytearray([2 + len(data), 3]) + data
+
+
+def identity_record(serial, product, pid):
+    record = bytearray([0xFF] * IDENTITY_SIZE)
+    record[0] = IDENTITY_MAGIC
+    if pid is not None:
+        record[IDENTITY_PRODUCT_ID] = pid & 0xFF
+        record[IDENTITY_PRODUCT_ID + 1] = pid >> 8
+    desc = string_descriptor(serial)
+    record[IDENTITY_SERIAL:IDENTITY_SERIAL + len(desc)] = desc
+    if product is not None:
+        desc = string_descriptor(product)
+        record[IDENTITY_PRODUCT:IDENTITY_PRODUCT + len(desc)] = desc
+    return record
+
+
+def read_ihex(path):
+    image = {}
+    base = 0
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith(':'):
+                continue
+            raw = bytearray.fromhex(line[1:])
+            if sum(raw) & 0xFF:
+                raise ValueError('%s: bad checksum: %s' % (path, line))
+            count, addr, kind = raw[0], (raw[1] << 8) | raw[2], raw[3]
+            data = raw[4:4 + count]
+            if kind == 0:
+                for i, b in enumerate(data):
+                    image[base + addr + i] = b
+            elif kind == 1:
+                break
+            elif kind == 2:
+                base = ((data[0] << 8) | data[1]) << 4
+            elif kind == 4:
+                base = ((data[0] << 8) | data[1]) << 16
+    return image
+
+
+def ihex_record(addr, kind, data):
+    raw = bytearray([len(data), (addr >> 8) & 0xFF, addr & 0xFF, kind]) + data
+    raw.append((-sum(raw)) & 0xFF)
+    return ':' + raw.hex().upper() + '\n'
+
+
+def write_ihex(path, image):
+    lines = []
+    addrs = sorted(image)
+    i = 0
+    while i < len(addrs):
+        start = addrs[i]
+        data = bytearray()
+        while i < len(addrs) and addrs[i] == start + len(data) and len(data) < 16:
+            data.append(image[addrs[i]])
+            i += 1
+        lines.append(ihex_record(start, 0, data))
+    lines.append(ihex_record(0, 1, bytearray()))
+    with open(path, 'w') as f:
+        f.writelines(lines)
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Write gamepad identity EEPROM images')
+    ap.add_argument('--prefix', default='', help='text before the serial number')
+    ap.add_argument('--first', type=int, required=True, help='first serial number')
+    ap.add_argument('--count', type=int, default=1, help='number of images')
+    ap.add_argument('--digits', type=int, default=5, help='zero padded width')
+    ap.add_argument('--product', help='product name, default: compiled STR_PRODUCT')
+    ap.add_argument('--pid', type=lambda s: int(s, 0), help='product ID, default: compiled PRODUCT_ID')
+    ap.add_argument('--template', help='.eep image to merge each identity into')
+    ap.add_argument('--out', default='.', help='output directory')
+    args = ap.parse_args()
+
+    if args.pid is not None and not 0 <= args.pid < 0xFFFF:
+        sys.exit('product ID must be 0x0000 to 0xFFFE')
+    template = read_ihex(args.template) if args.template else {}
+    os.makedirs(args.out, exist_ok=True)
+
+    for n in range(args.first, args.first + args.count):
+        serial = '%s%0*d' % (args.prefix, args.digits, n)
+        try:
+            record = identity_record(serial, args.product, args.pid)
+        except ValueError as e:
+            sys.exit(str(e))
+        image = dict(template)
+        for i, b in enumerate(record):
+            image[EEPROM_IDENTITY_ADDR + i] = b
+        write_ihex(os.path.join(args.out, serial + '.eep'), image)
+    print('wrote %d images to %s' % (args.count, args.out))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
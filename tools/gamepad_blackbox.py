@@ -0,0 +1,221 @@
+#!/usr/bin/env python3
+# Teensy Simple Gamepad - download the black-box recording of a gamepad
+# built with USE_BLACKBOX, through its feature report (Linux hidraw), and
+# show it or replay it.
+#
+#   gamepad_blackbox.py [--save dump.bin | --load dump.bin]
+#                       [--events | --replay ./simple_gamepad_replay]
+#
+# The gamepad keeps the recent changes of its input pins and its failed
+# sends in a ring in RAM, each with the USB frame (1 ms) it happened in.
+# Recording stops while the ring is downloaded, and resumes after. The
+# recording is listed oldest first, with the frames counted from its
+# start; the gaps between changes are only known modulo 256 frames.
+#
+# --events prints it in the form the host replay build reads, and
+# --replay runs it through that build ('make replay', with the gamepad's
+# configuration and MCU) to list the reports the gamepad sent, decoded as
+# the configuration's descriptor lays them out. --save keeps the ring to
+# look at later with --load, e.g. when a player sends it in.
+
+import argparse
+import os
+import subprocess
+import sys
+
+from gamepad_hid import CONFIG, analog_descriptor, decode, format_state, parse_descriptor, \
+    read_config, report_descriptor
+from gamepad_remap import find_device, read_map, request
+
+FEATURE_BLACKBOX_READ = 0x08
+
+BLACKBOX_PAD = 0x00
+BLACKBOX_PORTS = 0x00
+BLACKBOX_SEND = 0x40
+BLACKBOX_KEY = 0x80
+BLACKBOX_KIND_MASK = 0xC0
+
+SEND_OUTCOMES = {1: 'offline', 2: 'timed out'}
+
+# the ports in the order the gamepad reads them, by port count
+PORT_NAMES = {3: 'BCD', 5: 'BCDEF', 6: 'ABCDEF'}
+
+
+def read_ring(fd):
+    """returns the header (size, head, port count, segments) and the ring,
+    downloaded a page at a time while recording is stopped"""
+    ring = bytearray()
+    page = 0
+    try:
+        while True:
+            result = request(fd, FEATURE_BLACKBOX_READ, bytearray([page, 1]))
+            size = result[0] | (result[1] << 8)
+            ring += result[6:6 + size - len(ring)]
+            if len(ring) >= size:
+                return (size, result[2], result[3], result[4]), ring
+            page += 1
+    finally:
+        # recording resumes whatever happened
+        request(fd, FEATURE_BLACKBOX_READ, bytearray([0, 0]))
+
+
+def decode_segment(data, ports):
+    """returns the entries of a segment as (frame, kind, value) tuples: the
+    ports as a list for 'K' (the key entry) and 'F', the outcome for 'S'. A
+    segment not starting with a key entry has never been written"""
+    if len(data) < 2 + ports or data[0] != BLACKBOX_KEY:
+        return []
+    state = list(data[2:2 + ports])
+    entries = [(data[1], 'K', list(state))]
+    pos = 2 + ports
+    while pos + 2 <= len(data) and data[pos] != BLACKBOX_PAD:
+        header, frame = data[pos], data[pos + 1]
+        pos += 2
+        if header & BLACKBOX_KIND_MASK == BLACKBOX_SEND:
+            entries.append((frame, 'S', header & ~BLACKBOX_KIND_MASK))
+        elif header & BLACKBOX_KIND_MASK == BLACKBOX_PORTS:
+            for i in range(ports):
+                if header & (1 << i):
+                    if pos >= len(data):
+                        return entries
+                    state[i] = data[pos]
+                    pos += 1
+            entries.append((frame, 'F', list(state)))
+        else:
+            break
+    return entries
+
+
+def decode_ring(header, ring):
+    """returns the entries of the ring, oldest first, with the frames
+    counted from the first"""
+    size, head, ports, segments = header
+    seg = size // segments
+    current = head // seg
+    entries = []
+    for k in range(1, segments + 1):
+        n = (current + k) % segments
+        start = n * seg
+        # the segment being written ends at the head, the rest is older
+        end = head if n == current else start + seg
+        entries += decode_segment(ring[start:end], ports)
+
+    frames = []
+    total = last = None
+    for frame, kind, value in entries:
+        total = 0 if total is None else total + ((frame - last) & 0xFF)
+        last = frame
+        frames.append((total, kind, value))
+    return frames
+
+
+def events(entries, remap=None):
+    """returns the lines the host replay build reads"""
+    lines = ['M ' + ' '.join('%02x' % v for v in remap)] if remap else []
+    for frame, kind, value in entries:
+        if kind in 'KF':
+            lines.append('F %d %s' % (frame, ' '.join('%02x' % v for v in value)))
+        else:
+            lines.append('S %d %d' % (frame, value))
+    return lines
+
+
+def listing(entries, ports):
+    """returns the entries as text, with the pins that changed"""
+    names = PORT_NAMES.get(ports, ''.join(chr(ord('A') + i) for i in range(ports)))
+    lines = []
+    state = None
+    for frame, kind, value in entries:
+        if kind == 'S':
+            lines.append('%8d  send failed: %s' % (frame, SEND_OUTCOMES.get(value, value)))
+            continue
+        if state is None or (kind == 'K' and value != state):
+            # the start, or the changes made while recording was stopped
+            lines.append('%8d  %s %s' % (frame, 'pins' if state is None else 'resumed, pins',
+                                         ' '.join('%s=%02x' % (names[i], v)
+                                                  for i, v in enumerate(value))))
+        else:
+            changes = []
+            for i in range(ports):
+                for bit in range(8):
+                    if (state[i] ^ value[i]) & (1 << bit):
+                        changes.append('%s%d %s' % (names[i], bit,
+                                                    'high' if value[i] & (1 << bit) else 'low'))
+            if changes:
+                lines.append('%8d  %s' % (frame, ', '.join(changes)))
+        state = value
+    return lines
+
+
+def replay(program, lines, config):
+    """runs the events through the host replay build and returns its
+    output, with the reports decoded"""
+    config = read_config(config)
+    fields = {'R': parse_descriptor(report_descriptor(config))[0]}
+    if config['USE_SPLIT_REPORTS']:
+        fields['A'] = parse_descriptor(analog_descriptor(config))[0]
+    out = subprocess.run([program], input='\n'.join(lines) + '\n', stdout=subprocess.PIPE,
+                         universal_newlines=True, check=True).stdout
+    result = []
+    for line in out.splitlines():
+        parts = line.split()
+        if parts[0] in fields:
+            report = bytes(int(b, 16) for b in parts[2:])
+            state = decode(fields[parts[0]], report)
+            if parts[0] == 'A':
+                del state['buttons']
+            result.append('%8s  %s %s  (%s)' % (parts[1], 'report' if parts[0] == 'R' else 'analog',
+                                               report.hex(' '), format_state(state)))
+        elif parts[0] == 'S':
+            result.append('%8s  send failed: %s' % (parts[1],
+                                                  SEND_OUTCOMES.get(int(parts[2]), parts[2])))
+    return result
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Gamepad black-box recording')
+    ap.add_argument('--device', help='hidraw device, found by VID/PID if not given')
+    ap.add_argument('--vid', type=lambda s: int(s, 0), default=0x16C0)
+    ap.add_argument('--pid', type=lambda s: int(s, 0), default=0x047A)
+    ap.add_argument('--config', default=CONFIG, help='configuration to decode the reports with')
+    ap.add_argument('--save', help='write the downloaded ring to a file')
+    ap.add_argument('--load', help='read the ring from a file instead of the gamepad')
+    ap.add_argument('--events', action='store_true', help='print the replay build input')
+    ap.add_argument('--replay', help='host replay build to run the recording through')
+    args = ap.parse_args()
+
+    remap = None
+    if args.load:
+        with open(args.load, 'rb') as f:
+            data = f.read()
+        header = (data[0] | (data[1] << 8), data[2], data[3], data[4])
+        remap, ring = data[6:6 + data[5]], data[6 + data[5]:]
+    else:
+        device = args.device or find_device(args.vid, args.pid)
+        if not device:
+            sys.exit('no gamepad found with VID 0x%04X PID 0x%04X' % (args.vid, args.pid))
+        fd = os.open(device, os.O_RDWR)
+        header, ring = read_ring(fd)
+        # the replay needs the remapping the buttons were read with
+        if read_config(args.config)['USE_BUTTON_REMAP']:
+            remap = read_map(fd)
+        os.close(fd)
+    remap = bytes(remap or b'')
+
+    if args.save:
+        with open(args.save, 'wb') as f:
+            f.write(bytes([header[0] & 0xFF, header[0] >> 8, header[1], header[2], header[3],
+                           len(remap)]) + remap + bytes(ring))
+
+    entries = decode_ring(header, ring)
+    if args.events:
+        print('\n'.join(events(entries, remap)))
+    elif args.replay:
+        print('\n'.join(replay(args.replay, events(entries, remap), args.config)))
+    else:
+        print('\n'.join(listing(entries, header[2])))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
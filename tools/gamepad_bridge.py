@@ -0,0 +1,504 @@
+#!/usr/bin/env python3
+# Teensy Simple Gamepad - bridge every gamepad to a virtual input device of
+# its own player slot (Linux hidraw and uinput, needs access to both).
+#
+#   gamepad_bridge.py [--slots FILE] [--rt-priority 50]
+#   gamepad_bridge.py --benchmark 4 [--seconds 10]
+#
+# Reads the hidraw nodes of every gamepad with the VID and PID, waiting on
+# all of them at once with epoll, and writes the changes of each report as
+# the events of a uinput device, "Simple Gamepad Player N". The player slot
+# is kept for the serial number (STR_SERIAL_NUMBER) of the gamepad across
+# restarts and reconnections, in the slots file: one serial a line, in slot
+# order, new ones being added at the end. A slot's device stays when its
+# gamepad is unplugged, so the players never move. A gamepad built with
+# USE_SPLIT_REPORTS sends its axes and encoders on an analog interface of
+# its own; it is read too, and its controls go to the same device as the
+# buttons of the gamepad of the same USB device and serial number.
+#
+# The events are the ones the kernel's HID driver gives a gamepad (buttons
+# 1-16 as BTN_SOUTH..., then BTN_TRIGGER_HAPPY, the D-pad as ABS_X/ABS_Y or
+# ABS_HAT0X/ABS_HAT0Y, the axes as ABS_Z...), so programs see the same
+# controls, without the driver's per-device processing. Each report is read
+# into a buffer of its own gamepad and compared with the last one, and only
+# the fields in the bytes that changed are decoded. New gamepads are picked
+# up within --rescan seconds.
+#
+# --rt-priority runs the bridge with the SCHED_FIFO real-time priority
+# given, so a busy system does not delay the events (needs CAP_SYS_NICE).
+#
+# --benchmark N creates N emulated gamepads (see gamepad_uhid.py), bridges
+# them for --seconds, and prints the latency the bridge adds to each
+# event: from its read of the report returning to the kernel's timestamp
+# of the event written to the virtual device (both CLOCK_MONOTONIC), and
+# from the emulator's write of the change to that event.
+
+import argparse
+import fcntl
+import glob
+import os
+import re
+import select
+import statistics
+import struct
+import sys
+import threading
+import time
+
+from gamepad_hid import CONFIG, VENDOR_ID, device_descriptor, parse_descriptor, read_config
+from gamepad_remap import analog_interface, other_interface
+
+# linux/input-event-codes.h
+EV_SYN = 0x00
+EV_KEY = 0x01
+EV_REL = 0x02
+EV_ABS = 0x03
+SYN_REPORT = 0
+BTN_GAMEPAD = 0x130
+BTN_TRIGGER_HAPPY = 0x2c0
+BTN_TRIGGER_HAPPY_COUNT = 40
+ABS_HAT0X = 0x10
+ABS_HAT0Y = 0x11
+BUS_VIRTUAL = 0x06
+
+# Generic Desktop usages as the HID driver maps them: absolute to the ABS
+# code, relative to the REL code, of the low 4 bits of the usage
+ABS_CODES = {'x': 0x00, 'y': 0x01, 'z': 0x02, 'rx': 0x03, 'ry': 0x04, 'rz': 0x05,
+             'slider': 0x06}
+REL_CODES = {'dial': 0x07, 'wheel': 0x08}
+
+# the D-pad directions of each hat value, 8 being centered
+HAT_XY = [(0, -1), (1, -1), (1, 0), (1, 1), (0, 1), (-1, 1), (-1, 0), (-1, -1), (0, 0)]
+
+# linux/uinput.h
+UI_DEV_CREATE = 0x5501
+UI_DEV_DESTROY = 0x5502
+UI_DEV_SETUP = 0x405c5503
+UI_ABS_SETUP = 0x401c5504
+UI_SET_EVBIT = 0x40045564
+UI_SET_KEYBIT = 0x40045565
+UI_SET_RELBIT = 0x40045566
+UI_SET_ABSBIT = 0x40045567
+
+
+def ui_get_sysname(size):
+    return (2 << 30) | (size << 16) | (ord('U') << 8) | 44
+
+
+# linux/input.h, to timestamp the events of the benchmark
+EVIOCSCLOCKID = 0x400445a0
+CLOCK_MONOTONIC = 1
+INPUT_EVENT = struct.Struct('llHHi')
+
+RESCAN_SECONDS = 1.0
+
+
+def button_code(n):
+    """the key code of button n, as the HID driver gives it on a gamepad"""
+    if n <= 16:
+        return BTN_GAMEPAD + n - 1
+    if n <= 16 + BTN_TRIGGER_HAPPY_COUNT:
+        return BTN_TRIGGER_HAPPY + n - 17
+    return None
+
+
+class Control(object):
+    """a field of the report and the events it becomes"""
+
+    def __init__(self, field):
+        self.field = field
+        self.first = field.bit // 8
+        self.last = (field.bit + field.size - 1) // 8
+        self.kind = None
+        if field.name.startswith('button'):
+            self.code = button_code(int(field.name[6:]))
+            if self.code is not None:
+                self.kind = EV_KEY
+        elif field.name == 'hat':
+            self.kind = 'hat'
+        elif field.relative and field.name in REL_CODES:
+            self.kind, self.code = EV_REL, REL_CODES[field.name]
+        elif field.name in ABS_CODES:
+            self.kind, self.code = EV_ABS, ABS_CODES[field.name]
+
+    def events(self, report, out):
+        """appends the events of the field's value in report to out"""
+        value = self.field.value(report)
+        if self.kind == 'hat':
+            x, y = HAT_XY[value if value < 8 else 8]
+            out.append((EV_ABS, ABS_HAT0X, x))
+            out.append((EV_ABS, ABS_HAT0Y, y))
+        elif self.kind == EV_REL:
+            if value:
+                out.append((EV_REL, self.code, value))
+        elif self.kind is not None:
+            out.append((self.kind, self.code, value))
+
+
+class VirtualPad(object):
+    """the uinput device of a player slot"""
+
+    def __init__(self, slot, controls, vid, pid):
+        self.slot = slot
+        self.layout = [(c.kind, getattr(c, 'code', None)) for c in controls]
+        self.fd = os.open('/dev/uinput', os.O_WRONLY | os.O_NONBLOCK | os.O_CLOEXEC)
+        kinds = set(c.kind for c in controls)
+        fcntl.ioctl(self.fd, UI_SET_EVBIT, EV_SYN)
+        if EV_KEY in kinds:
+            fcntl.ioctl(self.fd, UI_SET_EVBIT, EV_KEY)
+        if EV_REL in kinds:
+            fcntl.ioctl(self.fd, UI_SET_EVBIT, EV_REL)
+        if EV_ABS in kinds or 'hat' in kinds:
+            fcntl.ioctl(self.fd, UI_SET_EVBIT, EV_ABS)
+        for c in controls:
+            if c.kind == EV_KEY:
+                fcntl.ioctl(self.fd, UI_SET_KEYBIT, c.code)
+            elif c.kind == EV_REL:
+                fcntl.ioctl(self.fd, UI_SET_RELBIT, c.code)
+            elif c.kind == EV_ABS:
+                self._abs(c.code, -127, 127)
+            elif c.kind == 'hat':
+                self._abs(ABS_HAT0X, -1, 1)
+                self._abs(ABS_HAT0Y, -1, 1)
+        name = ('Simple Gamepad Player %d' % (slot + 1)).encode()
+        fcntl.ioctl(self.fd, UI_DEV_SETUP,
+                    struct.pack('<HHHH80sI', BUS_VIRTUAL, vid, pid, slot + 1, name, 0))
+        fcntl.ioctl(self.fd, UI_DEV_CREATE)
+
+    def _abs(self, code, low, high):
+        fcntl.ioctl(self.fd, UI_SET_ABSBIT, code)
+        fcntl.ioctl(self.fd, UI_ABS_SETUP, struct.pack('<HxxiiiiII', code, 0, low, high, 0, 0, 0))
+
+    def event_node(self):
+        """returns the /dev/input/event node of the device"""
+        buf = bytearray(64)
+        fcntl.ioctl(self.fd, ui_get_sysname(len(buf)), buf, True)
+        sysname = bytes(buf).split(b'\0', 1)[0].decode()
+        for path in glob.glob('/sys/devices/virtual/input/%s/event*' % sysname):
+            return '/dev/input/' + os.path.basename(path)
+        return None
+
+    def write(self, events):
+        data = b''.join(INPUT_EVENT.pack(0, 0, t, c, v) for t, c, v in events)
+        os.write(self.fd, data + INPUT_EVENT.pack(0, 0, EV_SYN, SYN_REPORT, 0))
+
+    def close(self):
+        fcntl.ioctl(self.fd, UI_DEV_DESTROY)
+        os.close(self.fd)
+
+
+class Pad(object):
+    """a gamepad interface being read, the buttons one or the analog one"""
+
+    def __init__(self, device, serial, slot, analog=False):
+        self.device = device
+        self.serial = serial
+        self.slot = slot
+        self.analog = analog
+        fields, size = parse_descriptor(device_descriptor(device))
+        self.controls = [Control(f) for f in fields]
+        self.controls = [c for c in self.controls if c.kind is not None]
+        self.size = size
+        self.buf = bytearray(max(size, 64))
+        self.view = memoryview(self.buf)
+        self.last = bytearray(size)
+        self.relative = [c for c in self.controls if c.kind == EV_REL]
+        self.fd = os.open(device, os.O_RDONLY | os.O_NONBLOCK | os.O_CLOEXEC)
+
+    def events(self):
+        """returns the events of the report in the buffer: every control
+        in a byte that changed, and the relative ones, which are moves"""
+        changed = [i for i in range(self.size) if self.buf[i] != self.last[i]]
+        out = []
+        if changed:
+            low, high = changed[0], changed[-1]
+            for c in self.controls:
+                if c.kind != EV_REL and c.last >= low and c.first <= high and \
+                        any(c.first <= i <= c.last for i in changed):
+                    c.events(self.buf, out)
+            self.last[:] = self.view[:self.size]
+        for c in self.relative:
+            c.events(self.buf, out)
+        return out
+
+
+def hid_uevent(device):
+    name = os.path.basename(device)
+    with open('/sys/class/hidraw/%s/device/uevent' % name) as f:
+        return dict(line.split('=', 1) for line in f.read().splitlines() if '=' in line)
+
+
+def find_devices(vid, pid, phys=None):
+    """returns the hidraw nodes of every gamepad with the VID and PID, their
+    serial numbers, and the hidraw nodes of their analog interfaces (None
+    without one)"""
+    want = 'HID_ID=0003:%08X:%08X' % (vid, pid)
+    found = []
+    analog = {}
+    for path in sorted(glob.glob('/sys/class/hidraw/hidraw*')):
+        device = '/dev/' + os.path.basename(path)
+        try:
+            uevent = hid_uevent(device)
+            if 'HID_ID=' + uevent.get('HID_ID', '').upper() != want:
+                continue
+            # the interfaces of one gamepad share the phys of its USB device
+            usb = re.sub(r'/input[0-9]+$', '', uevent.get('HID_PHYS', ''))
+            if phys is not None and usb != phys:
+                continue
+            key = (usb, uevent.get('HID_UNIQ', ''))
+            if not other_interface(uevent.get('HID_PHYS', '')):
+                found.append((device, key))
+            elif analog_interface(device):
+                analog[key] = device
+        except OSError:
+            continue
+    return [(device, key[1], analog.get(key)) for device, key in found]
+
+
+class Slots(object):
+    """the player slot of each serial number, kept in a file"""
+
+    def __init__(self, path):
+        self.path = path
+        self.serials = []
+        if path and os.path.exists(path):
+            with open(path) as f:
+                self.serials = [line.strip() for line in f if line.strip()]
+
+    def slot(self, serial):
+        if serial not in self.serials:
+            self.serials.append(serial)
+            if self.path:
+                os.makedirs(os.path.dirname(os.path.abspath(self.path)), exist_ok=True)
+                with open(self.path, 'w') as f:
+                    f.write(''.join(s + '\n' for s in self.serials))
+        return self.serials.index(serial)
+
+
+class Bridge(object):
+    """reads every gamepad, and writes its events to its slot's device"""
+
+    def __init__(self, vid, pid, slots, phys=None, on_events=None):
+        self.vid = vid
+        self.pid = pid
+        self.slots = slots
+        self.phys = phys
+        self.on_events = on_events
+        self.pads = {}                      # by fd
+        self.virtual = {}                   # by slot
+        self.epoll = select.epoll()
+        self.stopped = threading.Event()
+
+    def rescan(self):
+        known = set(p.device for p in self.pads.values())
+        added = set()
+        for device, serial, analog in find_devices(self.vid, self.pid, self.phys):
+            slot = self.slots.slot(serial or device)
+            for node, is_analog in ((device, False), (analog, True)):
+                if node is None or node in known:
+                    continue
+                try:
+                    pad = Pad(node, serial, slot, is_analog)
+                except OSError:
+                    continue
+                self.pads[pad.fd] = pad
+                self.epoll.register(pad.fd, select.EPOLLIN)
+                added.add(slot)
+                sys.stderr.write('player %d: %s%s (serial %s)\n'
+                                 % (slot + 1, node, ' analog' if is_analog else '',
+                                    serial or '?'))
+        for slot in added:
+            # the buttons, then the analog controls when they are split off
+            pads = sorted((p for p in self.pads.values() if p.slot == slot),
+                          key=lambda p: p.analog)
+            controls = [c for p in pads for c in p.controls]
+            layout = [(c.kind, getattr(c, 'code', None)) for c in controls]
+            vpad = self.virtual.get(slot)
+            if vpad is None or vpad.layout != layout:
+                # a gamepad of another layout takes the slot over
+                if vpad is not None:
+                    vpad.close()
+                self.virtual[slot] = VirtualPad(slot, controls, self.vid, self.pid)
+
+    def drop(self, pad):
+        self.epoll.unregister(pad.fd)
+        os.close(pad.fd)
+        del self.pads[pad.fd]
+        sys.stderr.write('player %d: %s gone\n' % (pad.slot + 1, pad.device))
+
+    def run(self, rescan=RESCAN_SECONDS):
+        next_scan = 0
+        while not self.stopped.is_set():
+            now = time.monotonic()
+            if now >= next_scan:
+                self.rescan()
+                next_scan = now + rescan
+            for fd, mask in self.epoll.poll(max(0, next_scan - now)):
+                pad = self.pads.get(fd)
+                if pad is None:
+                    continue
+                try:
+                    # every report waiting, in order
+                    while True:
+                        n = os.readv(fd, [pad.view])
+                        if n <= 0:
+                            break
+                        t = time.clock_gettime_ns(time.CLOCK_MONOTONIC)
+                        events = pad.events()
+                        if events:
+                            self.virtual[pad.slot].write(events)
+                            if self.on_events:
+                                self.on_events(pad, t, bytes(pad.view[:pad.size]))
+                except BlockingIOError:
+                    pass
+                except OSError:
+                    self.drop(pad)
+
+    def close(self):
+        for pad in list(self.pads.values()):
+            self.drop(pad)
+        for vpad in self.virtual.values():
+            vpad.close()
+        self.epoll.close()
+
+
+def set_rt_priority(priority):
+    os.sched_setscheduler(0, os.SCHED_FIFO, os.sched_param(priority))
+
+
+def benchmark(args, config):
+    """bridges emulated gamepads, and returns the latencies of their events"""
+    from gamepad_uhid import EMULATOR_PHYS, Emulator
+
+    reads = {}                              # by slot: (read time, report, analog)
+    lock = threading.Lock()
+
+    def on_events(pad, t, report):
+        with lock:
+            reads.setdefault(pad.slot, []).append((t, report, pad.analog))
+
+    emulators = [Emulator(config, serial='bench%d' % (i + 1), rate=args.rate)
+                 for i in range(args.benchmark)]
+    # with USE_SPLIT_REPORTS, each has its analog interface too
+    interfaces = len(emulators) * (2 if config['USE_SPLIT_REPORTS'] else 1)
+    slots = Slots(None)
+    bridge = Bridge(VENDOR_ID, config['PRODUCT_ID'], slots, EMULATOR_PHYS, on_events)
+    deadline = time.monotonic() + 5
+    while len(bridge.pads) < interfaces and time.monotonic() < deadline:
+        bridge.rescan()
+        time.sleep(0.05)
+    if len(bridge.pads) < interfaces:
+        sys.exit('the emulated gamepads did not appear')
+
+    # the events as the programs get them, timestamped by the kernel
+    nodes = {}
+    for slot, vpad in bridge.virtual.items():
+        node = vpad.event_node()
+        fd = os.open(node, os.O_RDONLY | os.O_NONBLOCK)
+        fcntl.ioctl(fd, EVIOCSCLOCKID, struct.pack('i', CLOCK_MONOTONIC))
+        nodes[fd] = slot
+    syns = {}
+    reader_stop = threading.Event()
+
+    def reader():
+        ep = select.epoll()
+        for fd in nodes:
+            ep.register(fd, select.EPOLLIN)
+        while not reader_stop.is_set():
+            for fd, _ in ep.poll(0.1):
+                try:
+                    data = os.read(fd, INPUT_EVENT.size * 64)
+                except BlockingIOError:
+                    continue
+                for sec, usec, kind, code, value in INPUT_EVENT.iter_unpack(data):
+                    if kind == EV_SYN and code == SYN_REPORT:
+                        syns.setdefault(nodes[fd], []).append(sec * 1000000000 + usec * 1000)
+        ep.close()
+
+    reader_thread = threading.Thread(target=reader, daemon=True)
+    reader_thread.start()
+    bridge_thread = threading.Thread(target=bridge.run, daemon=True)
+    bridge_thread.start()
+    if args.rt_priority:
+        set_rt_priority(args.rt_priority)
+    for e in emulators:
+        e.start()
+    time.sleep(args.seconds)
+    for e in emulators:
+        e.stop()
+    time.sleep(0.2)
+    bridge.stopped.set()
+    bridge_thread.join()
+    reader_stop.set()
+    reader_thread.join()
+
+    added = []
+    total = []
+    by_serial = dict(('bench%d' % (i + 1), e) for i, e in enumerate(emulators))
+    for slot, slot_reads in reads.items():
+        slot_syns = syns.get(slot, [])
+        emulator = by_serial[slots.serials[slot]]
+        changes = {False: emulator.sent_changes(), True: emulator.sent_changes(analog=True)}
+        next_change = {False: 0, True: 0}
+        # each report read with events is one SYN_REPORT of the slot's
+        # device, in order, and the reports read from each interface are
+        # the changes sent on it, in order
+        for (t_read, report, analog), t_syn in zip(slot_reads, slot_syns):
+            added.append((t_syn - t_read) / 1000.0)
+            sent, i = changes[analog], next_change[analog]
+            while i < len(sent) and sent[i][1] != report:
+                i += 1
+            if i < len(sent):
+                total.append((t_syn - sent[i][0]) / 1000.0)
+                i += 1
+            next_change[analog] = i
+    bridge.close()
+    for e in emulators:
+        e.close()
+    return added, total
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p / 100.0 * len(values)))]
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Gamepads to uinput player devices')
+    ap.add_argument('--vid', type=lambda s: int(s, 0), default=VENDOR_ID)
+    ap.add_argument('--pid', type=lambda s: int(s, 0))
+    ap.add_argument('--config', default=CONFIG)
+    ap.add_argument('--slots', default=os.path.expanduser('~/.config/simple_gamepad/slots'))
+    ap.add_argument('--rescan', type=float, default=RESCAN_SECONDS)
+    ap.add_argument('--rt-priority', type=int, help='SCHED_FIFO priority, 1 to 99')
+    ap.add_argument('--benchmark', type=int, metavar='N', help='measure with N emulated gamepads')
+    ap.add_argument('--seconds', type=float, default=10)
+    ap.add_argument('--rate', type=float, default=1000, help='reports a second of each emulated gamepad')
+    args = ap.parse_args()
+
+    config = read_config(args.config)
+    if args.benchmark:
+        added, total = benchmark(args, config)
+        if not added:
+            sys.exit('no events were measured')
+        for name, values in (('added by the bridge', added), ('emulator to event', total)):
+            if values:
+                print('%-20s mean %.1f us, median %.1f, 99%% %.1f, max %.1f (%d events)'
+                      % (name, statistics.mean(values), percentile(values, 50),
+                         percentile(values, 99), max(values), len(values)))
+        return 0
+
+    if args.rt_priority:
+        set_rt_priority(args.rt_priority)
+    pid = args.pid if args.pid is not None else config['PRODUCT_ID']
+    bridge = Bridge(args.vid, pid, Slots(args.slots))
+    try:
+        bridge.run(args.rescan)
+    except KeyboardInterrupt:
+        pass
+    bridge.close()
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
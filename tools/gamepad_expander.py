@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+# Teensy Simple Gamepad - show the latency and errors of each MCP23017 port
+# expander of a gamepad built with EXPANDER_COUNT, through its feature
+# report (Linux hidraw).
+#
+#   gamepad_expander.py [--csv]
+#
+# The latency is the time from the expanders' interrupt line falling to the
+# report holding the change being loaded into the USB endpoint, measured by
+# the gamepad with Timer3; the host still collects it at its next poll.
+
+import argparse
+import os
+import struct
+import sys
+
+from gamepad_remap import find_device, request
+
+FEATURE_EXPANDER_READ = 0x05
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Gamepad port expander statistics')
+    ap.add_argument('--device', help='hidraw device, found by VID/PID if not given')
+    ap.add_argument('--vid', type=lambda s: int(s, 0), default=0x16C0)
+    ap.add_argument('--pid', type=lambda s: int(s, 0), default=0x047A)
+    ap.add_argument('--f-cpu', type=float, default=16e6)
+    ap.add_argument('--csv', action='store_true')
+    args = ap.parse_args()
+
+    device = args.device or find_device(args.vid, args.pid)
+    if not device:
+        sys.exit('no gamepad found with VID 0x%04X PID 0x%04X' % (args.vid, args.pid))
+    fd = os.open(device, os.O_RDWR)
+    tick_us = 64 * 1e6 / args.f_cpu
+
+    if args.csv:
+        print('expander,last_us,max_us,changes,errors')
+    n = 0
+    count = 1
+    while n < count:
+        result = request(fd, FEATURE_EXPANDER_READ, bytearray([n]))
+        count = result[0]
+        last, worst, changes, errors = struct.unpack('<4H', bytes(result[2:10]))
+        if args.csv:
+            print('%d,%.0f,%.0f,%d,%d' % (n, last * tick_us, worst * tick_us, changes, errors))
+        else:
+            print('expander %d (0x%02X): latency last %.0f us, max %.0f us, '
+                  '%d changes, %d errors'
+                  % (n, 0x20 + n, last * tick_us, worst * tick_us, changes, errors))
+        n += 1
+    os.close(fd)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
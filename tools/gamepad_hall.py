@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+# Teensy Simple Gamepad - show the travel and state of each Hall-effect
+# switch of a gamepad built with HALL_BUTTON_COUNT, and measure its sample
+# rate and decision latency, through its feature report (Linux hidraw).
+#
+#   gamepad_hall.py [--interval 1.0] [--watch]
+#
+# The gamepad counts the rounds of its ADC, each sampling every analog
+# input (the axes and the switches) once, and the rounds from a switch
+# being decided on to the report carrying it being loaded into the USB
+# endpoint; the host still collects it at its next poll. Reading the round
+# count twice gives the sample rate of each switch, and so the latency in
+# microseconds. --watch prints the travel of the switches continuously,
+# to set HALL_ACTUATION and the deltas.
+
+import argparse
+import os
+import struct
+import sys
+import time
+
+from gamepad_remap import find_device, request
+
+FEATURE_HALL_READ = 0x07
+
+
+def read_hall(fd):
+    """returns the switch count, the pressed bits, the round count, the last
+    and max latency in rounds, and the travel of each switch"""
+    result = request(fd, FEATURE_HALL_READ)
+    count, pressed = result[0], result[1]
+    rounds, last, worst = struct.unpack('<3H', bytes(result[2:8]))
+    return count, pressed, rounds, last, worst, list(result[8:8 + count])
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Gamepad Hall-effect switches')
+    ap.add_argument('--device', help='hidraw device, found by VID/PID if not given')
+    ap.add_argument('--vid', type=lambda s: int(s, 0), default=0x16C0)
+    ap.add_argument('--pid', type=lambda s: int(s, 0), default=0x047A)
+    ap.add_argument('--interval', type=float, default=1.0, help='seconds between the two reads')
+    ap.add_argument('--watch', action='store_true', help='print the travel until interrupted')
+    args = ap.parse_args()
+
+    device = args.device or find_device(args.vid, args.pid)
+    if not device:
+        sys.exit('no gamepad found with VID 0x%04X PID 0x%04X' % (args.vid, args.pid))
+    fd = os.open(device, os.O_RDWR)
+
+    t0 = time.monotonic()
+    count, pressed, rounds0, last, worst, travel = read_hall(fd)
+    time.sleep(args.interval)
+    count, pressed, rounds1, last, worst, travel = read_hall(fd)
+    elapsed = time.monotonic() - t0
+    # the count wraps at 16 bits, about 2 seconds at full rate
+    rate = ((rounds1 - rounds0) & 0xFFFF) / elapsed
+    round_us = 1e6 / rate if rate else 0
+    print('%d switches, each sampled %.0f times a second (every %.1f us)'
+          % (count, rate, round_us))
+    print('decision to report loaded: last %.1f us, max %.1f us (%d and %d rounds)'
+          % (last * round_us, worst * round_us, last, worst))
+
+    try:
+        while True:
+            print('  '.join('%d:%3d%s' % (i + 1, t, '*' if pressed & (1 << i) else ' ')
+                            for i, t in enumerate(travel)))
+            if not args.watch:
+                break
+            time.sleep(0.05)
+            count, pressed, _, _, _, travel = read_hall(fd)
+    except KeyboardInterrupt:
+        pass
+    os.close(fd)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
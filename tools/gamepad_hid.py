@@ -0,0 +1,269 @@
+#!/usr/bin/env python3
+# Teensy Simple Gamepad - the input report, for the host tools.
+#
+#   gamepad_hid.py [--config simple_gamepad_config.h] [--device /dev/hidrawN]
+#
+# Builds the HID report descriptor of a configuration byte for byte as
+# gamepad_hid_report_desc in simple_gamepad_defs.h does (and the analog
+# one, analog_hid_report_desc, with USE_SPLIT_REPORTS), and parses any
+# report descriptor into the fields of its input report, to decode the
+# reports the gamepad sends. Run on its own, it prints the fields of the
+# descriptor of a configuration, or of a device.
+
+import argparse
+import os
+import re
+import sys
+
+TOOLS = os.path.dirname(os.path.abspath(__file__))
+CONFIG = os.path.join(os.path.dirname(TOOLS), 'simple_gamepad_config.h')
+
+VENDOR_ID = 0x16C0
+FEATURE_REPORT_SIZE = 32
+# the loopback probe bytes, which end the input report (USE_LOOPBACK_PROBE)
+PROBE_REPORT_SIZE = 7
+
+DPAD_AXES = 0
+DPAD_HAT = 1
+HAT_CENTER = 8
+
+
+def read_config(path=CONFIG):
+    """returns the options of simple_gamepad_config.h that shape the
+    report and the device, as a dict"""
+    with open(path) as f:
+        text = f.read()
+    defines = dict(re.findall(r'^#define\s+(\w+)[ \t]+(.*?)\s*(?:/[/*].*)?$', text, re.M))
+
+    def number(name, default=0):
+        value = defines.get(name, str(default))
+        if value in ('LINK_NONE', 'DPAD_AXES'):
+            return 0
+        if value in ('LINK_PRIMARY', 'DPAD_HAT'):
+            return 1
+        if value == 'LINK_SECONDARY':
+            return 2
+        return int(value, 0)
+
+    def string(name):
+        m = re.match(r'L?"(.*)"', defines.get(name, '""'))
+        return m.group(1) if m else ''
+
+    config = {name: number(name) for name in (
+        'DPAD_MODE', 'BUTTON_COUNT', 'AXIS_COUNT', 'ENCODER_COUNT', 'PRODUCT_ID',
+        'USE_BUTTON_REMAP', 'USE_STACK_MONITOR', 'EXPANDER_COUNT', 'LINK_MODE',
+        'POLL_INTERVAL_MS', 'HALL_BUTTON_COUNT', 'USE_LOOPBACK_PROBE', 'USE_BLACKBOX',
+        'USE_SPLIT_REPORTS', 'ANALOG_INTERVAL_MS', 'USE_POLL_PHASE_TRACKING')}
+    config['USE_FEATURE_REPORT'] = int(bool(
+        config['USE_BUTTON_REMAP'] or config['USE_STACK_MONITOR'] or
+        config['EXPANDER_COUNT'] or config['LINK_MODE'] == 1 or config['HALL_BUTTON_COUNT'] or
+        config['USE_BLACKBOX'] or config['USE_POLL_PHASE_TRACKING']))
+    for name in ('STR_MANUFACTURER', 'STR_PRODUCT', 'STR_SERIAL_NUMBER'):
+        config[name] = string(name)
+    return config
+
+
+def report_descriptor(config):
+    """returns the report descriptor of a configuration, as the gamepad's
+    gamepad_hid_report_desc"""
+    buttons = config['BUTTON_COUNT']
+    offset = 4 if config['DPAD_MODE'] == DPAD_HAT else 0
+    padding = (8 - (offset + buttons) % 8) % 8
+    d = [0x05, 0x01, 0x09, 0x05, 0xa1, 0x01, 0xa1, 0x00]
+    if config['DPAD_MODE'] == DPAD_AXES:
+        d += [0x09, 0x30, 0x09, 0x31, 0x15, 0x81, 0x25, 0x7f, 0x75, 0x08, 0x95, 0x02,
+              0x81, 0x02]
+    else:
+        d += [0x09, 0x39, 0x15, 0x00, 0x25, 0x07, 0x35, 0x00, 0x46, 0x3b, 0x01,
+              0x65, 0x14, 0x75, 0x04, 0x95, 0x01, 0x81, 0x42, 0x65, 0x00, 0x45, 0x00]
+    d += [0x05, 0x09, 0x19, 0x01, 0x29, buttons, 0x15, 0x00, 0x25, 0x01,
+          0x95, buttons, 0x75, 0x01, 0x81, 0x02]
+    if padding:
+        d += [0x95, padding, 0x75, 0x01, 0x81, 0x03]
+    if not config['USE_SPLIT_REPORTS']:
+        d += _analog_items(config, True)
+    d += [0xc0]
+    if config['USE_LOOPBACK_PROBE']:
+        d += [0x06, 0x00, 0xff, 0x09, 0x02, 0x15, 0x00, 0x26, 0xff, 0x00, 0x75, 0x08,
+              0x95, PROBE_REPORT_SIZE, 0x81, 0x02, 0x09, 0x03, 0x95, 0x01, 0x91, 0x02]
+    if config['USE_FEATURE_REPORT']:
+        d += [0x06, 0x00, 0xff, 0x09, 0x01, 0x15, 0x00, 0x26, 0xff, 0x00, 0x75, 0x08,
+              0x95, FEATURE_REPORT_SIZE, 0xb1, 0x02]
+    d += [0xc0]
+    return bytes(d)
+
+
+def _analog_items(config, page):
+    """returns the items of the axes and encoders, each with its usage page
+    in the state report, the page being set once in the analog report"""
+    d = []
+    if config['AXIS_COUNT']:
+        d += ([0x05, 0x01] if page else []) + \
+            [0x19, 0x32, 0x29, 0x32 + config['AXIS_COUNT'] - 1,
+             0x15, 0x81, 0x25, 0x7f, 0x75, 0x08, 0x95, config['AXIS_COUNT'], 0x81, 0x02]
+    if config['ENCODER_COUNT']:
+        d += ([0x05, 0x01] if page else []) + \
+            [0x19, 0x37, 0x29, 0x37 + config['ENCODER_COUNT'] - 1,
+             0x15, 0x81, 0x25, 0x7f, 0x75, 0x08, 0x95, config['ENCODER_COUNT'], 0x81, 0x06]
+    return d
+
+
+def analog_descriptor(config):
+    """returns the report descriptor of the analog interface of a
+    configuration with USE_SPLIT_REPORTS, as analog_hid_report_desc"""
+    return bytes([0x05, 0x01, 0x09, 0x05, 0xa1, 0x01, 0xa1, 0x00] +
+                 _analog_items(config, False) + [0xc0, 0xc0])
+
+
+def report_size(config):
+    """returns the size of the input report of a configuration, in bytes"""
+    offset = 4 if config['DPAD_MODE'] == DPAD_HAT else 0
+    analog = 0 if config['USE_SPLIT_REPORTS'] else config['AXIS_COUNT'] + config['ENCODER_COUNT']
+    return ((2 if config['DPAD_MODE'] == DPAD_AXES else 0) +
+            (offset + config['BUTTON_COUNT'] + 7) // 8 + analog +
+            (PROBE_REPORT_SIZE if config['USE_LOOPBACK_PROBE'] else 0))
+
+
+# usages of the Generic Desktop page the gamepad uses, by name
+DESKTOP_NAMES = {0x30: 'x', 0x31: 'y', 0x32: 'z', 0x33: 'rx', 0x34: 'ry', 0x35: 'rz',
+                 0x36: 'slider', 0x37: 'dial', 0x38: 'wheel', 0x39: 'hat'}
+
+
+class Field(object):
+    """one control of the input report: its name, where its bits are and
+    how to read them"""
+
+    def __init__(self, name, bit, size, signed, relative):
+        self.name = name
+        self.bit = bit
+        self.size = size
+        self.signed = signed
+        self.relative = relative
+
+    def value(self, report):
+        """reads the field from a report, given as bytes"""
+        first = self.bit // 8
+        last = (self.bit + self.size - 1) // 8
+        raw = int.from_bytes(report[first:last + 1], 'little') >> (self.bit % 8)
+        raw &= (1 << self.size) - 1
+        if self.signed and raw & (1 << (self.size - 1)):
+            raw -= 1 << self.size
+        return raw
+
+
+def _item_value(data, signed):
+    value = int.from_bytes(data, 'little')
+    if signed and data and value & (1 << (8 * len(data) - 1)):
+        value -= 1 << (8 * len(data))
+    return value
+
+
+def parse_descriptor(desc):
+    """returns the fields of the input report of a report descriptor, and
+    the report size in bytes. Only what a report without report IDs needs
+    is followed: usage pages, usages and usage ranges, logical minimum,
+    report size and count"""
+    fields = []
+    bit = 0
+    page = 0
+    logical_min = 0
+    size = 0
+    count = 0
+    usages = []
+    usage_min = None
+    i = 0
+    while i < len(desc):
+        prefix = desc[i]
+        n = (0, 1, 2, 4)[prefix & 3]
+        data = desc[i + 1:i + 1 + n]
+        i += 1 + n
+        tag = prefix & 0xFC
+        if tag == 0x04:                     # Usage Page
+            page = _item_value(data, False)
+        elif tag == 0x14:                   # Logical Minimum
+            logical_min = _item_value(data, True)
+        elif tag == 0x74:                   # Report Size
+            size = _item_value(data, False)
+        elif tag == 0x94:                   # Report Count
+            count = _item_value(data, False)
+        elif tag == 0x08:                   # Usage
+            usages.append((page, _item_value(data, False)))
+        elif tag == 0x18:                   # Usage Minimum
+            usage_min = _item_value(data, False)
+        elif tag == 0x28:                   # Usage Maximum
+            if usage_min is not None:
+                usages += [(page, u) for u in range(usage_min, _item_value(data, False) + 1)]
+            usage_min = None
+        elif tag == 0x80:                   # Input
+            flags = _item_value(data, False)
+            for k in range(count):
+                if not flags & 0x01:        # not constant
+                    p, u = usages[min(k, len(usages) - 1)] if usages else (page, 0)
+                    if p == 0x09:
+                        name = 'button%d' % u
+                    else:
+                        name = DESKTOP_NAMES.get(u, 'usage_%02x_%02x' % (p, u))
+                    fields.append(Field(name, bit, size, logical_min < 0, bool(flags & 0x04)))
+                bit += size
+            usages = []
+        elif tag in (0x90, 0xB0, 0xA0, 0xC0):  # Output, Feature, collections
+            usages = []
+    return fields, (bit + 7) // 8
+
+
+def decode(fields, report):
+    """returns the controls of a report as a dict: each axis, the hat, and
+    'buttons', the set of the pressed button numbers"""
+    state = {'buttons': set()}
+    for f in fields:
+        value = f.value(report)
+        if f.name.startswith('button'):
+            if value:
+                state['buttons'].add(int(f.name[6:]))
+        else:
+            state[f.name] = value
+    return state
+
+
+def format_state(state):
+    parts = ['%s %d' % (name, value) for name, value in sorted(state.items())
+             if name != 'buttons']
+    if 'buttons' in state:
+        parts.append('buttons %s' % (','.join(str(b) for b in sorted(state['buttons'])) or '-'))
+    return ', '.join(parts)
+
+
+def device_descriptor(device):
+    """returns the report descriptor of a hidraw device, from sysfs"""
+    name = os.path.basename(device)
+    with open('/sys/class/hidraw/%s/device/report_descriptor' % name, 'rb') as f:
+        return f.read()
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Gamepad input report layout')
+    ap.add_argument('--config', default=CONFIG)
+    ap.add_argument('--device', help='hidraw device to read the descriptor of instead')
+    args = ap.parse_args()
+
+    if args.device:
+        descs = [('', device_descriptor(args.device))]
+    else:
+        config = read_config(args.config)
+        descs = [('', report_descriptor(config))]
+        if config['USE_SPLIT_REPORTS']:
+            descs.append(('analog ', analog_descriptor(config)))
+    for name, desc in descs:
+        fields, size = parse_descriptor(desc)
+        print('%sreport descriptor, %d bytes: %s' % (name, len(desc), desc.hex()))
+        print('%sinput report, %d bytes' % (name, size))
+        for f in fields:
+            print('  %-10s bit %3d, %d bit%s%s%s' % (f.name, f.bit, f.size,
+                                                    's' if f.size > 1 else '',
+                                                    ', signed' if f.signed else '',
+                                                    ', relative' if f.relative else ''))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+# Teensy Simple Gamepad - measure the input reports the host receives
+# (Linux hidraw).
+#
+#   gamepad_latency.py [--seconds 10] [--show] [--csv] [--analog]
+#   gamepad_latency.py --emulate [--config simple_gamepad_config.h]
+#
+# Reads the gamepad's hidraw node, timestamping each input report with
+# CLOCK_MONOTONIC as soon as it is read, and decodes it with the report
+# descriptor the gamepad declares (gamepad_hid_report_desc, read back from
+# sysfs). At the end it prints:
+#
+#   rate                   reports a second
+#   interval               time between reports: mean, minimum, median,
+#                          99th percentile and maximum
+#   jitter                 standard deviation of the interval
+#   duplicates             share of reports with the same controls as the
+#                          one before (the gamepad repeats an unchanged
+#                          state about every 33 ms)
+#   latency                from each change to the first report holding it
+#
+# The latency needs the time of each change, which only the emulator knows:
+# with --emulate, a gamepad of the configuration is created with uhid (see
+# gamepad_uhid.py) and measured instead, which tests the tool and the
+# decoder without hardware, and gives the latency of the kernel and the
+# hidraw path alone. --show prints every decoded report, --csv one line of
+# results.
+#
+# A gamepad built with USE_SPLIT_REPORTS sends its axes and encoders in an
+# analog report, on an interface of its own; without them, the report
+# measured only holds the D-pad and buttons. --analog measures the analog
+# interface instead (only sent when an axis changes, so its duplicates are
+# none and its rate follows the changes).
+
+import argparse
+import os
+import select
+import statistics
+import sys
+import time
+
+from gamepad_hid import CONFIG, decode, device_descriptor, format_state, parse_descriptor, read_config
+from gamepad_remap import find_device
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p / 100.0 * len(values)))]
+
+
+def wait_device(find, timeout):
+    """returns the hidraw node found by find(), once it has appeared"""
+    deadline = time.monotonic() + timeout
+    while True:
+        device = find()
+        if device and os.access(device, os.R_OK):
+            return device
+        if time.monotonic() > deadline:
+            return None
+        time.sleep(0.05)
+
+
+def measure(fd, fields, seconds, show=False):
+    """reads reports for some seconds, returning their receive times (ns)
+    and contents"""
+    received = []
+    buf = bytearray(64)
+    end = time.monotonic() + seconds
+    while True:
+        left = end - time.monotonic()
+        if left <= 0:
+            break
+        if not select.select([fd], [], [], left)[0]:
+            continue
+        n = os.readv(fd, [buf])
+        now = time.clock_gettime_ns(time.CLOCK_MONOTONIC)
+        report = bytes(buf[:n])
+        received.append((now, report))
+        if show:
+            print('%.6f %s' % (now / 1e9, format_state(decode(fields, report))))
+    return received
+
+
+def summarize(received, fields, changes=None):
+    """returns the statistics of the reports received, as a dict. changes
+    are the (time, report) of each change sent, when known"""
+    s = {'reports': len(received)}
+    if len(received) < 2:
+        return s
+    times = [t for t, _ in received]
+    intervals = [(b - a) / 1000.0 for a, b in zip(times, times[1:])]
+    s['rate'] = (len(received) - 1) / ((times[-1] - times[0]) / 1e9)
+    s['interval_mean'] = statistics.mean(intervals)
+    s['interval_min'] = min(intervals)
+    s['interval_p50'] = percentile(intervals, 50)
+    s['interval_p99'] = percentile(intervals, 99)
+    s['interval_max'] = max(intervals)
+    s['jitter'] = statistics.pstdev(intervals)
+    states = [decode(fields, r) for _, r in received]
+    s['duplicates'] = sum(a == b for a, b in zip(states, states[1:])) / float(len(states) - 1)
+
+    if changes:
+        # each change is matched with the first report holding it received
+        # after it was sent
+        latencies = []
+        i = 0
+        for sent, report in changes:
+            while i < len(received) and received[i][0] < sent:
+                i += 1
+            j = i
+            while j < len(received) and received[j][1] != report:
+                j += 1
+            if j < len(received):
+                latencies.append((received[j][0] - sent) / 1000.0)
+        if latencies:
+            s['latency_count'] = len(latencies)
+            s['latency_mean'] = statistics.mean(latencies)
+            s['latency_p50'] = percentile(latencies, 50)
+            s['latency_p99'] = percentile(latencies, 99)
+            s['latency_max'] = max(latencies)
+    return s
+
+
+CSV_COLUMNS = ('reports', 'rate', 'interval_mean', 'interval_min', 'interval_p50',
+               'interval_p99', 'interval_max', 'jitter', 'duplicates', 'latency_count',
+               'latency_mean', 'latency_p50', 'latency_p99', 'latency_max')
+
+
+def report(s, csv, header):
+    if csv:
+        if header:
+            print(','.join(CSV_COLUMNS))
+        print(','.join('%.3f' % s[c] if isinstance(s.get(c), float) else str(s.get(c, ''))
+                       for c in CSV_COLUMNS))
+        return
+    print('%d reports' % s['reports'])
+    if s['reports'] < 2:
+        return
+    print('rate       %.1f reports/s' % s['rate'])
+    print('interval   mean %.1f us, min %.1f, median %.1f, 99%% %.1f, max %.1f'
+          % (s['interval_mean'], s['interval_min'], s['interval_p50'], s['interval_p99'],
+             s['interval_max']))
+    print('jitter     %.1f us' % s['jitter'])
+    print('duplicates %.1f%%' % (100 * s['duplicates']))
+    if 'latency_count' in s:
+        print('latency    mean %.1f us, median %.1f, 99%% %.1f, max %.1f (%d changes)'
+              % (s['latency_mean'], s['latency_p50'], s['latency_p99'], s['latency_max'],
+                 s['latency_count']))
+    else:
+        print('latency    not known (the change times are only known with --emulate)')
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Gamepad input report timing')
+    ap.add_argument('--device', help='hidraw device, found by VID/PID if not given')
+    ap.add_argument('--vid', type=lambda s: int(s, 0), default=0x16C0)
+    ap.add_argument('--pid', type=lambda s: int(s, 0))
+    ap.add_argument('--seconds', type=float, default=10)
+    ap.add_argument('--emulate', action='store_true', help='measure a uhid emulated gamepad')
+    ap.add_argument('--config', default=CONFIG, help='configuration of the emulated gamepad')
+    ap.add_argument('--rate', type=float, help='samples a second of the emulated gamepad')
+    ap.add_argument('--analog', action='store_true',
+                    help='measure the analog interface (USE_SPLIT_REPORTS)')
+    ap.add_argument('--show', action='store_true')
+    ap.add_argument('--csv', action='store_true')
+    ap.add_argument('--no-header', action='store_true')
+    args = ap.parse_args()
+
+    config = read_config(args.config)
+    pid = args.pid if args.pid is not None else config['PRODUCT_ID']
+    emulator = None
+    if args.emulate:
+        if args.analog and not config['USE_SPLIT_REPORTS']:
+            sys.exit('--analog needs a configuration with USE_SPLIT_REPORTS')
+        from gamepad_uhid import Emulator
+        emulator = Emulator(config, rate=args.rate)
+    if args.device:
+        device = args.device
+    elif emulator:
+        from gamepad_uhid import find_emulated
+        device = wait_device(lambda: find_emulated(args.analog), 5.0)
+    else:
+        device = find_device(args.vid, pid, args.analog)
+    if not device:
+        sys.exit('no gamepad %sfound with VID 0x%04X PID 0x%04X'
+                 % ('analog interface ' if args.analog else '', args.vid, pid))
+
+    fields, _ = parse_descriptor(device_descriptor(device))
+    fd = os.open(device, os.O_RDONLY)
+    if emulator:
+        emulator.start()
+    try:
+        received = measure(fd, fields, args.seconds, args.show)
+    finally:
+        if emulator:
+            emulator.close()
+        os.close(fd)
+
+    s = summarize(received, fields, emulator.sent_changes(args.analog) if emulator else None)
+    report(s, args.csv, not args.no_header)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
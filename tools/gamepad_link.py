@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+# Teensy Simple Gamepad - show the latency, frames and errors of each
+# secondary board of a primary built with LINK_MODE LINK_PRIMARY, through
+# its feature report (Linux hidraw).
+#
+#   gamepad_link.py [--csv]
+#
+# The latency is the time from the poll a secondary sampled its buttons on
+# to the report holding a change of them being loaded into the USB
+# endpoint, measured by the primary with Timer3; the host still collects it
+# at its next poll. Missed polls were not answered by a good frame in time.
+# The CRC, UART and overflow errors are for the link as a whole.
+
+import argparse
+import os
+import struct
+import sys
+
+from gamepad_remap import find_device, request
+
+FEATURE_LINK_READ = 0x06
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Gamepad board link statistics')
+    ap.add_argument('--device', help='hidraw device, found by VID/PID if not given')
+    ap.add_argument('--vid', type=lambda s: int(s, 0), default=0x16C0)
+    ap.add_argument('--pid', type=lambda s: int(s, 0), default=0x047A)
+    ap.add_argument('--f-cpu', type=float, default=16e6)
+    ap.add_argument('--csv', action='store_true')
+    args = ap.parse_args()
+
+    device = args.device or find_device(args.vid, args.pid)
+    if not device:
+        sys.exit('no gamepad found with VID 0x%04X PID 0x%04X' % (args.vid, args.pid))
+    fd = os.open(device, os.O_RDWR)
+    tick_us = 64 * 1e6 / args.f_cpu
+
+    if args.csv:
+        print('secondary,last_us,max_us,frames,missed')
+    n = 0
+    count = 1
+    errors = (0, 0, 0)
+    while n < count:
+        result = request(fd, FEATURE_LINK_READ, bytearray([n]))
+        count = result[0]
+        last, worst, frames, missed = struct.unpack('<4H', bytes(result[2:10]))
+        errors = struct.unpack('<3H', bytes(result[10:16]))
+        if args.csv:
+            print('%d,%.0f,%.0f,%d,%d' % (n, last * tick_us, worst * tick_us, frames, missed))
+        else:
+            print('secondary %d: latency last %.0f us, max %.0f us, %d frames, %d missed'
+                  % (n, last * tick_us, worst * tick_us, frames, missed))
+        n += 1
+    if not args.csv:
+        print('link: %d CRC errors, %d UART errors, %d bytes lost' % errors)
+    os.close(fd)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
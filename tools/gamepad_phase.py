@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+# Teensy Simple Gamepad - show how well a gamepad built with
+# USE_POLL_PHASE_TRACKING follows the host polls, through its feature
+# report (Linux hidraw).
+#
+#   gamepad_phase.py [--watch]
+#
+# Prints the learned time of the host poll within the USB frame, and the
+# age of the sampled inputs when the host collected the last report and at
+# worst since the gamepad was reset. With the phase locked, the age should
+# stay close to POLL_GUARD_US; ages near a whole poll interval mean the
+# sample is taken after the poll and the report waits for the next one.
+# --watch prints them once a second until interrupted.
+
+import argparse
+import os
+import struct
+import sys
+import time
+
+from gamepad_remap import find_device, request
+
+FEATURE_PHASE_READ = 0x09
+
+
+def read_phase(fd):
+    """returns the poll interval (ms), the Timer1 ticks per ms, the guard
+    time (us), then locked, the poll offset, the last and max sample age
+    (ticks) and the count of reports collected"""
+    result = request(fd, FEATURE_PHASE_READ)
+    interval = result[0]
+    ticks, guard = struct.unpack('<2H', bytes(result[1:5]))
+    locked = result[5]
+    offset, last, worst, collected = struct.unpack('<4H', bytes(result[6:14]))
+    return interval, ticks, guard, locked, offset, last, worst, collected
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Gamepad poll phase tracking')
+    ap.add_argument('--device', help='hidraw device, found by VID/PID if not given')
+    ap.add_argument('--vid', type=lambda s: int(s, 0), default=0x16C0)
+    ap.add_argument('--pid', type=lambda s: int(s, 0), default=0x047A)
+    ap.add_argument('--watch', action='store_true', help='print until interrupted')
+    args = ap.parse_args()
+
+    device = args.device or find_device(args.vid, args.pid)
+    if not device:
+        sys.exit('no gamepad found with VID 0x%04X PID 0x%04X' % (args.vid, args.pid))
+    fd = os.open(device, os.O_RDWR)
+
+    interval, ticks, guard, locked, offset, last, worst, collected = read_phase(fd)
+    tick_us = 1000.0 / ticks
+    print('poll every %d ms, sample %d us before it' % (interval, guard))
+    try:
+        while True:
+            if locked:
+                print('poll at %.0f us into the frame, sample age: last %.0f us, '
+                      'max %.0f us, %d reports collected'
+                      % (offset * tick_us, last * tick_us, worst * tick_us, collected))
+            else:
+                print('no host poll seen yet')
+            if not args.watch:
+                break
+            time.sleep(1)
+            _, _, _, locked, offset, last, worst, collected = read_phase(fd)
+    except KeyboardInterrupt:
+        pass
+    os.close(fd)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
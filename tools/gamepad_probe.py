@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+# Teensy Simple Gamepad - measure the USB round trip of a gamepad built with
+# USE_LOOPBACK_PROBE, with its loopback probe (Linux hidraw).
+#
+#   gamepad_probe.py [--count 1000] [--interval 0.005] [--csv]
+#
+# Each probe writes a token in an output report, which the host sends in a
+# SET_REPORT control transfer, and waits for the input report carrying the
+# token back. The gamepad gives the Timer3 time and USB frame number at
+# which the token arrived and the report was loaded, so the round trip
+# seen by the host splits into:
+#   gamepad     from the token arriving to the report being loaded
+#   usb + host  the rest: the output transfer, the wait for the host's
+#               poll of the input endpoint, and both host stacks
+# The one-way estimate is half of usb + host. The frames column counts the
+# USB frames (1 ms) from the token arriving to the report being loaded.
+
+import argparse
+import os
+import select
+import statistics
+import sys
+import time
+
+from gamepad_hid import PROBE_REPORT_SIZE, parse_descriptor, device_descriptor
+from gamepad_remap import find_device
+
+
+def probe(fd, token, size, timeout):
+    """writes a token and returns the host round trip in us, the gamepad
+    time and frames from the token to the report, or None on a timeout"""
+    t0 = time.monotonic_ns()
+    # the output report has no report ID, hidraw wants a 0 in its place
+    os.write(fd, bytes([0, token]))
+    deadline = t0 + int(timeout * 1e9)
+    while True:
+        left = (deadline - time.monotonic_ns()) / 1e9
+        if left <= 0 or not select.select([fd], [], [], left)[0]:
+            return None
+        report = os.read(fd, 64)
+        t1 = time.monotonic_ns()
+        if len(report) < size:
+            continue
+        p = report[size - PROBE_REPORT_SIZE:size]
+        if p[0] != token:
+            continue
+        rx_frame, rx_time = p[1], p[2] | (p[3] << 8)
+        load_frame, load_time = p[4], p[5] | (p[6] << 8)
+        return ((t1 - t0) / 1000.0, (load_time - rx_time) & 0xFFFF,
+                (load_frame - rx_frame) & 0xFF)
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Gamepad USB loopback latency')
+    ap.add_argument('--device', help='hidraw device, found by VID/PID if not given')
+    ap.add_argument('--vid', type=lambda s: int(s, 0), default=0x16C0)
+    ap.add_argument('--pid', type=lambda s: int(s, 0), default=0x047A)
+    ap.add_argument('--f-cpu', type=float, default=16e6)
+    ap.add_argument('--count', type=int, default=1000)
+    ap.add_argument('--interval', type=float, default=0.005, help='seconds between probes')
+    ap.add_argument('--timeout', type=float, default=0.1)
+    ap.add_argument('--csv', action='store_true', help='print every probe')
+    args = ap.parse_args()
+
+    device = args.device or find_device(args.vid, args.pid)
+    if not device:
+        sys.exit('no gamepad found with VID 0x%04X PID 0x%04X' % (args.vid, args.pid))
+    size = parse_descriptor(device_descriptor(device))[1]
+    fd = os.open(device, os.O_RDWR)
+    tick_us = 64 * 1e6 / args.f_cpu
+
+    rtts, gamepad, usb = [], [], []
+    lost = 0
+    if args.csv:
+        print('token,rtt_us,gamepad_us,frames,usb_host_us,one_way_us')
+    for i in range(args.count):
+        token = i & 0xFF
+        result = probe(fd, token, size, args.timeout)
+        if result is None:
+            lost += 1
+            continue
+        rtt, ticks, frames = result
+        inside = ticks * tick_us
+        rtts.append(rtt)
+        gamepad.append(inside)
+        usb.append(rtt - inside)
+        if args.csv:
+            print('%d,%.1f,%.1f,%d,%.1f,%.1f' % (token, rtt, inside, frames, rtt - inside,
+                                                (rtt - inside) / 2))
+        time.sleep(args.interval)
+    os.close(fd)
+
+    if not rtts:
+        sys.exit('no probe came back: is the gamepad built with USE_LOOPBACK_PROBE?')
+    if not args.csv:
+        for name, values in (('round trip', rtts), ('gamepad', gamepad), ('usb + host', usb)):
+            print('%-11s mean %7.1f us, median %7.1f, min %7.1f, max %7.1f'
+                  % (name, statistics.mean(values), statistics.median(values),
+                     min(values), max(values)))
+        print('one-way estimate %.1f us; %d probes, %d lost'
+              % (statistics.median(usb) / 2, len(rtts), lost))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
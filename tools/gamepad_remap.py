@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+# Teensy Simple Gamepad - show or change the button remapping of a gamepad
+# built with USE_BUTTON_REMAP, through its feature report (Linux hidraw).
+#
+#   gamepad_remap.py show
+#   gamepad_remap.py set 2 1 3 4 5i - 7 8
+#   gamepad_remap.py reset
+#
+# 'set' takes one entry per pin button of the report, in report order: the
+# number of the button pin it reads (1 for BTN1's pin, as listed in
+# simple_gamepad_config.h for each board), followed by 'i' to invert it, or '-' to disable
+# the button. The example swaps BTN1 and BTN2, inverts BTN5 and disables
+# BTN6. The mapping is stored in the gamepad's EEPROM.
+
+import argparse
+import fcntl
+import glob
+import os
+import re
+import sys
+import time
+
+FEATURE_REPORT_SIZE = 32
+
+FEATURE_REMAP_READ = 0x01
+FEATURE_REMAP_WRITE = 0x02
+FEATURE_REMAP_RESET = 0x03
+FEATURE_REMAP_PAGE = FEATURE_REPORT_SIZE - 4
+
+FEATURE_OK = 0x00
+FEATURE_BUSY = 0x01
+STATUS_NAMES = {0x02: 'command not supported', 0x03: 'mapping not valid'}
+
+REMAP_PIN_MASK = 0x3F
+REMAP_INVERT = 0x40
+REMAP_DISABLE = 0x80
+
+# the report descriptors of the gamepad's interfaces start with Generic
+# Desktop, Gamepad; the keyboard's with Keyboard
+GAMEPAD_USAGE = bytes([0x05, 0x01, 0x09, 0x05])
+
+
+def _ioc(direction, nr, size):
+    return (direction << 30) | (size << 16) | (ord('H') << 8) | nr
+
+
+def hidiocsfeature(size):
+    return _ioc(3, 0x06, size)
+
+
+def hidiocgfeature(size):
+    return _ioc(3, 0x07, size)
+
+
+def other_interface(phys):
+    """tells whether a HID_PHYS is of another interface than the gamepad's,
+    the first: the keyboard of a gamepad built with USE_KEYBOARD, or its
+    analog interface with USE_SPLIT_REPORTS"""
+    return re.search(r'/input[1-9][0-9]*$', phys) is not None
+
+
+def analog_interface(device):
+    """tells whether the hidraw node of another interface than the
+    gamepad's is its analog interface, rather than its keyboard"""
+    name = os.path.basename(device)
+    with open('/sys/class/hidraw/%s/device/report_descriptor' % name, 'rb') as f:
+        return f.read(len(GAMEPAD_USAGE)) == GAMEPAD_USAGE
+
+
+def find_device(vid, pid, analog=False):
+    """returns the hidraw node of the gamepad interface, or of the analog
+    one, of the first gamepad with the VID and PID"""
+    want = 'HID_ID=0003:%08X:%08X' % (vid, pid)
+    for path in sorted(glob.glob('/sys/class/hidraw/hidraw*')):
+        device = '/dev/' + os.path.basename(path)
+        try:
+            with open(os.path.join(path, 'device', 'uevent')) as f:
+                uevent = f.read()
+            phys = re.search(r'^HID_PHYS=(.*)$', uevent, re.M)
+            other = bool(phys and other_interface(phys.group(1)))
+            if want in uevent.upper() and other == analog and \
+                    (not analog or analog_interface(device)):
+                return device
+        except OSError:
+            pass
+    return None
+
+
+def request(fd, command, args=b'', timeout=1.0):
+    # the report has no report ID, hidraw wants a 0 in its place
+    buf = bytearray([0, command]) + bytearray(args)
+    buf += bytearray(FEATURE_REPORT_SIZE + 1 - len(buf))
+    deadline = time.time() + timeout
+    while True:
+        try:
+            fcntl.ioctl(fd, hidiocsfeature(len(buf)), bytes(buf))
+            break
+        except OSError:
+            # refused while the gamepad is still busy with a request
+            if time.time() > deadline:
+                raise
+            time.sleep(0.01)
+    while True:
+        result = bytearray(FEATURE_REPORT_SIZE + 1)
+        fcntl.ioctl(fd, hidiocgfeature(len(result)), result, True)
+        result = result[1:]
+        if result[0] == command and result[1] != FEATURE_BUSY:
+            break
+        if time.time() > deadline:
+            sys.exit('gamepad did not answer')
+        time.sleep(0.01)
+    if result[1] != FEATURE_OK:
+        sys.exit('gamepad refused: %s' % STATUS_NAMES.get(result[1], result[1]))
+    return result[2:]
+
+
+def parse_entry(text):
+    if text == '-':
+        return REMAP_DISABLE
+    value = 0
+    if text.endswith('i'):
+        value |= REMAP_INVERT
+        text = text[:-1]
+    pin = int(text)
+    if pin < 1 or pin > REMAP_PIN_MASK + 1:
+        raise ValueError('not a button pin: %s' % text)
+    return value | (pin - 1)
+
+
+def format_entry(value):
+    if value & REMAP_DISABLE:
+        return '-'
+    return '%d%s' % ((value & REMAP_PIN_MASK) + 1, 'i' if value & REMAP_INVERT else '')
+
+
+def read_map(fd):
+    # the mapping comes a page at a time
+    result = request(fd, FEATURE_REMAP_READ, bytearray([0]))
+    count = result[0]
+    remap = bytearray(result[2:2 + min(count, FEATURE_REMAP_PAGE)])
+    while len(remap) < count:
+        result = request(fd, FEATURE_REMAP_READ, bytearray([len(remap)]))
+        remap += result[2:2 + min(count - len(remap), FEATURE_REMAP_PAGE)]
+    return remap
+
+
+def write_map(fd, remap):
+    for first in range(0, len(remap), FEATURE_REMAP_PAGE):
+        page = remap[first:first + FEATURE_REMAP_PAGE]
+        request(fd, FEATURE_REMAP_WRITE, bytearray([first, len(page)]) + page)
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Gamepad button remapping')
+    ap.add_argument('--device', help='hidraw device, found by VID/PID if not given')
+    ap.add_argument('--vid', type=lambda s: int(s, 0), default=0x16C0)
+    ap.add_argument('--pid', type=lambda s: int(s, 0), default=0x047A)
+    ap.add_argument('command', choices=('show', 'set', 'reset'))
+    ap.add_argument('map', nargs='*')
+    args = ap.parse_args()
+
+    device = args.device or find_device(args.vid, args.pid)
+    if not device:
+        sys.exit('no gamepad found with VID 0x%04X PID 0x%04X' % (args.vid, args.pid))
+    fd = os.open(device, os.O_RDWR)
+
+    if args.command == 'set':
+        count = len(read_map(fd))
+        if len(args.map) != count:
+            sys.exit('the gamepad has %d pin buttons, give one entry for each' % count)
+        write_map(fd, bytearray(parse_entry(e) for e in args.map))
+    elif args.command == 'reset':
+        request(fd, FEATURE_REMAP_RESET)
+
+    print(' '.join(format_entry(v) for v in read_map(fd)))
+    os.close(fd)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
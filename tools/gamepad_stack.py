@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+# Teensy Simple Gamepad - read the stack high-water mark of a gamepad built
+# with USE_STACK_MONITOR, through its feature report (Linux hidraw).
+#
+#   gamepad_stack.py [--csv]
+#
+# Prints the most bytes of stack used since the gamepad was reset, out of
+# the RAM left for it after the static data. --csv prints them as a
+# used,size line. tools/avr_benchmark.py --load reads it the same way into
+# its table.
+
+import argparse
+import os
+import sys
+
+from gamepad_remap import find_device, request
+
+FEATURE_STACK_READ = 0x04
+
+
+def read_stack(fd):
+    """returns the bytes of stack used and the bytes left for it"""
+    result = request(fd, FEATURE_STACK_READ)
+    return result[0] | (result[1] << 8), result[2] | (result[3] << 8)
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Gamepad stack high-water mark')
+    ap.add_argument('--device', help='hidraw device, found by VID/PID if not given')
+    ap.add_argument('--vid', type=lambda s: int(s, 0), default=0x16C0)
+    ap.add_argument('--pid', type=lambda s: int(s, 0), default=0x047A)
+    ap.add_argument('--csv', action='store_true')
+    args = ap.parse_args()
+
+    device = args.device or find_device(args.vid, args.pid)
+    if not device:
+        sys.exit('no gamepad found with VID 0x%04X PID 0x%04X' % (args.vid, args.pid))
+    fd = os.open(device, os.O_RDWR)
+    used, size = read_stack(fd)
+    os.close(fd)
+
+    if args.csv:
+        print('%d,%d' % (used, size))
+    else:
+        print('stack used %d of %d bytes (%.1f%%)' % (used, size, 100.0 * used / size))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,253 @@
+#!/usr/bin/env python3
+# Teensy Simple Gamepad - emulate the gamepad with uhid, for testing the
+# host tools on a machine with no gamepad attached (Linux, needs write
+# access to /dev/uhid).
+#
+#   gamepad_uhid.py [--config simple_gamepad_config.h] [--rate 1000]
+#                   [--change-every 8] [--serial 00002] [--seconds 10]
+#
+# The emulated device has the VID, PID, strings and report descriptor of
+# the configuration, so it gets a hidraw node and an input device like the
+# gamepad. Like the gamepad, it samples once per POLL_INTERVAL_MS (or every
+# 1000 / --rate ms), changes its state every --change-every samples (a
+# walk through the buttons, the D-pad and the axes), and sends a report
+# when the state changed or, unchanged, about every 33 ms. Feature reports
+# are answered as by a gamepad that knows no command. With
+# USE_SPLIT_REPORTS the axes are swept in the analog report instead, on a
+# second device of the same serial number standing for the analog
+# interface, sent when they changed and at most every ANALOG_INTERVAL_MS.
+#
+# The Emulator class is also used by the other tools, which then know the
+# time each change was sent (CLOCK_MONOTONIC) to measure their latency.
+
+import argparse
+import glob
+import os
+import select
+import struct
+import sys
+import threading
+import time
+
+from gamepad_hid import (CONFIG, DPAD_AXES, FEATURE_REPORT_SIZE, HAT_CENTER, VENDOR_ID,
+                         analog_descriptor, read_config, report_descriptor, report_size)
+
+# linux/uhid.h
+UHID_DESTROY = 1
+UHID_START = 2
+UHID_STOP = 3
+UHID_OPEN = 4
+UHID_CLOSE = 5
+UHID_OUTPUT = 6
+UHID_GET_REPORT = 9
+UHID_GET_REPORT_REPLY = 10
+UHID_CREATE2 = 11
+UHID_INPUT2 = 12
+UHID_SET_REPORT = 13
+UHID_SET_REPORT_REPLY = 14
+UHID_DATA_MAX = 4096
+UHID_EVENT_SIZE = 4 + 128 + 64 + 64 + 2 + 2 + 4 * 4 + UHID_DATA_MAX
+BUS_USB = 0x03
+
+# the firmware sends an unchanged state about every 33 ms
+NOCHANGE_TX_MS = 33
+
+# the feature report result of a command the gamepad does not know
+FEATURE_UNKNOWN = 0x02
+
+
+# the phys of the emulated devices, which tells them from real gamepads,
+# and of their analog interface
+EMULATOR_PHYS = 'gamepad_uhid'
+EMULATOR_ANALOG_PHYS = EMULATOR_PHYS + '/input1'
+
+
+def find_emulated(analog=False):
+    """returns the hidraw node of an emulated gamepad, or of its analog
+    interface, or None"""
+    phys = EMULATOR_ANALOG_PHYS if analog else EMULATOR_PHYS
+    for path in sorted(glob.glob('/sys/class/hidraw/hidraw*')):
+        try:
+            with open(os.path.join(path, 'device', 'uevent')) as f:
+                if 'HID_PHYS=%s\n' % phys in f.read():
+                    return '/dev/' + os.path.basename(path)
+        except OSError:
+            pass
+    return None
+
+
+def _event(kind, payload=b''):
+    data = struct.pack('<I', kind) + payload
+    return data + bytes(UHID_EVENT_SIZE - len(data))
+
+
+class Emulator(object):
+    """a gamepad of a configuration, created with uhid. The reports are
+    sent by a thread, from start() to stop(), and sent_changes() gives the
+    time each changed report was written and the report"""
+
+    def __init__(self, config, serial=None, rate=None, change_every=8):
+        self.config = config
+        self.size = report_size(config)
+        self.split = bool(config['USE_SPLIT_REPORTS'])
+        self.analog_size = config['AXIS_COUNT'] + config['ENCODER_COUNT']
+        self.interval = 1.0 / rate if rate else config['POLL_INTERVAL_MS'] / 1000.0
+        self.change_every = change_every
+        self.changes = []
+        self.analog_changes = []
+        self._stop = threading.Event()
+        self._thread = None
+        serial = serial or config['STR_SERIAL_NUMBER']
+        self.fd = self._create(serial, EMULATOR_PHYS, report_descriptor(config))
+        self.analog_fd = None
+        if self.split:
+            self.analog_fd = self._create(serial, EMULATOR_ANALOG_PHYS, analog_descriptor(config))
+
+    def _create(self, serial, phys, desc):
+        c = self.config
+        fd = os.open('/dev/uhid', os.O_RDWR | os.O_CLOEXEC)
+        name = ('%s %s' % (c['STR_MANUFACTURER'], c['STR_PRODUCT'])).encode()
+        payload = struct.pack('<128s64s64sHHIIII', name[:127], phys.encode(),
+                              serial.encode()[:63], len(desc), BUS_USB, VENDOR_ID,
+                              c['PRODUCT_ID'], 0x0100, 0)
+        os.write(fd, _event(UHID_CREATE2, payload + desc))
+        return fd
+
+    def close(self):
+        self.stop()
+        for fd in (self.fd, self.analog_fd):
+            if fd is not None:
+                os.write(fd, _event(UHID_DESTROY))
+                os.close(fd)
+
+    def state_report(self, step):
+        """returns the report of the state at a step of the walk: one button
+        at a time, then each D-pad direction, then the axes swept"""
+        c = self.config
+        report = bytearray(self.size)
+        buttons = c['BUTTON_COUNT']
+        phase = step % (buttons + 5)
+        offset = 0
+        hat = HAT_CENTER
+        if c['DPAD_MODE'] == DPAD_AXES:
+            if buttons <= phase < buttons + 4:
+                report[(phase - buttons) // 2] = (0x81, 0x7F)[(phase - buttons) % 2]
+            offset = 2
+            bit = 0
+        else:
+            if buttons <= phase < buttons + 4:
+                hat = (0, 4, 6, 2)[phase - buttons]
+            bit = 4
+        if phase < buttons:
+            bit += phase
+            report[offset + bit // 8] |= 1 << (bit % 8)
+        if c['DPAD_MODE'] != DPAD_AXES:
+            report[offset] |= hat
+        # the axes follow the button bytes, unless they have a report of
+        # their own
+        if not self.split:
+            first = offset + (4 * (c['DPAD_MODE'] != DPAD_AXES) + buttons + 7) // 8
+            report[first:first + c['AXIS_COUNT']] = self.axes(step)
+        return bytes(report)
+
+    def axes(self, step):
+        """returns the axis bytes at a step of the walk"""
+        return bytes(((step * 8 + i * 32) % 255 - 127) & 0xFF
+                     for i in range(self.config['AXIS_COUNT']))
+
+    def analog_report(self, step):
+        """returns the analog report at a step of the walk, the encoders
+        left still"""
+        return self.axes(step) + bytes(self.analog_size - self.config['AXIS_COUNT'])
+
+    def send(self, report, fd=None):
+        os.write(fd or self.fd, _event(UHID_INPUT2, struct.pack('<H', len(report)) + report))
+
+    def _answer(self):
+        # events from the kernel: feature reports are answered, the others
+        # are of no interest
+        for fd in (self.fd, self.analog_fd):
+            while fd is not None and select.select([fd], [], [], 0)[0]:
+                ev = os.read(fd, UHID_EVENT_SIZE)
+                kind = struct.unpack_from('<I', ev)[0]
+                if kind == UHID_GET_REPORT:
+                    rid, rnum, rtype = struct.unpack_from('<IBB', ev, 4)
+                    result = bytearray(FEATURE_REPORT_SIZE)
+                    result[1] = FEATURE_UNKNOWN
+                    os.write(fd, _event(UHID_GET_REPORT_REPLY,
+                                        struct.pack('<IHH', rid, 0, len(result)) + result))
+                elif kind == UHID_SET_REPORT:
+                    rid = struct.unpack_from('<I', ev, 4)[0]
+                    os.write(fd, _event(UHID_SET_REPORT_REPLY, struct.pack('<IH', rid, 0)))
+
+    def run(self, seconds=None):
+        """samples and sends reports until stopped, or for some seconds"""
+        step = 0
+        last = None
+        unchanged = 0
+        last_analog = None
+        analog_wait = 0
+        start = time.monotonic()
+        deadline = start
+        while not self._stop.is_set():
+            if seconds is not None and time.monotonic() - start >= seconds:
+                break
+            self._answer()
+            report = self.state_report(step // self.change_every)
+            unchanged += self.interval * 1000
+            if report != last or unchanged >= NOCHANGE_TX_MS:
+                now = time.clock_gettime_ns(time.CLOCK_MONOTONIC)
+                self.send(report)
+                if report != last:
+                    self.changes.append((now, report))
+                last = report
+                unchanged = 0
+            if self.split:
+                analog_wait -= self.interval * 1000
+                analog = self.analog_report(step // self.change_every)
+                if analog != last_analog and analog_wait <= 0:
+                    now = time.clock_gettime_ns(time.CLOCK_MONOTONIC)
+                    self.send(analog, self.analog_fd)
+                    self.analog_changes.append((now, analog))
+                    last_analog = analog
+                    analog_wait = self.config['ANALOG_INTERVAL_MS']
+            step += 1
+            deadline += self.interval
+            delay = deadline - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+
+    def start(self):
+        self._thread = threading.Thread(target=self.run, daemon=True)
+        self._thread.start()
+
+    def stop(self):
+        self._stop.set()
+        if self._thread:
+            self._thread.join()
+            self._thread = None
+
+    def sent_changes(self, analog=False):
+        return list(self.analog_changes if analog else self.changes)
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Emulated gamepad (uhid)')
+    ap.add_argument('--config', default=CONFIG)
+    ap.add_argument('--serial', help='serial number (default STR_SERIAL_NUMBER)')
+    ap.add_argument('--rate', type=float, help='samples a second (default 1000 / POLL_INTERVAL_MS)')
+    ap.add_argument('--change-every', type=int, default=8, help='samples between changes')
+    ap.add_argument('--seconds', type=float, help='run time (default until interrupted)')
+    args = ap.parse_args()
+
+    emulator = Emulator(read_config(args.config), args.serial, args.rate, args.change_every)
+    try:
+        emulator.run(args.seconds)
+    except KeyboardInterrupt:
+        pass
+    emulator.close()
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
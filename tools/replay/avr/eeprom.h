@@ -0,0 +1,21 @@
+/* Teensy Simple Gamepad - host replay build: the EEPROM is an array in
+   replay.c, and the gamepad gives its addresses as pointers */
+#ifndef REPLAY_AVR_EEPROM_H
+#define REPLAY_AVR_EEPROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EEMEM
+
+void eeprom_read_block(void *dst, const void *src, size_t n);
+void eeprom_update_block(const void *src, void *dst, size_t n);
+uint8_t eeprom_read_byte(const uint8_t *p);
+uint16_t eeprom_read_word(const uint16_t *p);
+void eeprom_update_byte(uint8_t *p, uint8_t value);
+void eeprom_update_word(uint16_t *p, uint16_t value);
+#define eeprom_write_byte   eeprom_update_byte
+#define eeprom_busy_wait()  ((void)0)
+#define eeprom_is_ready()   1
+
+#endif
@@ -0,0 +1,15 @@
+/* Teensy Simple Gamepad - host replay build: interrupts never run, the
+   handlers are plain functions */
+#ifndef REPLAY_AVR_INTERRUPT_H
+#define REPLAY_AVR_INTERRUPT_H
+
+#define ISR(vector, ...)    void vector(void)
+#define EMPTY_INTERRUPT(v)  void v(void) {}
+#define ISR_NAKED
+#define ISR_NOBLOCK
+#define ISR_ALIASOF(v)
+#define sei()               ((void)0)
+#define cli()               ((void)0)
+#define reti()              ((void)0)
+
+#endif
@@ -0,0 +1,64 @@
+/* Teensy Simple Gamepad - host replay build: the registers the gamepad
+   uses, as plain variables defined in replay.c. Writes to UEDATX go to
+   the report being captured, see replay_fifo, and UEINTX and UESTA0X are
+   those of the endpoint banks modelled by replay_endpoint */
+#ifndef REPLAY_AVR_IO_H
+#define REPLAY_AVR_IO_H
+
+#include <stdint.h>
+
+#define REPLAY_REG8(n)  extern volatile uint8_t n;
+#define REPLAY_REG16(n) extern volatile uint16_t n;
+#include "replay_regs.h"
+#undef REPLAY_REG8
+#undef REPLAY_REG16
+
+extern volatile uint8_t *replay_fifo(void);
+#define UEDATX (*replay_fifo())
+extern volatile uint8_t *replay_endpoint(uint8_t status);
+#define UEINTX (*replay_endpoint(0))
+#define UESTA0X (*replay_endpoint(1))
+
+#define _BV(b)      (1 << (b))
+#define RAMSTART    0x100
+#define RAMEND      0x0AFF
+
+enum
+{
+    // USB
+    EORSTE = 3, SOFE = 2, EORSTI = 3, SOFI = 2, SUSPI = 0, WAKEUPI = 4,
+    SUSPE = 0, WAKEUPE = 4, RXSTPI = 3, RXOUTI = 2, TXINI = 0, RWAL = 5,
+    FIFOCON = 7, NAKINI = 6, STALLEDI = 1, NAKOUTI = 4, KILLBK = 2,
+    RXSTPE = 3, RXOUTE = 2, TXINE = 0, NAKINE = 6, STALLRQ = 5,
+    STALLRQC = 4, RSTDT = 3, EPEN = 0, ADDEN = 7, PLOCK = 0, PLLE = 1,
+    PLLP0 = 2, USBE = 7, OTGPADE = 4, FRZCLK = 5, NBUSYBK0 = 0,
+    NBUSYBK1 = 1, CURRBK0 = 2, CURRBK1 = 3, DTSEQ0 = 2, CFGOK = 7,
+    ALLOC = 1, DETACH = 0, RMWKUP = 1,
+    // timers
+    WGM01 = 1, CS00 = 0, CS01 = 1, CS02 = 2, OCIE0A = 1, OCF0A = 1,
+    TOIE0 = 0, WGM12 = 3, CS10 = 0, CS11 = 1, CS12 = 2, OCIE1A = 1,
+    OCF1A = 1, CS30 = 0, CS31 = 1, CS32 = 2,
+    // external and pin change interrupts
+    PCIE0 = 0, PCIF0 = 0, PCIE1 = 1, PCIF1 = 1, INT0 = 0, INT1 = 1,
+    INT2 = 2, INT3 = 3, INT6 = 6, ISC00 = 0, ISC01 = 1, ISC10 = 2,
+    ISC11 = 3, ISC20 = 4, ISC21 = 5, ISC30 = 6, ISC31 = 7, ISC40 = 0,
+    ISC50 = 2, ISC60 = 4, ISC61 = 5, ISC70 = 6, INTF0 = 0, INTF1 = 1,
+    INTF2 = 2, INTF3 = 3, INTF6 = 6,
+    // TWI
+    TWINT = 7, TWEA = 6, TWSTA = 5, TWSTO = 4, TWEN = 2, TWIE = 0,
+    TWPS0 = 0, TWPS1 = 1,
+    // UART
+    RXC1 = 7, TXC1 = 6, UDRE1 = 5, FE1 = 4, DOR1 = 3, UPE1 = 2, U2X1 = 1,
+    RXCIE1 = 7, TXCIE1 = 6, UDRIE1 = 5, RXEN1 = 4, TXEN1 = 3, UCSZ12 = 2,
+    UCSZ11 = 2, UCSZ10 = 1,
+    // ADC
+    REFS0 = 6, REFS1 = 7, ADLAR = 5, MUX0 = 0, MUX5 = 5, ADEN = 7,
+    ADSC = 6, ADATE = 5, ADIF = 4, ADIE = 3, ADPS0 = 0, ADPS1 = 1,
+    ADPS2 = 2, ACD = 7,
+    // EEPROM, sleep and power
+    EERE = 0, EEPE = 1, EEMPE = 2, SE = 0, SM0 = 1, SM1 = 2, SM2 = 3,
+    PRTIM0 = 5, PRTIM1 = 3, PRADC = 0, PRSPI = 2, PRTWI = 7,
+    PRUSART1 = 0, PRTIM3 = 3, PRTIM4 = 4, PRUSB = 7
+};
+
+#endif
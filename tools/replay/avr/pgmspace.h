@@ -0,0 +1,16 @@
+/* Teensy Simple Gamepad - host replay build: flash is plain memory */
+#ifndef REPLAY_AVR_PGMSPACE_H
+#define REPLAY_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+
+#define PROGMEM
+#define PSTR(s)             (s)
+#define pgm_read_byte(p)    (*(const uint8_t *)(p))
+#define pgm_read_word(p)    (*(const uint16_t *)(p))
+#define pgm_read_dword(p)   (*(const uint32_t *)(p))
+#define memcpy_P            memcpy
+
+#endif
@@ -0,0 +1,8 @@
+/* Teensy Simple Gamepad - host replay build: the clock is not scaled */
+#ifndef REPLAY_AVR_POWER_H
+#define REPLAY_AVR_POWER_H
+
+#define clock_prescale_set(x)   ((void)(x))
+#define clock_div_1             0
+
+#endif
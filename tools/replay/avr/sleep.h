@@ -0,0 +1,14 @@
+/* Teensy Simple Gamepad - host replay build: sleeping does nothing */
+#ifndef REPLAY_AVR_SLEEP_H
+#define REPLAY_AVR_SLEEP_H
+
+#define SLEEP_MODE_IDLE         0
+#define SLEEP_MODE_PWR_DOWN     4
+#define set_sleep_mode(mode)    ((void)(mode))
+#define sleep_enable()          ((void)0)
+#define sleep_disable()         ((void)0)
+#define sleep_cpu()             ((void)0)
+#define sleep_mode()            ((void)0)
+#define sleep_bod_disable()     ((void)0)
+
+#endif
@@ -0,0 +1,7 @@
+/* Teensy Simple Gamepad - host replay build: there is no watchdog */
+#ifndef REPLAY_AVR_WDT_H
+#define REPLAY_AVR_WDT_H
+
+#define wdt_reset()     ((void)0)
+
+#endif
@@ -0,0 +1,378 @@
+/* Teensy Simple Gamepad
+ * A Gamepad device with one 2-axis D-pad and 1 or more buttons
+ * Copyright (C) 2013 Robert Byam, robertbyam.com
+ *
+ * Derived from keyboard and serial examples for Teensy USB Development Board
+ * http://www.pjrc.com/teensy/usb_keyboard.html
+ * http://www.pjrc.com/teensy/usb_serial.html
+ * Copyright (c) 2008 PJRC.COM, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* ===========================================================================
+   This software implements a generic gamepad with one 2-axis (four direction)
+   D-Pad and 1 or more button.  The intended usage is that all of these files
+   remain constant, and only the file simple_gamepad_config.h is modified to
+   specify the configurable parameters for the gamepad
+
+   tools/replay/replay.c
+   This file replays a black-box recording (see USE_BLACKBOX) through the
+   gamepad's own code, built for the host with the shims of this directory
+   in place of avr-libc, to reproduce the reports it sent. It reads the
+   recording as written by tools/gamepad_blackbox.py --events:
+     M remap bytes          the button remapping, written to the EEPROM
+     F frame ports          the input pins, as sampled in a frame
+     S frame outcome        a send that failed (1 offline, 2 timed out)
+   and prints each report that changed as "R frame bytes", each analog
+   report (USE_SPLIT_REPORTS) as "A frame bytes", and each failed send as
+   "S frame outcome", frame by frame. Every frame without a change
+   is sampled once as well, as the turbo and macro engine runs on frames.
+   The inputs other than the pins (expanders, link, ADC, Hall-effect
+   switches) are not recorded and stay at rest.
+
+   With -p the host polls too: the two banks of the gamepad endpoint are
+   modelled, the host takes the oldest report loaded at the start of every
+   POLL_INTERVAL_MS-th frame, printed as "H frame bytes", and a report that
+   finds both banks full stays pending, sent again at the next sample as by
+   the main loop. This shows when the host actually sees each report, e.g.
+   with and without USE_FRESH_REPORTS.
+   ======================================================================== */
+
+#include "simple_gamepad_defs.h"
+#include "simple_gamepad_usb.h"
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REPLAY_REG8(n)  volatile uint8_t n;
+#define REPLAY_REG16(n) volatile uint16_t n;
+#include "replay_regs.h"
+
+volatile uint8_t usb_configuration = 1;
+
+/* the ports in the order of READ_ALL_INPUTS and of the recording */
+#if defined(__AVR_ATmega32U4__)
+static volatile uint8_t *const replay_pins[] = { &PINB, &PINC, &PIND, &PINE, &PINF };
+#elif defined(__AVR_AT90USB162__)
+static volatile uint8_t *const replay_pins[] = { &PINB, &PINC, &PIND };
+#else
+static volatile uint8_t *const replay_pins[] = { &PINA, &PINB, &PINC, &PIND, &PINE, &PINF };
+#endif
+#define REPLAY_PORT_COUNT   (sizeof(replay_pins) / sizeof(replay_pins[0]))
+
+/* the report written to the endpoint by the last send */
+static uint8_t report[64];
+static uint8_t reportLength;
+static uint8_t lastReport[64];
+static uint8_t lastLength;
+#if USE_SPLIT_REPORTS
+/* the analog report written by the last analog send, if any */
+static uint8_t analog[8];
+static uint8_t analogLength;
+#endif
+
+static uint8_t eeprom[4096];
+
+/* the frame being replayed, and whether it has been sampled yet */
+static unsigned long now;
+static uint8_t sampled;
+
+/* the host's polls (-p): the reports loaded in the two banks of the
+   gamepad endpoint and not collected yet, the oldest first, and its UEINTX
+   as last handed out, to tell the writes made to it since */
+static uint8_t hostPolls;
+static uint8_t banks[2][sizeof(report)];
+static uint8_t bankLengths[2];
+static uint8_t bankCount;
+static volatile uint8_t gamepadIntx;
+static uint8_t gamepadIntxLeft;
+static volatile uint8_t gamepadSta0x;
+
+
+static void replay_print(char kind, unsigned long frame, const uint8_t *bytes, uint8_t length);
+
+
+/* this function starts the next frame: the host collects the oldest report
+   loaded, if it polls in this frame */
+static void
+replay_frame(unsigned long frame)
+{
+    now = frame;
+    sampled = 0;
+    UDFNUML = frame;
+    UDFNUMH = (frame >> 8) & 0x07;
+    if (!hostPolls || frame % POLL_INTERVAL_MS != 0 || !bankCount)
+        return;
+    replay_print('H', frame, banks[0], bankLengths[0]);
+    memmove(banks[0], banks[1], bankLengths[1]);
+    bankLengths[0] = bankLengths[1];
+    bankCount--;
+}
+
+
+/* this function returns UEINTX (status 0) or UESTA0X (status 1) of the
+   selected endpoint. Those of the gamepad endpoint are modelled with -p:
+   a write to UEINTX is acted on at the next access, a cleared FIFOCON
+   loading the report written and a set KILLBK killing the last bank
+   loaded. The other endpoints always have room */
+volatile uint8_t *
+replay_endpoint(uint8_t status)
+{
+    static volatile uint8_t otherIntx, otherSta0x;
+
+    if (!hostPolls)
+        return status ? &otherSta0x : &otherIntx;
+    if (gamepadIntx != gamepadIntxLeft)
+    {
+        if (gamepadIntx & (1<<KILLBK))
+        {
+            if (bankCount)
+                bankCount--;
+        }
+        else if (!(gamepadIntx & (1<<FIFOCON)) && bankCount < 2)
+        {
+            memcpy(banks[bankCount], report, reportLength);
+            bankLengths[bankCount++] = reportLength;
+        }
+    }
+    gamepadIntx = bankCount < 2 ? (1<<RWAL) | (1<<FIFOCON) : 0;
+    gamepadIntxLeft = gamepadIntx;
+    gamepadSta0x = bankCount;
+    if (UENUM != GAMEPAD_ENDPOINT)
+    {
+        otherIntx = (1<<RWAL) | (1<<FIFOCON);
+        otherSta0x = 0;
+        return status ? &otherSta0x : &otherIntx;
+    }
+    return status ? &gamepadSta0x : &gamepadIntx;
+}
+
+
+volatile uint8_t *
+replay_fifo(void)
+{
+    static uint8_t other;
+
+    // only the gamepad reports are replayed, not the keyboard's
+#if USE_SPLIT_REPORTS
+    if (UENUM == ANALOG_ENDPOINT && analogLength < sizeof(analog))
+        return &analog[analogLength++];
+#endif
+    if (UENUM != GAMEPAD_ENDPOINT)
+        return &other;
+    if (reportLength == sizeof(report))
+        reportLength--;
+    return &report[reportLength++];
+}
+
+
+void
+eeprom_read_block(void *dst, const void *src, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        ((uint8_t *)dst)[i] = eeprom_read_byte((const uint8_t *)src + i);
+    }
+}
+
+
+void
+eeprom_update_block(const void *src, void *dst, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        eeprom_update_byte((uint8_t *)dst + i, ((const uint8_t *)src)[i]);
+    }
+}
+
+
+uint8_t
+eeprom_read_byte(const uint8_t *p)
+{
+    return eeprom[(uintptr_t)p % sizeof(eeprom)];
+}
+
+
+uint16_t
+eeprom_read_word(const uint16_t *p)
+{
+    return eeprom_read_byte((const uint8_t *)p) |
+           (eeprom_read_byte((const uint8_t *)p + 1) << 8);
+}
+
+
+void
+eeprom_update_byte(uint8_t *p, uint8_t value)
+{
+    eeprom[(uintptr_t)p % sizeof(eeprom)] = value;
+}
+
+
+void
+eeprom_update_word(uint16_t *p, uint16_t value)
+{
+    eeprom_update_byte((uint8_t *)p, value);
+    eeprom_update_byte((uint8_t *)p + 1, value >> 8);
+}
+
+
+/* this function prints a report */
+static void
+replay_print(char kind, unsigned long frame, const uint8_t *bytes, uint8_t length)
+{
+    uint8_t i;
+
+    printf("%c %lu", kind, frame);
+    for (i = 0; i < length; i++)
+    {
+        printf(" %02x", bytes[i]);
+    }
+    printf("\n");
+}
+
+
+/* this function samples the pins as the main loop does, and sends the
+   report if it changed, if one is pending or if forced to, printing it if
+   it was loaded and differs from the last one printed, with the frame it
+   was loaded in. The analog report is printed whenever one is sent */
+static void
+replay_sample(uint8_t force)
+{
+    static uint8_t pending;
+
+    sampled = 1;
+    if (simple_gampad_read_buttons() || pending || force)
+    {
+        if (!hostPolls)
+            UEINTX = 1 << RWAL;
+        reportLength = 0;
+        pending = usb_simple_gamepad_send() > 0;
+        // the last access acts on the write that loaded the report
+        (void)UESTA0X;
+        if (reportLength &&
+            (reportLength != lastLength || memcmp(report, lastReport, reportLength)))
+        {
+            replay_print('R', now, report, reportLength);
+            memcpy(lastReport, report, reportLength);
+            lastLength = reportLength;
+        }
+    }
+#if USE_SPLIT_REPORTS
+    if (!hostPolls)
+        UEINTX = 1 << RWAL;
+    analogLength = 0;
+    usb_simple_gamepad_send_analog();
+    if (analogLength)
+        replay_print('A', now, analog, analogLength);
+#endif
+}
+
+
+/* this function replays the frames up to frame, sampling each once */
+static void
+replay_until(unsigned long frame)
+{
+    while (now < frame)
+    {
+        if (!sampled)
+            replay_sample(0);
+        replay_frame(now + 1);
+    }
+}
+
+
+int
+main(int argc, char **argv)
+{
+    char line[256];
+    char *p, *end;
+    unsigned long frame;
+    uint8_t i, started = 0, first = 0;
+#if USE_BUTTON_REMAP
+    uint8_t map[DIRECT_BUTTON_COUNT];
+#endif
+
+    if (argc > 1 && !strcmp(argv[1], "-p"))
+        hostPolls = 1;
+    else if (argc > 1)
+    {
+        fprintf(stderr, "usage: %s [-p] < recording\n", argv[0]);
+        return 2;
+    }
+
+    // the EEPROM of a new part is erased
+    memset(eeprom, 0xFF, sizeof(eeprom));
+
+    while (fgets(line, sizeof(line), stdin))
+    {
+        p = line + 1;
+        if (line[0] == 'M')
+        {
+#if USE_BUTTON_REMAP
+            for (i = 0; i < DIRECT_BUTTON_COUNT; i++)
+            {
+                map[i] = strtoul(p, &end, 16);
+                if (end == p)
+                    break;
+                p = end;
+            }
+            if (i != DIRECT_BUTTON_COUNT || !simple_gamepad_remap_write(map))
+                fprintf(stderr, "replay: remapping not valid for this build, ignored\n");
+#endif
+            continue;
+        }
+        if (line[0] != 'F' && line[0] != 'S')
+            continue;
+
+        frame = strtoul(p, &end, 10);
+        p = end;
+        if (!started)
+        {
+            // the gamepad starts as it does on power up
+            simple_gamepad_configure();
+            replay_frame(frame);
+            started = 1;
+            first = 1;
+        }
+        // the frames in between, in which the pins did not change
+        replay_until(frame);
+
+        if (line[0] == 'S')
+        {
+            printf("S %lu %lu\n", frame, strtoul(p, NULL, 10));
+            continue;
+        }
+        for (i = 0; i < REPLAY_PORT_COUNT; i++)
+        {
+            *replay_pins[i] = strtoul(p, &end, 16);
+            p = end;
+        }
+        // the first sample is sent whatever it reads, as on power up
+        replay_sample(first);
+        first = 0;
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+/* Teensy Simple Gamepad - host replay build: the list of the registers,
+   expanded by avr/io.h to declare them and by replay.c to define them.
+   UEDATX, UEINTX and UESTA0X are not in it, see avr/io.h */
+REPLAY_REG8(PINA) REPLAY_REG8(PINB) REPLAY_REG8(PINC)
+REPLAY_REG8(PIND) REPLAY_REG8(PINE) REPLAY_REG8(PINF)
+REPLAY_REG8(DDRA) REPLAY_REG8(DDRB) REPLAY_REG8(DDRC)
+REPLAY_REG8(DDRD) REPLAY_REG8(DDRE) REPLAY_REG8(DDRF)
+REPLAY_REG8(PORTA) REPLAY_REG8(PORTB) REPLAY_REG8(PORTC)
+REPLAY_REG8(PORTD) REPLAY_REG8(PORTE) REPLAY_REG8(PORTF)
+REPLAY_REG8(SREG) REPLAY_REG8(CLKPR) REPLAY_REG8(SMCR) REPLAY_REG8(MCUCR)
+REPLAY_REG8(MCUSR) REPLAY_REG8(PRR0) REPLAY_REG8(PRR1)
+REPLAY_REG8(GPIOR0) REPLAY_REG8(GPIOR1) REPLAY_REG8(GPIOR2)
+REPLAY_REG8(UHWCON) REPLAY_REG8(USBCON) REPLAY_REG8(USBSTA)
+REPLAY_REG8(USBINT) REPLAY_REG8(UDCON) REPLAY_REG8(UDINT)
+REPLAY_REG8(UDIEN) REPLAY_REG8(UDADDR) REPLAY_REG8(UDFNUML)
+REPLAY_REG8(UDFNUMH) REPLAY_REG8(UDMFN)
+REPLAY_REG8(UENUM) REPLAY_REG8(UERST) REPLAY_REG8(UECONX)
+REPLAY_REG8(UECFG0X) REPLAY_REG8(UECFG1X)
+REPLAY_REG8(UESTA1X) REPLAY_REG8(UEIENX) REPLAY_REG8(UEBCLX)
+REPLAY_REG8(UEBCHX) REPLAY_REG8(UEINT) REPLAY_REG8(PLLCSR)
+REPLAY_REG8(PLLFRQ)
+REPLAY_REG8(TCCR0A) REPLAY_REG8(TCCR0B) REPLAY_REG8(TCNT0)
+REPLAY_REG8(OCR0A) REPLAY_REG8(OCR0B) REPLAY_REG8(TIMSK0) REPLAY_REG8(TIFR0)
+REPLAY_REG8(TCCR1A) REPLAY_REG8(TCCR1B) REPLAY_REG8(TCCR1C)
+REPLAY_REG16(TCNT1) REPLAY_REG16(OCR1A) REPLAY_REG16(OCR1B)
+REPLAY_REG8(TIMSK1) REPLAY_REG8(TIFR1)
+REPLAY_REG8(TCCR3A) REPLAY_REG8(TCCR3B) REPLAY_REG16(TCNT3)
+REPLAY_REG8(PCICR) REPLAY_REG8(PCMSK0) REPLAY_REG8(PCMSK1) REPLAY_REG8(PCIFR)
+REPLAY_REG8(EICRA) REPLAY_REG8(EICRB) REPLAY_REG8(EIMSK) REPLAY_REG8(EIFR)
+REPLAY_REG8(TWBR) REPLAY_REG8(TWSR) REPLAY_REG8(TWCR) REPLAY_REG8(TWDR)
+REPLAY_REG8(TWAR)
+REPLAY_REG8(UCSR1A) REPLAY_REG8(UCSR1B) REPLAY_REG8(UCSR1C)
+REPLAY_REG16(UBRR1) REPLAY_REG8(UDR1)
+REPLAY_REG8(ADMUX) REPLAY_REG8(ADCSRA) REPLAY_REG8(ADCSRB) REPLAY_REG8(ADCL)
+REPLAY_REG8(ADCH) REPLAY_REG16(ADC) REPLAY_REG8(DIDR0) REPLAY_REG8(DIDR2)
+REPLAY_REG8(EEARL) REPLAY_REG16(EEAR) REPLAY_REG8(EECR) REPLAY_REG8(EEDR)
+REPLAY_REG8(WDTCSR) REPLAY_REG8(SPCR) REPLAY_REG8(SPSR) REPLAY_REG8(SPDR)
+REPLAY_REG8(ACSR)
@@ -0,0 +1,9 @@
+/* Teensy Simple Gamepad - host replay build: everything is atomic */
+#ifndef REPLAY_UTIL_ATOMIC_H
+#define REPLAY_UTIL_ATOMIC_H
+
+#define ATOMIC_BLOCK(type)      for (int replay_once = 1; replay_once; replay_once = 0)
+#define ATOMIC_RESTORESTATE     0
+#define ATOMIC_FORCEON          0
+
+#endif
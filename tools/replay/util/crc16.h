@@ -0,0 +1,21 @@
+/* Teensy Simple Gamepad - host replay build: the avr-libc CRC the gamepad
+   uses, as avr-libc documents it */
+#ifndef REPLAY_UTIL_CRC16_H
+#define REPLAY_UTIL_CRC16_H
+
+#include <stdint.h>
+
+static inline uint8_t
+_crc8_ccitt_update(uint8_t crc, uint8_t data)
+{
+    uint8_t i;
+
+    crc ^= data;
+    for (i = 0; i < 8; i++)
+    {
+        crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+#endif
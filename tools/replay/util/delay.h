@@ -0,0 +1,8 @@
+/* Teensy Simple Gamepad - host replay build: delays take no time */
+#ifndef REPLAY_UTIL_DELAY_H
+#define REPLAY_UTIL_DELAY_H
+
+#define _delay_ms(ms)   ((void)(ms))
+#define _delay_us(us)   ((void)(us))
+
+#endif
@@ -0,0 +1,216 @@
+#!/usr/bin/env python3
+# Teensy Simple Gamepad - checks of the input and report code on the host.
+#
+#   tools/replay_check.py [--workdir DIR] [--make make] [--cc cc] [-v]
+#
+# Builds the black-box replay (make replay, see tools/replay/replay.c) for
+# a few configurations of the Teensy 2.0, each in its own copy of the
+# sources under --workdir with simple_gamepad_config.h changed, plays
+# input pin sequences through it and compares the reports with those
+# expected. Prints one line per check, PASS or FAIL with the first
+# difference (all of them with -v), and exits non-zero if any failed.
+#
+#   fresh_reports          USE_FRESH_REPORTS: two changes within one host
+#                          poll reach the host at that poll, and a button
+#                          pressed and released within one poll still
+#                          reaches it
+#   queued_reports         without it, the second change of a poll reaches
+#                          the host a poll late
+#   socd_MODE_DPAD         every sequence of four samples of UP, DOWN, LEFT
+#                          and RIGHT, from all released, for each SOCD_MODE
+#                          and DPAD_MODE, against a model of the modes in
+#                          this file rather than the table of the gamepad
+
+import argparse
+import glob
+import os
+import re
+import shutil
+import subprocess
+import sys
+
+TREE = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+MCU = 'atmega32u4'
+
+# the Teensy 2.0 ports in the order of the recording, and the pins of the
+# D-pad and of the first buttons
+PORTS = 'BCDEF'
+UP, DOWN, LEFT, RIGHT = 'B0', 'B1', 'B2', 'B3'
+BTN6, BTN8 = 'C6', 'D7'
+
+# every check starts from the same known configuration
+BASE = [('BUTTON_COUNT', '8'), ('DPAD_MODE', 'DPAD_AXES'), ('POLL_INTERVAL_MS', '10'),
+        ('USE_POLL_PHASE_TRACKING', '0'), ('TURBO_BUTTONS', '0'), ('MACRO_COUNT', '0')]
+
+
+def frame(n, *pressed):
+    """an F line of the recording, with the pins given pressed (low)"""
+    ports = [0xFF] * len(PORTS)
+    for pin in pressed:
+        ports[PORTS.index(pin[0])] &= ~(1 << int(pin[1]))
+    return 'F %d %s' % (n, ' '.join('%02x' % p for p in ports))
+
+
+def prepare(workdir, settings):
+    """copies the sources into workdir and sets the configuration there"""
+    if os.path.isdir(workdir):
+        shutil.rmtree(workdir)
+    os.makedirs(workdir)
+    for path in glob.glob(os.path.join(TREE, '*.[ch]')) + [os.path.join(TREE, 'Makefile')]:
+        shutil.copy(path, workdir)
+    shutil.copytree(os.path.join(TREE, 'tools', 'replay'), os.path.join(workdir, 'tools', 'replay'))
+    config = os.path.join(workdir, 'simple_gamepad_config.h')
+    with open(config) as f:
+        text = f.read()
+    for name, value in BASE + settings:
+        text, n = re.subn(r'^(#define\s+%s)\b.*$' % name,
+                          lambda m: m.group(1) + ' ' + value, text, flags=re.M)
+        if n != 1:
+            sys.exit('%s not found in simple_gamepad_config.h' % name)
+    with open(config, 'w') as f:
+        f.write(text)
+
+
+# each check: its name, configuration, replay options, recording, and the
+# lines expected of the kinds given
+FRESH_INPUT = [
+    frame(0),
+    frame(12, BTN8),            # a press, then a second one in the same poll
+    frame(15, BTN8, BTN6),
+    frame(32),
+    frame(42, BTN8),            # a tap within one poll
+    frame(45),
+    frame(70),
+]
+
+CHECKS = [
+    ('fresh_reports', [('USE_FRESH_REPORTS', '1')], ['-p'], FRESH_INPUT, 'H', [
+        'H 10 00 00 00',
+        'H 20 00 00 a0',        # both presses at the first poll
+        'H 40 00 00 00',
+        'H 50 00 00 80',        # the tap is kept, not replaced by the release
+        'H 60 00 00 00',
+    ]),
+    ('queued_reports', [('USE_FRESH_REPORTS', '0')], ['-p'], FRESH_INPUT, 'H', [
+        'H 10 00 00 00',
+        'H 20 00 00 80',
+        'H 30 00 00 a0',        # the second press a poll late
+        'H 40 00 00 00',
+        'H 50 00 00 80',
+        'H 60 00 00 00',
+    ]),
+]
+
+
+# the D-pad of the report in axes mode, x then y, and in hat mode, for each
+# resolved direction of the y and x axes: 0 center, 1 UP or LEFT, 2 DOWN or
+# RIGHT
+AXIS_VALUES = ('00', '81', '7f')
+HAT_VALUES = {(0, 0): 8, (1, 0): 0, (1, 2): 1, (0, 2): 2, (2, 2): 3,
+              (2, 0): 4, (2, 1): 5, (0, 1): 6, (1, 1): 7}
+SOCD_MODES = ('SOCD_PRIORITY', 'SOCD_NEUTRAL', 'SOCD_LAST_WIN', 'SOCD_FIRST_WIN')
+
+
+class SocdAxis:
+    """one axis as SOCD_MODE documents it: first is UP or LEFT, second
+    DOWN or RIGHT, and of two presses in one sample the first is taken as
+    the most recent"""
+
+    def __init__(self, mode):
+        self.mode = mode
+        self.held = (0, 0)
+        self.last = 0
+
+    def sample(self, first, second):
+        if second and not self.held[1]:
+            self.last = 2
+        if first and not self.held[0]:
+            self.last = 1
+        self.held = (first, second)
+        if not first or not second:
+            return 1 if first else (2 if second else 0)
+        if self.mode == 'SOCD_PRIORITY':
+            return 1
+        if self.mode == 'SOCD_NEUTRAL':
+            return 0
+        if self.mode == 'SOCD_LAST_WIN':
+            return self.last
+        return 3 - self.last
+
+
+def socd_check(mode, dpad):
+    """every sequence of four D-pad samples, each followed by a release"""
+    recording, expected = [], []
+    y, x = SocdAxis(mode), SocdAxis(mode)
+    last = None
+    n = 0
+    for seq in range(16 ** 4):
+        steps = [(seq >> (4 * i)) & 15 for i in range(4)] + [0]
+        for bits in steps:
+            pressed = [pin for i, pin in enumerate((UP, DOWN, LEFT, RIGHT)) if bits & (1 << i)]
+            recording.append(frame(n, *pressed))
+            dy = y.sample(bits & 1, (bits >> 1) & 1)
+            dx = x.sample((bits >> 2) & 1, (bits >> 3) & 1)
+            if dpad == 'DPAD_AXES':
+                report = 'R %d %s %s 00' % (n, AXIS_VALUES[dx], AXIS_VALUES[dy])
+            else:
+                report = 'R %d %02x 00' % (n, HAT_VALUES[(dy, dx)])
+            if report.split()[2:] != last:
+                expected.append(report)
+                last = report.split()[2:]
+            n += 1
+    name = 'socd_%s_%s' % (mode[5:].lower(), dpad[5:].lower())
+    return (name, [('SOCD_MODE', mode), ('DPAD_MODE', dpad)], [], recording, 'R', expected)
+
+
+CHECKS += [socd_check(mode, dpad) for mode in SOCD_MODES for dpad in ('DPAD_AXES', 'DPAD_HAT')]
+
+
+def run_check(args, name, settings, options, recording, kinds, expected):
+    workdir = os.path.join(args.workdir, name)
+    prepare(workdir, settings)
+    build = subprocess.run([args.make, '-C', workdir, 'MCU=' + MCU, 'HOSTCC=' + args.cc, 'replay'],
+                           stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                           universal_newlines=True)
+    if build.returncode != 0:
+        sys.stderr.write(build.stdout)
+        return ['build failed']
+    replay = subprocess.run([os.path.join(workdir, 'simple_gamepad_replay')] + options,
+                            input='\n'.join(recording) + '\n', stdout=subprocess.PIPE,
+                            universal_newlines=True)
+    got = [line for line in replay.stdout.splitlines() if line[:1] in kinds]
+    errors = []
+    for i in range(max(len(got), len(expected))):
+        want = expected[i] if i < len(expected) else '(nothing)'
+        have = got[i] if i < len(got) else '(nothing)'
+        if want != have:
+            errors.append('expected %s, got %s' % (want, have))
+    return errors
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Gamepad checks on the host')
+    ap.add_argument('--workdir', default='_replay_check')
+    ap.add_argument('--make', default='make')
+    ap.add_argument('--cc', default='cc')
+    ap.add_argument('-v', '--verbose', action='store_true')
+    args = ap.parse_args()
+
+    failed = 0
+    for check in CHECKS:
+        errors = run_check(args, *check)
+        if errors:
+            failed += 1
+            print('FAIL %s: %s' % (check[0], errors[0]))
+            if args.verbose:
+                for error in errors[1:]:
+                    print('    ' + error)
+        else:
+            print('PASS %s' % check[0])
+    print('%d of %d checks failed' % (failed, len(CHECKS)) if failed else
+          'all %d checks passed' % len(CHECKS))
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()